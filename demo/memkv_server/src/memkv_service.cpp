@@ -106,6 +106,70 @@ private:
 	raft::version ver_;
 	bool done_;
 };
+class read_index_future : public raft::read_index_callback
+{
+public:
+	read_index_future()
+		:done_(false)
+	{
+		acl_assert(acl_pthread_cond_init(&cond_, NULL) == 0);
+		acl_assert(acl_pthread_mutex_init(&mutex_, NULL) == 0);
+	}
+
+	~read_index_future()
+	{
+		acl_pthread_cond_destroy(&cond_);
+		acl_pthread_mutex_destroy(&mutex_);
+	}
+	void operator()(replicate_status_t status, raft::log_index_t)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		done_ = true;
+		status_ = status;
+		//notify .store up to date or lost leadership
+		acl_pthread_cond_signal(&cond_);
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+	//wait for store up to date or error
+	void wait()
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		while (!done_)
+			acl_pthread_cond_wait(&cond_, &mutex_);
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+	replicate_status_t status()
+	{
+		return status_;
+	}
+private:
+	acl_pthread_mutex_t mutex_;
+	acl_pthread_cond_t cond_;
+	replicate_status_t status_;
+	bool done_;
+};
+
+//wait for store up to date to read it linearizably.
+//set RESP::status and return false if failed
+template<class RESP>
+bool read_index(RESP &resp, raft::node *node)
+{
+	read_index_future future;
+	if (!node->read_index(&future))
+	{
+		resp.status = "no leader";
+		return false;
+	}
+	future.wait();
+	//maybe node lost leadership.
+	if (future.status() != raft::replicate_callback::E_OK)
+	{
+		resp.status = "no leader";
+		return false;
+	}
+	return true;
+}
+
 static inline std::string to_string(const acl::string &data)
 {
 	return std::string(data.c_str(), data.size());
@@ -235,6 +299,8 @@ void memkv_service::init_raft_node()
 	node_->set_max_log_count((size_t) cfg_.max_log_count);
 	node_->set_metadata_path(cfg_.metadata_path);
 	node_->set_snapshot_path(cfg_.snapshot_path);
+	//http_rpc worker threads replicate concurrently.write them in batch
+	node_->set_replicate_coalescing(1024, 4 * 1024 * 1024, 100);
 
 	std::vector<raft::peer_info> peer_infos;
 	for (size_t i = 0; i < cfg_.peer_addrs.size(); i++)
@@ -291,6 +357,11 @@ void memkv_service::regist_service()
 	server_.on_pb(service_path, node_,
                   &raft::node::handle_install_snapshot_request);
 
+	//batched heartbeats
+	service_path.format("/memkv%s/raft/heartbeat_req", id);
+	server_.on_pb(service_path, node_,
+                  &raft::node::handle_heartbeat_request);
+
 }
 void memkv_service::reload()
 {
@@ -453,8 +524,8 @@ failed:
 	return false;
 }
 /*
-	apply invoke from raft framework.it mean leader replicate
-	data to this node, and data has be committed.
+	apply invoke from raft framework.it mean data has be committed.
+	leader and followers apply data here.
 */
 bool memkv_service::apply(const std::string& data,
 	const raft::version& ver)
@@ -516,7 +587,10 @@ bool memkv_service::get(const get_req &req, get_resp &resp)
 		return true;
 	}
 
-	
+	//no log written for read
+	if (!read_index(resp, node_))
+		return true;
+
 	acl::lock_guard lg(mem_store_locker_);
 	memkv_store_t::iterator it = store_.find(req.key);
 	if (it != store_.end())
@@ -536,6 +610,10 @@ bool memkv_service::exist(const exist_req &req, exist_resp& resp)
 		resp.status = "no leader";
 		return true;
 	}
+
+	if (!read_index(resp, node_))
+		return true;
+
 	acl::lock_guard lg(mem_store_locker_);
 	memkv_store_t::iterator it = store_.find(req.key);
 	if (it != store_.end())
@@ -562,11 +640,9 @@ bool memkv_service::set(const set_req &req, set_resp &resp)
 		logger("set failed");
 		return true;
 	}
-	// status ok .set key to store
+	// status ok .key has been set to store by apply()
 	acl::lock_guard lg(mem_store_locker_);
     writes_ ++;
-	store_[req.key] = store_[req.value];
-	curr_ver_ = ver;
 
 	return true;
 }
@@ -593,10 +669,7 @@ bool memkv_service::del(const del_req &req, del_resp &resp)
 		return true;
 	}
 
-	// status ok .del value from store
-	acl::lock_guard lg(mem_store_locker_);
-	store_.erase(req.key);
-	curr_ver_ = ver;
+	// status ok .key has been erased from store by apply()
 
 	return true;
 }
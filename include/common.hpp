@@ -98,6 +98,40 @@ namespace raft
 		buffer_ += sizeof(value);
 		return value;
 	}
+	//little endian
+	inline void put_le_uint32(unsigned char *&buffer_, unsigned int value)
+	{
+		buffer_[0] = (unsigned char)(value & 0xff);
+		buffer_[1] = (unsigned char)(((value) >> 8) & 0xff);
+		buffer_[2] = (unsigned char)(((value) >> 16) & 0xff);
+		buffer_[3] = (unsigned char)(((value) >> 24) & 0xff);
+		buffer_ += sizeof(value);
+	}
+
+	inline unsigned int get_le_uint32(unsigned char *&buffer_)
+	{
+		unsigned int value =
+			((unsigned int)buffer_[0]) |
+			(((unsigned int)buffer_[1]) << 8) |
+			(((unsigned int)buffer_[2]) << 16) |
+			(((unsigned int)buffer_[3]) << 24);
+		buffer_ += sizeof(value);
+		return value;
+	}
+
+	inline void put_le_uint64(unsigned char *&buffer_, unsigned long long value)
+	{
+		put_le_uint32(buffer_, (unsigned int)(value & 0xffffffff));
+		put_le_uint32(buffer_, (unsigned int)(value >> 32));
+	}
+
+	inline unsigned long long get_le_uint64(unsigned char *&buffer_)
+	{
+		unsigned long long value = get_le_uint32(buffer_);
+		value |= ((unsigned long long)get_le_uint32(buffer_)) << 32;
+		return value;
+	}
+
 	inline void put_string(unsigned char *&buffer_, const std::string &str)
 	{
 		put_uint32(buffer_, (unsigned int)str.size());
@@ -124,6 +158,16 @@ namespace raft
 		buffer_ += len;
 	}
 	
+	//msg.ByteSizeLong() has be invoked,and len is the size of msg
+	inline void put_message(unsigned char *&buffer_,
+							const google::protobuf::Message &msg,
+							size_t len)
+	{
+		put_uint32(buffer_, static_cast<unsigned int>(len + sizeof(int)));
+		msg.SerializeWithCachedSizesToArray(buffer_);
+		buffer_ += len;
+	}
+
 	inline bool get_message(unsigned char *&buffer_,
 							google::protobuf::Message &entry)
 	{
@@ -262,6 +306,46 @@ namespace raft
 #endif
     }
 
+	//touch pages of [addr, addr + len) to fault them in
+	inline void prefault_mmap(void *addr, size_t len)
+	{
+		static const size_t page_size = 4096;
+		volatile unsigned char *buffer = (volatile unsigned char*)addr;
+
+		for (size_t i = 0; i < len; i += page_size)
+			buffer[i] = buffer[i];
+	}
+
+	//flush [addr, addr + len) of a mmap file to disk
+	inline bool sync_mmap(void *addr, size_t len)
+	{
+		if (!len)
+			return true;
+#if defined (_WIN32) || defined(_WIN64)
+		if (!FlushViewOfFile(addr, len))
+		{
+			logger_error("FlushViewOfFile error: %s", acl_last_serror());
+			return false;
+		}
+		return true;
+#elif defined(ACL_UNIX)
+		//msync need page align address
+		static const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+		size_t begin = (size_t)addr & ~(page_size - 1);
+
+		len += (size_t)addr - begin;
+		if (msync((void*)begin, len, MS_SYNC) == -1)
+		{
+			logger_error("msync error: %s", acl_last_serror());
+			return false;
+		}
+		return true;
+#else
+		logger_error("%s: not supported yet!", __FUNCTION__);
+		return false;
+#endif
+	}
+
 	inline std::string 
 		get_filename(const std::string &file_path)
 	{
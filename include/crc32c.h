@@ -0,0 +1,27 @@
+#pragma once
+namespace raft
+{
+	/**
+	 * \brief crc32c (Castagnoli) checksum.
+	 * use sse4.2 crc32 instruction when cpu support it,
+	 * otherwise use table lookup.
+	 * \param data data to checksum
+	 * \param len length of data
+	 * \param crc crc of data before,for checksum data in pieces
+	 * \return crc32c of data
+	 */
+	unsigned int crc32c(const void *data, size_t len, unsigned int crc = 0);
+
+	/**
+	 * \brief crc32c() by table lookup only.to check the
+	 * hardware one against it
+	 */
+	unsigned int crc32c_software(const void *data,
+								 size_t len,
+								 unsigned int crc = 0);
+
+	/**
+	 * \brief check if crc32c() use hardware instruction
+	 */
+	bool crc32c_hardware();
+}
@@ -0,0 +1,81 @@
+#pragma once
+namespace raft
+{
+	class peer;
+
+	/**
+	 * \brief send heartbeats of all the peers to the same host in
+	 * one heartbeat_request,and fan the responses back to peers.
+	 * peers of many groups in multi_raft share one batcher.
+	 * one request in flight for each host at most.heartbeats
+	 * pushed when it is in flight are sent after it done.
+	 */
+	class heartbeat_batcher
+	{
+	public:
+		/**
+		 * \param _scheduler scheduler to run senders
+		 * \param _transport transport to send heartbeats
+		 * \param window milliseconds to wait for more heartbeats
+		 * to the same host before send
+		 */
+		heartbeat_batcher(scheduler &_scheduler,
+						  transport &_transport,
+						  unsigned int window = 10);
+
+		~heartbeat_batcher();
+
+		/**
+		 * \brief queue heartbeat of peer.peer::heartbeat_done()
+		 * invoked with the response later
+		 * \param _peer peer sending heartbeat
+		 * \param peer_id id of host.heartbeats to the same host
+		 * are sent together
+		 * \param req heartbeat.AppendEntries without entries
+		 */
+		void push(peer *_peer,
+				  const std::string &peer_id,
+				  const replicate_log_entries_request &req);
+
+		/**
+		 * \brief drop heartbeats of peer.and wait for the heartbeats
+		 * in flight done.peer must invoke it before destroyed
+		 * \param _peer peer to remove
+		 */
+		void remove(peer *_peer);
+
+		/**
+		 * \param window milliseconds to wait for more heartbeats
+		 */
+		void set_window(unsigned int window);
+	private:
+		//heartbeats to one host
+		class host : public scheduler::task, public transport::callback
+		{
+		public:
+			host(heartbeat_batcher &batcher, const std::string &peer_id);
+		private:
+			friend class heartbeat_batcher;
+
+			virtual void run();
+
+			virtual void rpc_done(bool ok);
+
+			heartbeat_batcher &batcher_;
+			std::string peer_id_;
+			std::vector<peer*> peers_;
+			heartbeat_request req_;
+			//peers of the request in flight
+			std::vector<peer*> sending_;
+			heartbeat_request sending_req_;
+			heartbeat_response resp_;
+		};
+
+		scheduler &scheduler_;
+		unsigned int window_;
+		transport &transport_;
+		std::map<std::string, host*> hosts_;
+		acl_pthread_mutex_t mutex_;
+		acl_pthread_cond_t cond_;
+	};
+}
@@ -1,6 +1,8 @@
 #pragma once
 namespace raft
 {
+	struct log_entry_view;
+
 	struct log 
 	{
 		/**
@@ -34,13 +36,45 @@ namespace raft
 		 * \return return log index ( > 0) if write ok.otherwise return 0;
 		 */
 		virtual log_index_t write(const log_entry &entry) = 0;
-		
+
+		/**
+		 * \brief write log entries [begin, entries.size()) to log file
+		 * as many as the log can hold.
+		 * \param entries log entries
+		 * \param begin the first one to write
+		 * \return count of entries written.return 0 if log eof
+		 */
+		virtual size_t write_batch(const std::vector<log_entry> &entries,
+								   size_t begin) = 0;
+
+		/**
+		 * \brief flush log entries written since last sync to disk
+		 * \return return true if flush ok,otherwise return false
+		 */
+		virtual bool sync() = 0;
+
 		/**
 		 * \brief truncate log, and it will delete log entry [index, last_index]
 		 * \param index index to delete
 		 * \return return true if truncate ok,otherwise return false
 		 */
 		virtual bool truncate(log_index_t index) = 0;
+
+		/**
+		 * \brief make an empty log ready to write.move log file to
+		 * file_path,and entries written start from last_index + 1
+		 * \param file_path new file path of log
+		 * \param last_index last index before this log
+		 * \return return true if ok,otherwise return false
+		 */
+		virtual bool reset(const std::string &file_path,
+						   log_index_t last_index) = 0;
+
+		/**
+		 * \brief touch all the pages of log file,so writes will not
+		 * page fault or allocate disk blocks later
+		 */
+		virtual void prefault() = 0;
 		
 
 		/**
@@ -67,6 +101,22 @@ namespace raft
 						  std::vector<log_entry*> &entries,
 						  int &bytes) = 0;
 
+		/**
+		 * \brief read log entries as views into log file.
+		 * no memory allocated for entry,no data copied.
+		 * \param index log index to read
+		 * \param max_bytes max bytes of entries data to read
+		 * \param max_count max count of entries to read
+		 * \param views buffer to store views of log entries
+		 * \param bytes size of all the log entries data
+		 * \return true if read ok, otherwise return false
+		 */
+		virtual bool read(log_index_t index,
+						  int max_bytes,
+						  int max_count,
+						  std::vector<log_entry_view> &views,
+						  int &bytes) = 0;
+
 		/**
 		 * \brief get last index of this log
 		 * \return return 0,if empty otherwise return log_index_t ( > 0)
@@ -130,8 +180,7 @@ namespace raft
 		 */
 		void inc_ref()
 		{
-			acl::lock_guard lg(locker_);
-			ref_++;
+			ref_.fetch_add(1, std::memory_order_relaxed);
 		}
 
 		/**
@@ -141,12 +190,7 @@ namespace raft
 		 */
 		void dec_ref()
 		{
-			locker_.lock();
-			ref_--;
-			int ref = ref_;
-			locker_.unlock();
-
-			if (ref == 0)
+			if (ref_.fetch_sub(1, std::memory_order_acq_rel) == 1)
 				close();
 		}
 
@@ -156,8 +200,7 @@ namespace raft
 		 */
 		int ref()
 		{
-			acl::lock_guard lg(locker_);
-			return ref_;
+			return ref_.load(std::memory_order_acquire);
 		}
 	protected:
 		/**
@@ -181,7 +224,7 @@ namespace raft
 		/**
 		 * \brief ref of log
 		 */
-		int ref_;
+		std::atomic<int> ref_;
 
 		/**
 		 * \brief ref locker
@@ -189,5 +232,75 @@ namespace raft
 		acl::locker locker_;
 	};
 
-	
+	/**
+	 * \brief view of a log entry in log file.data_ point to
+	 * the log file directly.view hold a ref of the log,so data_
+	 * is valid until the view be destroyed.
+	 */
+	struct log_entry_view
+	{
+		log_entry_view()
+			:index_(0),
+			term_(0),
+			type_(e_raft_log),
+			data_(NULL),
+			len_(0),
+			log_(NULL)
+		{
+		}
+
+		log_entry_view(const log_entry_view &other)
+			:index_(other.index_),
+			term_(other.term_),
+			type_(other.type_),
+			data_(other.data_),
+			len_(other.len_),
+			log_(other.log_)
+		{
+			if (log_)
+				log_->inc_ref();
+		}
+
+		log_entry_view &operator = (const log_entry_view &other)
+		{
+			if (this == &other)
+				return *this;
+			set_log(other.log_);
+			index_ = other.index_;
+			term_ = other.term_;
+			type_ = other.type_;
+			data_ = other.data_;
+			len_ = other.len_;
+			return *this;
+		}
+
+		~log_entry_view()
+		{
+			set_log(NULL);
+		}
+
+		/**
+		 * \brief hold a ref of _log,and release the old one
+		 */
+		void set_log(log *_log)
+		{
+			if (_log)
+				_log->inc_ref();
+			if (log_)
+				log_->dec_ref();
+			log_ = _log;
+		}
+
+		std::string data() const
+		{
+			return std::string(data_, len_);
+		}
+
+		log_index_t index_;
+		term_t term_;
+		log_entry_type type_;
+		const char *data_;
+		size_t len_;
+		log *log_;
+	};
 }
\ No newline at end of file
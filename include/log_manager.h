@@ -2,27 +2,134 @@
 
 namespace raft
 {
-	//todo add log cache
 	typedef std::map<log_index_t, log_index_t> log_infos_t;
 
 	typedef typename std::map<log_index_t, 
 		log_index_t>::iterator log_infos_iter_t;
 
+	typedef google::protobuf::RepeatedPtrField<log_entry> log_entries_t;
+
 	class log_manager
 	{
 	public:
+		/**
+		 * durability of log entries.
+		 * e_sync_none: never flush,leave it to the os.
+		 * e_sync_entry: flush as soon as sync(index) be invoked.
+		 * e_sync_group: sync(index) wait for more entries
+		 * (sync_entries) or timeout (sync_micros) and then flush
+		 * them in one go.
+		 * callers of sync(index) in the same time share one flush.
+		 */
+		enum sync_mode_t
+		{
+			e_sync_none,
+			e_sync_entry,
+			e_sync_group,
+		};
+
 		log_manager(const std::string &path);
 		
 		virtual ~log_manager();
 
+		/**
+		 * reload log files from disk.log files are opened by
+		 * reload threads in parallel.sealed log files open without
+		 * scan,so only the last one need to scan all.
+		 * @return return false if some log file open error
+		 */
 		bool reload_logs();
 
+		/**
+		 * set count of threads to reload log files.default 4
+		 * @param count count of threads
+		 */
+		void set_reload_threads(size_t count);
+
+		/**
+		 * keep spare log files created and mapped by a background
+		 * thread,so write() switch to next log file without
+		 * creating it.
+		 * @param count count of spare log files. 0 to disable
+		 * @param prefault touch all pages of spare log files
+		 */
+		void set_preallocate(size_t count, bool prefault = false);
+
 		log_index_t write(const log_entry &entry);
+
+		/**
+		 * write log entries in one go.
+		 * @param entries log entries to write
+		 * @return return index of the last entry, or 0 if error
+		 */
+		log_index_t write(const std::vector<log_entry> &entries);
+
+		/**
+		 * wait until log entries [1, index] flushed to disk.
+		 * @param index the index of log entry
+		 * @param group false to flush at once in e_sync_group mode.
+		 * the only flusher of log don't wait for a group,nobody else
+		 * writes entries while it is waiting
+		 * @return return false if flush error
+		 */
+		bool sync(log_index_t index, bool group = true);
+
+		/**
+		 * the last log index that has be flushed to disk.
+		 * it eq last_index() when sync mode is e_sync_none
+		 * @return log index
+		 */
+		log_index_t sync_index();
+
+		void set_sync_mode(sync_mode_t mode,
+						   size_t sync_entries = 0,
+						   unsigned int sync_micros = 0);
+
+		sync_mode_t sync_mode();
+
+		/**
+		 * keep the latest log entries written in memory,serialized,
+		 * so leader can build replicate requests for all the peers
+		 * from the bytes,instead of parsing them from log files and
+		 * serializing them again and again.
+		 * @param max_bytes max bytes of entries to keep. 0 to disable
+		 */
+		void set_cache_size(size_t max_bytes);
 		
 		bool read(log_index_t index, int max_bytes,int max_count,
 			std::vector<log_entry*> &entries);
 
 		bool read(log_index_t index, log_entry &entry);
+
+		/**
+		 * read views of log entries.views point to log files
+		 * directly and hold refs of them.
+		 * @return return false if no entry read
+		 */
+		bool read(log_index_t index, int max_bytes, int max_count,
+			std::vector<log_entry_view> &views);
+
+		bool read(log_index_t index, log_entry_view &view);
+
+		/**
+		 * read log entries and append them to entries.log_entry
+		 * objects cleared in entries are reused,so no memory
+		 * allocated when entries reused again and again.
+		 * @return return false if no entry read
+		 */
+		bool read(log_index_t index, int max_bytes, int max_count,
+			log_entries_t &entries);
+
+		/**
+		 * read log entries encoded as the entries field of
+		 * replicate_log_entries_request and append them to entries.
+		 * bytes of entries in cache are appended as they are,so
+		 * requests serialized with them need no log_entry objects.
+		 * @param count number of entries read
+		 * @return return false if no entry read
+		 */
+		bool read(log_index_t index, int max_bytes, int max_count,
+			std::string &entries, int &count);
 		
 		void truncate(log_index_t index);
 
@@ -34,6 +141,12 @@ namespace raft
 
 		term_t last_term();
 
+		/**
+		 * get last index and its term together.wait free,
+		 * they always belong to the same entry
+		 */
+		void last_log(log_index_t &index, term_t &term);
+
 		/**
 		 * return all logs info .
 		 * one log info is [start_log_index, last_log_index].
@@ -49,17 +162,151 @@ namespace raft
 
 		void set_last_term(term_t term);
 	protected:
+		/**
+		 * open log files [begin, begin + step, ...) in reload_logs()
+		 */
+		class reload_worker : public acl::thread
+		{
+		public:
+			reload_worker(log_manager &manager,
+						  const std::vector<std::string> &files,
+						  std::vector<log*> &logs,
+						  size_t begin,
+						  size_t step);
+		private:
+			virtual void *run();
+
+			log_manager &manager_;
+			const std::vector<std::string> &files_;
+			std::vector<log*> &logs_;
+			size_t begin_;
+			size_t step_;
+		};
+
+		/**
+		 * create spare log files in background
+		 */
+		class preallocator : public acl::thread
+		{
+		public:
+			explicit preallocator(log_manager &manager);
+		private:
+			virtual void *run();
+
+			log_manager &manager_;
+		};
 
 		virtual log *create(const std::string &file_path) = 0;
 
+		log *new_log();
+
+		log *pop_spare_log();
+
+		/**
+		 * close log and rename its files with .broken.
+		 * for log files can't be reloaded.
+		 */
+		void quarantine_log(log *_log);
+
+		/**
+		 * stop preallocator and delete spare log files.
+		 * subclass must call it in destructor
+		 */
+		void stop_preallocator();
+
+		/**
+		 * immutable snapshot of logs_.find_log() search it without
+		 * locker_.it is replaced as a whole when logs_ changed
+		 */
+		struct log_table
+		{
+			std::vector<log_index_t> start_indexes_;
+			std::vector<log*> logs_;
+		};
+
+		/**
+		 * find log which contains index.lock free
+		 * @return log with ref inc, or NULL
+		 */
 		log *find_log(log_index_t index);
 
+		/**
+		 * publish logs_ to log_table_.must hold locker_.
+		 * return after all readers of the old table done,so logs
+		 * removed from logs_ can be released after it
+		 */
+		void publish_log_table();
+
+		int lock_log_table();
+
+		void unlock_log_table(int slot);
+
+		bool do_sync(log_index_t &synced_index);
+
+		bool wait_for_group(log_index_t index);
+
+		void update_written_index(log_index_t index);
+
+		void cache_entry(const log_entry &entry);
+
+		bool read_cache(log_index_t index, int max_bytes, int max_count,
+			std::vector<log_entry*> &entries);
+
+		void truncate_cache(log_index_t index);
+
+		/**
+		 * publish last_index_ and last_term_.must hold locker_
+		 */
+		void set_last_log(log_index_t index, term_t term);
+
 		std::string		path_;
 		size_t			log_size_;
-		log_index_t		last_index_;
-		term_t			last_term_;
+		size_t			reload_threads_;
+		//seqlock of last_index_ and last_term_.odd when writing
+		std::atomic<unsigned int> last_seq_;
+		std::atomic<log_index_t> last_index_;
+		std::atomic<term_t>		last_term_;
 		acl::locker		locker_;
 		log				*last_log_;
 		std::map<log_index_t, log*> logs_;
+
+		std::atomic<log_table*> log_table_;
+		//readers of log_table_ count in table_readers_[epoch & 1]
+		std::atomic<unsigned int> table_epoch_;
+		std::atomic<int> table_readers_[2];
+
+		sync_mode_t		sync_mode_;
+		size_t			sync_entries_;
+		unsigned int	sync_micros_;
+		bool			syncing_;
+		log_index_t		synced_index_;
+		log_index_t		written_index_;
+		timeval			first_written_time_;
+		acl_pthread_mutex_t sync_mutex_;
+		acl_pthread_cond_t	sync_cond_;
+
+		//serialized log_entry in cache
+		struct cached_entry
+		{
+			log_index_t index_;
+			std::string bytes_;
+		};
+
+		//the latest log entries written. cache_[i].index_ eq
+		//cache_[0].index_ + i
+		std::deque<cached_entry> cache_;
+		size_t			cache_bytes_;
+		size_t			max_cache_bytes_;
+		acl::locker		cache_locker_;
+
+		std::list<log*>	spare_logs_;
+		size_t			spare_count_;
+		size_t			spare_seq_;
+		bool			prefault_;
+		bool			preallocator_stop_;
+		bool			preallocator_started_;
+		preallocator	preallocator_;
+		acl_pthread_mutex_t spare_mutex_;
+		acl_pthread_cond_t	spare_cond_;
 	};
 }
\ No newline at end of file
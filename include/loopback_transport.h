@@ -0,0 +1,107 @@
+#pragma once
+namespace raft
+{
+	/**
+	 * \brief in-process transport.requests are passed to the handlers
+	 * of nodes in the same process directly,without serialization
+	 * and sockets,so a whole cluster can run in one test or benchmark.
+	 * nodes of the cluster share one loopback_transport.
+	 * async calls are handled in the caller thread too.
+	 */
+	class loopback_transport : public transport
+	{
+	public:
+		loopback_transport();
+
+		~loopback_transport();
+
+		/**
+		 * \brief requests to peer_id are handled by _node
+		 */
+		void bind(const std::string &peer_id, node *_node);
+
+		/**
+		 * \brief requests to peer_id are handled by host.
+		 * multi_raft route them to its groups
+		 */
+		void bind(const std::string &peer_id, multi_raft *host);
+
+		/**
+		 * \brief remove handler of peer_id.wait for requests to it
+		 * in process done.the handler can be destroyed after it
+		 */
+		void unbind(const std::string &peer_id);
+
+		/**
+		 * \brief simulate network partition.requests to a disconnected
+		 * peer fail as rpc error
+		 * \param peer_id id of peer
+		 * \param connected false to disconnect.default true
+		 */
+		void set_connected(const std::string &peer_id, bool connected);
+
+		virtual void add_peer(const std::string &peer_id,
+							  const std::string &addr);
+
+		virtual bool vote(const std::string &peer_id,
+						  const vote_request &req,
+						  vote_response &resp);
+
+		virtual bool replicate(const std::string &peer_id,
+							   const replicate_log_entries_request &req,
+							   replicate_log_entries_response &resp);
+
+		virtual bool install_snapshot(const std::string &peer_id,
+									  const install_snapshot_request &req,
+									  install_snapshot_response &resp);
+
+		virtual bool heartbeat(const std::string &peer_id,
+							   const heartbeat_request &req,
+							   heartbeat_response &resp);
+
+		virtual void async_vote(const std::string &peer_id,
+								const vote_request &req,
+								vote_response &resp,
+								callback *_callback);
+
+		virtual void async_replicate(const std::string &peer_id,
+									 const replicate_log_entries_request &req,
+									 replicate_log_entries_response &resp,
+									 callback *_callback);
+
+		virtual void async_replicate(const std::string &peer_id,
+									 const std::string &req,
+									 replicate_log_entries_response &resp,
+									 callback *_callback);
+
+		virtual void async_install_snapshot(
+				const std::string &peer_id,
+				const install_snapshot_request &req,
+				install_snapshot_response &resp,
+				callback *_callback);
+
+		virtual void async_heartbeat(const std::string &peer_id,
+									 const heartbeat_request &req,
+									 heartbeat_response &resp,
+									 callback *_callback);
+	private:
+		struct endpoint
+		{
+			node *node_;
+			multi_raft *host_;
+			bool connected_;
+			//requests in process
+			int ref_;
+		};
+
+		endpoint *acquire_endpoint(const std::string &peer_id);
+
+		void release_endpoint(endpoint *_endpoint);
+
+		void bind(const std::string &peer_id, node *_node, multi_raft *host);
+
+		std::map<std::string, endpoint*> endpoints_;
+		acl_pthread_mutex_t mutex_;
+		acl_pthread_cond_t cond_;
+	};
+}
@@ -7,82 +7,112 @@ namespace raft
 	public:
         /**
          * metadata construct.
-         * @param max_file_size when file full.
-         * it will create new one
-         * if max_file_size too small. it create so many file
-         * (it will auto delete old file).if max_file_size too big
-         * it will take too long time to reload metadata.
+         * @param page_size size of each of the two slots of
+         * the metadata file. the whole status(term,vote_for,
+         * indexes,peer_infos) must fit in one slot.
+         * an existing file keeps the page size it was created with.
          */
-		metadata(size_t max_file_size = 8*1024*1024);
+		metadata(size_t page_size = 4096);
 
         ~metadata ();
 
         /**
-         * reload metadata
+         * reload metadata.journal files(*.meta) of old versions
+         * are migrated to the slot file and removed.
          * @param path the path to reload metadata
          * @return return true if reload ok.
          * return false some error  happen
          */
 		bool reload(const std::string &path);
 
+        /**
+         * set committed index.written to the mmap file
+         * without flushing to disk. see sync()
+         */
 		bool set_committed_index(log_index_t index);
 
 		log_index_t get_committed_index();
 
+        /**
+         * set applied index.written to the mmap file
+         * without flushing to disk. see sync()
+         */
 		bool set_applied_index(log_index_t index);
 
 		log_index_t get_applied_index();
 
+        /**
+         * set current term.flushed to disk before return
+         */
 		bool set_current_term(term_t term);
 
 		term_t get_current_term();
 
+        /**
+         * set vote for.flushed to disk before return
+         */
 		bool set_vote_for(const std::string &id, term_t term);
 
 		std::pair<term_t,std::string> get_vote_for();
 
+        /**
+         * set peer infos.flushed to disk before return
+         */
 		bool set_peer_infos(const std::vector<peer_info> &infos);
 
 		std::vector<peer_info> get_peer_info();
 
+        /**
+         * flush committed/applied index written
+         * after the last flush to disk.
+         * @return return false if flush failed
+         */
+		bool sync();
+
         void print_status();
 	private:
-        bool create_new_file ();
+		bool open(const std::string &file_path);
 
-		bool check_remain_buffer(size_t size);
+		bool check_slot(int slot, unsigned long long &seq);
 
-		bool load_committed_index();
+		void load_slot(int slot);
 
-		bool load_applied_index();
+		bool write_slot(bool durable);
 
-		bool load_vote_for();
-		
-		bool load_current_term();
+		unsigned char *slot_addr(int slot);
 
-        bool load_peer_info();
+		//old journal files
+		bool load_journal(const std::string &path);
 
-		bool reload();
+		size_t replay_journal(unsigned char *buf, size_t size);
 
-		bool open(const std::string &file_path, bool create);
+		bool replay_record(unsigned char *&buffer, unsigned char *end);
 
-		bool check_point();
+		bool check_string(unsigned char *buffer, unsigned char *end);
 
-	private:
-		size_t file_index_;
+		void remove_journal(const std::string &path);
 
-		term_t current_term_;
-		log_index_t committed_index_;
-		log_index_t applied_index_;
+	private:
+		//written under locker_,read without lock
+		std::atomic<term_t> current_term_;
+		std::atomic<log_index_t> committed_index_;
+		std::atomic<log_index_t> applied_index_;
 		std::string vote_for_;
 		term_t vote_term_;
 
 		std::vector<peer_info> peer_infos_;
 		acl::locker locker_;
-		std::string path_;
         std::string file_path_;
 
-		size_t max_buffer_size_;
-		unsigned char *write_pos_;
+		//sequence number of the newest slot
+		unsigned long long seq_;
+		//slot last flushed to disk.the other one
+		//takes the lazy writes
+		int durable_slot_;
+		//lazy writes not flushed yet
+		bool dirty_;
+
+		size_t page_size_;
 		unsigned char *buf_;
 	};
 }
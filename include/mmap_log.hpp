@@ -4,12 +4,46 @@ namespace raft
 	class mmap_log : public log
 	{
 	public:
+		/**
+		 * \brief format of log entries write to data file.
+		 * entries of all the formats can be read,so a log file
+		 * write by old version still work.
+		 */
+		enum format_t
+		{
+			//MAGIC_START | len | protobuf(log_entry) | MAGIC_END
+			e_format_protobuf,
+			//little endian header:
+			//magic | index | term | type | len | crc32c
+			//and then raw log data
+			e_format_binary,
+		};
+
+		/**
+		 * \brief when to verify crc32c of e_format_binary entries.
+		 * entries are always verified when reload log file,and log
+		 * is truncated at the first broken one.entries of sealed log
+		 * are verified in reload by e_verify_reload only.
+		 */
+		enum verify_t
+		{
+			//verify when reload only
+			e_verify_reload,
+			//verify every read
+			e_verify_always,
+			//verify one of sample_rate reads
+			e_verify_sampled,
+		};
+
 		/**
 		 * \brief mmap_log construct
 		 * \param last_index last log index 
 		 * \param file_size max file size.min is 64K
+		 * \param format format of entries to write
 		 */
-		explicit mmap_log(log_index_t last_index, size_t file_size);
+		explicit mmap_log(log_index_t last_index,
+						  size_t file_size,
+						  format_t format = e_format_protobuf);
 
         ~mmap_log();
 
@@ -17,8 +51,18 @@ namespace raft
 
 		virtual log_index_t write(const log_entry & entry);
 
+		virtual size_t write_batch(const std::vector<log_entry> &entries,
+								   size_t begin);
+
+		virtual bool sync();
+
 		virtual bool truncate(log_index_t index);
 
+		virtual bool reset(const std::string &file_path,
+						   log_index_t last_index);
+
+		virtual void prefault();
+
 		virtual bool read(log_index_t index, log_entry &entry);
 
 		virtual bool read(log_index_t index,
@@ -27,6 +71,12 @@ namespace raft
 			std::vector<log_entry*> &entries,
 			int &bytes);
 
+		virtual bool read(log_index_t index,
+			int max_bytes,
+			int max_count,
+			std::vector<log_entry_view> &views,
+			int &bytes);
+
 		virtual bool eof();
 
 		virtual bool empty();
@@ -39,11 +89,43 @@ namespace raft
 
 		virtual std::string file_path();
 
+		/**
+		 * \brief set verify policy.must be invoked before open()
+		 * \param verify verify_t
+		 * \param sample_rate for e_verify_sampled
+		 */
+		void set_verify(verify_t verify, unsigned int sample_rate = 0);
+
 	private:
 
 		virtual void close();
 
-		static bool get_entry(unsigned char *& buffer, log_entry &entry);
+		bool get_entry(unsigned char *& buffer, log_entry &entry);
+
+		bool get_entry_view(unsigned char *& buffer,
+							log_entry_view &view);
+
+		bool verify_read();
+
+		bool check_len(const unsigned char *record);
+
+		bool check_crc(const unsigned char *record);
+
+		bool check_entry(size_t offset, log_index_t index);
+
+		bool check_entries(log_index_t start_index, size_t index_offset);
+
+		bool truncate_reload(unsigned char *index_buffer);
+
+		void write_footer();
+
+		void clear_footer();
+
+		bool load_footer();
+
+		size_t entry_size(const log_entry &entry) const;
+
+		void put_entry(unsigned char *&buffer, const log_entry &entry) const;
 
 		unsigned char* get_data_buffer(log_index_t index);
 
@@ -51,6 +133,8 @@ namespace raft
 
 		static size_t one_index_size();
 
+		size_t index_remain() const;
+
 		bool reload_log();
 
 		bool set_data_wbuf(log_index_t index);
@@ -62,6 +146,12 @@ namespace raft
     private:
 		bool is_open_;
 		bool eof_;
+		//footer written but not synced
+		bool footer_dirty_;
+		format_t format_;
+		verify_t verify_;
+		unsigned int sample_rate_;
+		std::atomic<unsigned int> read_count_;
 
 		std::string data_filepath_;
 		std::string index_filepath_;
@@ -70,8 +160,12 @@ namespace raft
         term_t      last_term_;
         term_t      start_term_;
 		acl::locker write_locker_;
+		//serialize sync() and truncate()
+		acl::locker sync_locker_;
 
 		size_t data_buf_size_;
+		size_t data_sync_offset_;
+		size_t index_sync_offset_;
 		size_t index_buf_size_;
 
 		unsigned char *data_buf_;
@@ -85,7 +179,18 @@ namespace raft
 	class mmap_log_manager : public log_manager
 	{
 	public:
-		mmap_log_manager(const std::string &log_path);
+		mmap_log_manager(const std::string &log_path,
+						 mmap_log::format_t format =
+						 mmap_log::e_format_protobuf);
+
+		~mmap_log_manager();
+
+		/**
+		 * \brief set verify policy of log files.
+		 * see mmap_log::set_verify()
+		 */
+		void set_verify(mmap_log::verify_t verify,
+						unsigned int sample_rate = 0);
 
 	private:
 		/**
@@ -94,5 +199,9 @@ namespace raft
 		* \return mmap_log if ok.or NULL
 		*/
 		virtual log *create(const std::string &file_path) ;
+
+		mmap_log::format_t format_;
+		mmap_log::verify_t verify_;
+		unsigned int sample_rate_;
 	};
 }
@@ -0,0 +1,127 @@
+#pragma once
+namespace raft
+{
+	/**
+	 * \brief host many raft groups in one process.groups share
+	 * one scheduler,one transport,and the same three service
+	 * paths.requests are routed to the group by group_id of them.
+	 * one group is one node.node id of all the groups is the id
+	 * of this host,and peers of groups are other hosts.
+	 * log apply and compaction of groups run by the shared
+	 * background scheduler,so no thread is created for a group
+	 * unless its log writer enabled.
+	 */
+	class multi_raft
+	{
+	public:
+		/**
+		 * \param node_id id of this host
+		 * \param path root path.files of group are kept in
+		 * path/group_id/
+		 * \param _scheduler scheduler shared by groups
+		 * \param _transport transport shared by groups
+		 */
+		multi_raft(const std::string &node_id,
+				   const std::string &path,
+				   scheduler &_scheduler = scheduler::get_instance(),
+				   transport &_transport =
+						http_rpc_transport::get_instance());
+
+		~multi_raft();
+
+		/**
+		 * \brief create raft group.set callbacks of the node returned,
+		 * and add_group() and start() it then.requests to the group
+		 * are rejected until it added.
+		 * \param group_id id of group.unique in this host
+		 * \param peer_infos other hosts of the group
+		 * \return return node of the group.NULL if group exist
+		 */
+		node *create_group(const std::string &group_id,
+						   const std::vector<peer_info> &peer_infos);
+
+		/**
+		 * \brief reload node of group created,and route requests
+		 * to it then.group is removed if reload failed
+		 * \param group_id id of group
+		 * \return return false if not created,added already,or
+		 * reload failed
+		 */
+		bool add_group(const std::string &group_id);
+
+		/**
+		 * \brief get node of group
+		 * \param group_id id of group
+		 * \return return NULL if not found
+		 */
+		node *get_group(const std::string &group_id);
+
+		/**
+		 * \brief remove group and delete its node.wait for requests
+		 * of the group in process done.files of group are kept
+		 * \param group_id id of group
+		 * \return return false if not found
+		 */
+		bool remove_group(const std::string &group_id);
+
+		std::vector<std::string> groups();
+
+		/**
+		 * \brief set milliseconds heartbeats of groups wait for
+		 * each other before sent to a host together
+		 * \param window default 10
+		 */
+		void set_heartbeat_window(unsigned int window);
+
+		/**
+		 * \brief regist it instead of node::handle_vote_request
+		 */
+		bool handle_vote_request(const vote_request &req,
+								 vote_response &resp);
+
+		/**
+		 * \brief regist it instead of node::handle_replicate_log_request
+		 */
+		bool handle_replicate_log_request(
+				const replicate_log_entries_request &req,
+				replicate_log_entries_response &resp);
+
+		/**
+		 * \brief regist it instead of
+		 * node::handle_install_snapshot_request
+		 */
+		bool handle_install_snapshot_request(
+				const install_snapshot_request &req,
+				install_snapshot_response &resp);
+
+		/**
+		 * \brief heartbeats of groups to this host.regist it to
+		 * path /memkv{node_id}/raft/heartbeat_req
+		 */
+		bool handle_heartbeat_request(const heartbeat_request &req,
+									  heartbeat_response &resp);
+	private:
+		struct group
+		{
+			node *node_;
+			//requests in process
+			int ref_;
+			//reloaded by add_group
+			bool added_;
+		};
+
+		group *acquire_group(const std::string &group_id);
+
+		void release_group(group *_group);
+
+		std::string node_id_;
+		std::string path_;
+		scheduler &scheduler_;
+		transport &transport_;
+		heartbeat_batcher heartbeat_batcher_;
+
+		std::map<std::string, group*> groups_;
+		acl_pthread_mutex_t mutex_;
+		acl_pthread_cond_t cond_;
+	};
+}
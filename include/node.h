@@ -64,6 +64,40 @@ namespace raft
 		 */
 		virtual bool operator()(const std::string& data,
                                 const version& ver) = 0;
+
+		/**
+		 * \brief zero copy version of operator().data point to
+		 * log file directly,and it is valid only in the callback.
+		 * default one copy data and invoke the one above.
+		 */
+		virtual bool operator()(const char *data,
+								size_t len,
+								const version& ver)
+		{
+			return (*this)(std::string(data, len), ver);
+		}
+
+		/**
+		 * \brief apply a run of committed entries in one go.node
+		 * persist applied index once for each batch.views point to
+		 * log files directly,and they are valid only in the callback.
+		 * default one invoke operator() for each of them.
+		 * \param views committed entries.index of them increase one
+		 * by one
+		 * \param count count of views
+		 * \return return count of entries applied.node invoke it
+		 * again from the first entry not applied.
+		 */
+		virtual size_t apply_batch(const log_entry_view *views, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				version ver(views[i].index_, views[i].term_);
+				if (!(*this)(views[i].data_, views[i].len_, ver))
+					return i;
+			}
+			return count;
+		}
 	};
 
 
@@ -91,6 +125,25 @@ namespace raft
 		virtual bool operator()(status_t status, version ver) = 0;
 	};
 
+	/**
+	 * read_index_callback is handle to node when read by read_index().
+	 * it's operator() function will be invoked when state machine is
+	 * up to date for the read,or node lost leadership.
+	 */
+	struct read_index_callback
+	{
+		virtual ~read_index_callback(){}
+		/**
+		 * \brief callback function.it is invoked by node's threads,
+		 * must not block.
+		 * \param status E_OK to read state machine now.E_NO_LEADER
+		 * if node lost leadership before read confirmed
+		 * \param index read index.entries up to it have been applied
+		 */
+		virtual void operator()(replicate_callback::status_t status,
+								log_index_t index) = 0;
+	};
+
 	struct load_snapshot_callback
 	{
 		virtual ~load_snapshot_callback() {}
@@ -142,16 +195,45 @@ namespace raft
 		~node();
 		/**
 		 * \brief to replicate data to cluster.when this node is leader.
-		 * if majorty of nodes recevie the data. replicate_callback will be
-		 * invoke. and user should apply data to state machine.
+		 * if majorty of nodes recevie the data. apply_callback apply it
+		 * to state machine,on leader as on followers,and then
+		 * replicate_callback will be invoked.
 		 * \param data the data to replicate to cluster
 		 * \param callback replicate result callback .when replicate done or 
 		 * something error happend.eg lost leadership
 		 * \return retrun false when this node is not leader or write log data 
 		 * error. therwise return true to user.
+		 * if data written but flushing log failed,node steps down,
+		 * callback is invoked with E_ERROR and return false.
 		 */
 		bool replicate(const std::string &data, replicate_callback *callback);
 
+		/**
+		 * \brief replicate a batch of data to cluster.entries are
+		 * written to log in one go,and peers are notified once.
+		 * \param data the data to replicate to cluster
+		 * \param callbacks one replicate_callback for each data.
+		 * \return retrun false when this node is not leader or write log data
+		 * error. therwise return true to user.
+		 * if data written but flushing log failed,node steps down,
+		 * callbacks are invoked with E_ERROR and return false.
+		 */
+		bool replicate_batch(const std::vector<std::string> &data,
+							 const std::vector<replicate_callback*> &callbacks);
+
+		/**
+		 * \brief linearizable read without writing log(ReadIndex).
+		 * node take committed index as read index,confirm it is still
+		 * leader by one round of requests to peers,and wait for entries
+		 * up to read index applied.then callback read state machine.
+		 * reads at the same time share one round.a new leader serve
+		 * reads after entries in its log when elected committed.
+		 * \param callback invoked when ready to read or lost leadership
+		 * \return return false when this node is not leader,and callback
+		 * will not be invoked.otherwise return true.
+		 */
+		bool read_index(read_index_callback *callback);
+
 		
 		/**
 		 * \brief read data from node's log.
@@ -311,6 +393,142 @@ namespace raft
 		void set_max_log_size(size_t size);
 
 
+		/**
+		 * \brief set durability of log entries.
+		 * with e_sync_entry or e_sync_group,replicate_callback
+		 * will be invoked after the entry flushed to disk.
+		 * \param mode log_manager::sync_mode_t
+		 * \param group_entries for e_sync_group,flush when so many
+		 * entries wait to flush
+		 * \param group_micros for e_sync_group,max microseconds an
+		 * entry wait to flush
+		 */
+		void set_log_sync_mode(log_manager::sync_mode_t mode,
+							   size_t group_entries = 0,
+							   unsigned int group_micros = 0);
+
+		/**
+		 * \brief set max bytes of the latest log entries keep in
+		 * memory.replicate requests for peers build from them.
+		 * memory is taken by each node,so size it by the groups
+		 * of the host for multi_raft
+		 * \param max_bytes 0 to disable the cache.default 0
+		 */
+		void set_log_cache_size(size_t max_bytes);
+
+		/**
+		 * \brief set format of log entries to write.
+		 * must be invoked before start().log files of all the
+		 * formats can be read.
+		 * \param format mmap_log::format_t.default e_format_protobuf
+		 */
+		void set_log_format(mmap_log::format_t format);
+
+		/**
+		 * \brief set when to verify crc32c of log entries.
+		 * must be invoked before start().
+		 * \param verify mmap_log::verify_t.default e_verify_reload
+		 * \param sample_rate for e_verify_sampled,verify one of
+		 * sample_rate reads
+		 */
+		void set_log_verify(mmap_log::verify_t verify,
+							unsigned int sample_rate = 0);
+
+		/**
+		 * \brief keep spare log files created in background,
+		 * so switching to next log file not block writing.
+		 * \param count count of spare log files.default 1
+		 * \param prefault touch all pages of spare log files
+		 */
+		void set_log_preallocate(size_t count, bool prefault = false);
+
+		/**
+		 * \brief gather replicate(...) calls from many threads,and
+		 * write them to log in batch by one log writer thread.
+		 * a log flusher thread flushes the written batches while
+		 * the next one is writing.must be invoked before start().
+		 * \param max_count max count of entries in one batch
+		 * \param max_bytes max bytes of entries in one batch
+		 * \param linger_micros max microseconds to wait for more
+		 * entries. 0 mean write what has gathered at once
+		 */
+		void set_replicate_coalescing(size_t max_count,
+									  size_t max_bytes,
+									  unsigned int linger_micros = 0);
+
+		/**
+		 * \brief let peers replicate log in pipeline.
+		 * must be invoked before start().works only on transports
+		 * of pipeline() true,such as tcp_transport.peers on other
+		 * ones stop-and-wait
+		 * \param max_inflight max count of AppendEntries requests
+		 * in flight for each peer.1 for stop-and-wait.
+		 */
+		void set_replicate_pipeline(size_t max_inflight);
+
+		/**
+		 * \brief set max count of replicate callbacks wait for their
+		 * entries applied.replicate(...) wait for free ones when so
+		 * many entries not applied.must be invoked before start().
+		 * \param count default 4096
+		 */
+		void set_max_pending_replicates(size_t count);
+
+		/**
+		 * \brief set scheduler to run peers and election timer of
+		 * this node.nodes in one process can share one scheduler.
+		 * must be invoked before start().
+		 * \param _scheduler default scheduler::get_instance()
+		 */
+		void set_scheduler(scheduler &_scheduler);
+
+		/**
+		 * \brief set scheduler to apply committed entries and
+		 * compact log of this node.apply callbacks and making
+		 * snapshot may take long,so they don't share workers with
+		 * peers and timers.nodes in one process share its workers,
+		 * threads not grow with the count of nodes.
+		 * must be invoked before start().
+		 * \param _scheduler default scheduler::get_background_instance()
+		 */
+		void set_background_scheduler(scheduler &_scheduler);
+
+		/**
+		 * \brief send heartbeats of peers by batcher.heartbeats to
+		 * the same host are sent in one request.
+		 * must be invoked before start().
+		 * \param batcher NULL to send heartbeat one by one.default NULL
+		 */
+		void set_heartbeat_batcher(heartbeat_batcher *batcher);
+
+		/**
+		 * \brief set transport to send requests to peers.
+		 * must be invoked before start().
+		 * \param _transport default http_rpc_transport::get_instance()
+		 */
+		void set_transport(transport &_transport);
+
+		/**
+		 * \brief set min milliseconds of election timeout.timeout is
+		 * random in [timeout, timeout * 2.5).leader send heartbeat
+		 * every timeout milliseconds.
+		 * must be invoked before start().
+		 * \param timeout milliseconds.default 3000
+		 */
+		void set_election_timeout(unsigned int timeout);
+
+		/**
+		 * \brief keep committed and applied index in memory,and write
+		 * them to metadata every interval milliseconds and when node
+		 * destroyed,instead of on each update.after restart they are
+		 * recovered from metadata,last snapshot and log.
+		 * current term and vote for are always written at once.
+		 * must be invoked before start().
+		 * \param interval milliseconds.0 write metadata on each
+		 * update.default 0
+		 */
+		void set_index_checkpoint(unsigned int interval);
+
 		/**
 		 * \brief set max count of log files, when
 		 * the count of log files  >= this count
@@ -325,6 +543,15 @@ namespace raft
          * @param id node id.unique in the cluster
          */
         void set_node_id(const std::string &id);
+
+        /**
+         * set raft group id of this node.it is sent with raft
+         * requests,so multi_raft route them to the group.
+         * @param id group id.empty for single group
+         */
+        void set_group_id(const std::string &id);
+
+        std::string group_id() const;
 		///raft rpc interface///
 	public:
 		/**
@@ -352,6 +579,17 @@ namespace raft
                 const replicate_log_entries_request &req,
 				replicate_log_entries_response &resp);
 
+		/**
+		 * \brief handle heartbeats batched by heartbeat_batcher of
+		 * leader.all of them are for this node.one response for
+		 * each heartbeat,in the same order
+		 * \param req heartbeats send from leader
+		 * \param resp responses send back to leader
+		 * \return return true
+		 */
+		bool handle_heartbeat_request(const heartbeat_request &req,
+									  heartbeat_response &resp);
+
 		/**
 		* \brief this interface should regist to server to process
 		 * install_snapshot_request
@@ -391,6 +629,16 @@ namespace raft
 
         term_t last_log_term()const;
 
+		scheduler &get_scheduler();
+
+		scheduler &get_background_scheduler();
+
+		heartbeat_batcher *get_heartbeat_batcher();
+
+		transport &get_transport();
+
+		unsigned int election_timeout();
+
 		log_index_t last_snapshot_index();
 
 		void set_last_snapshot_index(log_index_t index);
@@ -426,9 +674,64 @@ namespace raft
 			log_index_t index,
 			int entry_size = 0);
 
-		std::vector<log_index_t> get_peers_match_index();
+		/**
+		 * \brief same as above,but entries are appended to entries
+		 * encoded,and not set in request.request serialized and
+		 * appended to entries make the whole request,so entries in
+		 * log cache are sent without parsing and serializing them
+		 * \param count number of entries appended
+		 */
+		bool build_replicate_log_request(
+			replicate_log_entries_request &request,
+			std::string &entries,
+			log_index_t index,
+			int entry_size,
+			int &count);
+
+		/**
+		 * \brief set the fields of request but entries
+		 * \param count number of entries to send from index
+		 * \return return false if read log failed
+		 */
+		bool build_replicate_log_header(
+			replicate_log_entries_request &request,
+			log_index_t index,
+			int entry_size,
+			int &count);
+
+		/**
+		 * \brief find the first index of term.entry at index must
+		 * be of term.terms of entries never decrease,so it is
+		 * binary search
+		 * \param index index of entry of term
+		 * \param term term to find
+		 * \return return start_log_index() if the first one
+		 * has been compacted
+		 */
+		log_index_t first_index_of_term(log_index_t index, term_t term);
+
+		/**
+		 * \brief find the last index of term.binary search
+		 * \param term term to find
+		 * \return return 0 if no entry of term in log
+		 */
+		log_index_t last_index_of_term(term_t term);
 
-		void replicate_log_callback();
+		/**
+		 * \brief reject replicate request for entry at
+		 * req.prev_log_index() is of term
+		 */
+		void set_conflict_term(const replicate_log_entries_request &req,
+							   term_t term,
+							   replicate_log_entries_response &resp);
+
+		/**
+		 * \brief match index of member in quorum_ move forward.
+		 * update committed index
+		 * \param slot slot of member in quorum_
+		 * \param match_index match index of member
+		 */
+		void replicate_log_callback(int slot, log_index_t match_index);
 
 		void build_vote_request(vote_request &req);
 
@@ -491,62 +794,213 @@ namespace raft
 
 		void close_snapshot();
 
-		void invoke_apply_callbacks();
+		/**
+		 * \brief apply committed entries.
+		 * \return return false if read log or apply_batch failed
+		 */
+		bool invoke_apply_callbacks();
+
+		/**
+		 * \brief write committed and applied index to metadata
+		 * and flush it to disk
+		 */
+		void checkpoint_indexes();
+
+		/**
+		 * \brief entries (index - count, index] applied
+		 */
+		void set_applied_index(log_index_t index, size_t count);
 
-		void invoke_replicate_callback(replicate_callback::status_t status);
+		/**
+		 * \brief invoke callback of entry applied and free its slot
+		 * \return return false if no callback for the entry
+		 */
+		bool invoke_replicate_callback(log_index_t index,
+									   term_t term,
+									   replicate_callback::status_t status);
 
         void notify_replicate_failed();
 
-		void make_log_entry(const std::string &data, log_entry &entry);
+		/**
+		 * \brief round of requests to peers for read_index().
+		 * peer take it before send request
+		 */
+		unsigned long long read_round();
+
+		/**
+		 * \brief peer in slot response request of round
+		 * in current term
+		 */
+		void read_round_acked(int slot, unsigned long long round);
+
+		/**
+		 * \brief invoke callbacks of reads confirmed and applied
+		 */
+		void serve_read_index();
+
+		void notify_read_index_failed();
+
+		bool write_logs(std::vector<log_entry> &entries,
+						log_index_t &index,
+						term_t &term);
+
+		/**
+		 * \brief keep callbacks and write entries.callbacks are kept
+		 * before entries written,so they are found when entries
+		 * committed.
+		 */
+		bool write_entries(std::vector<log_entry> &entries,
+						   const std::vector<replicate_callback*> &callbacks,
+						   log_index_t &index);
+
+		/**
+		 * \brief write entries and notify peers.
+		 * \param kept set true if node kept callbacks.they are
+		 * invoked by node even if return false
+		 * \param written if not NULL,set to the last index written
+		 * and leave flush to the caller
+		 */
+		bool replicate_entries(std::vector<log_entry> &entries,
+							   const std::vector<replicate_callback*> &callbacks,
+							   bool &kept,
+							   log_index_t *written = NULL);
+
+		/**
+		 * \brief flush log up to index.
+		 * \param group wait for other callers to flush together
+		 * \return return false if flush failed
+		 */
+		bool sync_log(log_index_t index, bool group = true);
+
+		/**
+		 * \brief entries [first, last] written but not flushed.
+		 * fail their callbacks and step down
+		 */
+		void sync_log_failed(log_index_t first, log_index_t last);
+
+		/**
+		 * \brief keep callbacks of entries [index, index + size)
+		 * in pending_callbacks_.wait for free slots.
+		 * \return return false if not leader any more
+		 */
+		bool add_replicate_callbacks(
+			log_index_t index,
+			term_t term,
+			const std::vector<replicate_callback*> &callbacks);
 
-		bool write_log(const std::string &data,
-                       log_index_t &index,
-                       term_t &term);
+		/**
+		 * \brief free slots of entries not written
+		 */
+		void remove_replicate_callbacks(log_index_t index, size_t count);
 
-		void add_replicate_callback(const version& version, 
-									replicate_callback* callback);
+		/**
+		 * \brief wake up replicate(...) callers wait for free slots
+		 */
+		void notify_pending_freed();
 
 		void update_peers_match_index(log_index_t index);
 
         void init_peers();
 	private:
 		/**
-		 * \brief apply log thread
+		 * \brief apply committed entries.task of background
+		 * scheduler,so entries of one node are applied in order
 		 */
-		class apply_log : public acl::thread
+		class apply_log : scheduler::task
 		{
 		public:
 			explicit apply_log(node &);
 			~apply_log();
 			void to_apply ();
-			virtual void *run();
+			void stop();
 		private:
-			bool wait_to_apply();
+			virtual void run();
 			node &node_;
-			bool to_stop_;
-			acl_pthread_mutex_t mutex_;
-			acl_pthread_cond_t cond_;
+			//milliseconds.doubled on each failed run
+			unsigned int retry_delay_;
 		};
 
 		/**
-		 * \brief do log compaction work thread
+		 * \brief do log compaction.task of background scheduler
 		 */
-		class log_compaction : public acl::thread
+		class log_compaction : scheduler::task
 		{
 		public:
 			explicit log_compaction(node &_node);
 			~log_compaction();
 			void do_compact_log();
+			void stop();
+		private:
+			virtual void run();
+			node &node_;
+		};
+
+		/**
+		 * \brief replicate request wait in log_writer queue
+		 */
+		struct replicate_req
+		{
+			std::string data_;
+			replicate_callback *callback_;
+			replicate_req *next_;
+		};
+
+		/**
+		 * \brief log writer thread.replicate(...) callers push
+		 * requests to a lock-free queue,and log writer write them
+		 * to log in batch and notify peers once.
+		 */
+		class log_writer : public acl::thread
+		{
+		public:
+			explicit log_writer(node &_node);
+			~log_writer();
+			void set_limits(size_t max_count,
+							size_t max_bytes,
+							unsigned int linger_micros);
+			bool enabled() const;
+			void push(replicate_req *req);
+			void stop();
 		private:
-			virtual void* run();
+			virtual void *run();
+			bool wait_for_reqs(const timespec *timeout);
+			size_t take_reqs(std::vector<replicate_req*> &reqs);
+			void write_reqs(std::vector<replicate_req*> &reqs);
+			node &node_;
+			bool enabled_;
+			bool to_stop_;
+			size_t max_count_;
+			size_t max_bytes_;
+			unsigned int linger_micros_;
+			std::atomic<replicate_req*> head_;
+			std::atomic<bool> waiting_;
 			acl_pthread_mutex_t mutex_;
 			acl_pthread_cond_t cond_;
+		};
+
+		/**
+		 * \brief log flusher thread.flush entries written by
+		 * log writer,so log writer writes the next batch while
+		 * the last one is flushing.
+		 */
+		class log_flusher : public acl::thread
+		{
+		public:
+			explicit log_flusher(node &_node);
+			~log_flusher();
+			void flush(log_index_t first, log_index_t last);
+			void stop();
+		private:
+			virtual void *run();
 			node &node_;
-			bool do_compact_log_;
-            bool stop_;
+			bool to_stop_;
+			log_index_t first_index_;
+			log_index_t last_index_;
+			acl_pthread_mutex_t mutex_;
+			acl_pthread_cond_t cond_;
 		};
 
-		class election_timer : acl::thread
+		class election_timer : scheduler::task
 		{
 		public:
 			election_timer(node &_node);
@@ -555,17 +1009,66 @@ namespace raft
 
 			void set_timer(unsigned int delays_mills);
 			void cancel_timer();
+			void stop();
 		private:
-			virtual void* run();
+			virtual void run();
 			node &node_;
 			bool cancel_;
-			bool stop_;
 			unsigned int delay_;
+			//timer set before fire later than it.ignore them
+			timeval deadline_;
 			acl_pthread_mutex_t mutex_;
-			acl_pthread_cond_t cond_;
+		};
+
+		/**
+		 * \brief checkpoint committed and applied index
+		 * every checkpoint_interval_ milliseconds.task of
+		 * background scheduler
+		 */
+		class checkpoint_timer : scheduler::task
+		{
+		public:
+			checkpoint_timer(node &_node);
+
+			~checkpoint_timer();
+
+			void start();
+			void stop();
+		private:
+			virtual void run();
+			node &node_;
 		};
 	private:
-		typedef std::map<version, replicate_callback*> replicate_callbacks_t;
+		/**
+		 * \brief replicate callback wait for its entry applied.
+		 * slot is free when callback_ is NULL
+		 */
+		struct pending_callback
+		{
+			pending_callback()
+				:index_(0),
+				 term_(0),
+				 callback_(NULL)
+			{
+			}
+			std::atomic<log_index_t> index_;
+			std::atomic<term_t> term_;
+			std::atomic<replicate_callback*> callback_;
+		};
+
+		/**
+		 * \brief read wait for round confirmed and read index applied.
+		 * index_ is taken after leader commit entries of its log
+		 * when elected
+		 */
+		struct read_request
+		{
+			read_index_callback *callback_;
+			bool indexed_;
+			log_index_t index_;
+			unsigned long long round_;
+		};
+
 		typedef std::map<std::string, vote_response>   vote_responses_t;
 
 		log_manager *log_manager_;
@@ -576,20 +1079,47 @@ namespace raft
 
         bool        start_;
 		std::string node_id_;
+		std::string group_id_;
 		std::string leader_id_;
 		std::string vote_for_;
         bool        log_ok_;
         std::vector<peer_info> peer_infos_;
 		acl::locker	metadata_locker_;
 
+		//metadata has them at last checkpoint
+		std::atomic<log_index_t> committed_index_;
+		std::atomic<log_index_t> applied_index_;
+		unsigned int checkpoint_interval_;
 
-		replicate_callbacks_t replicate_callbacks_;
-		acl::locker replicate_callbacks_locker_;
+
+		//callback of entry index is pending_callbacks_[index % size]
+		std::vector<pending_callback> pending_callbacks_;
+		acl_pthread_mutex_t pending_mutex_;
+		acl_pthread_cond_t pending_cond_;
+		//predict index of entries to write
+		acl::locker write_locker_;
 
 
 		std::map<std::string, peer*> peers_;
+		scheduler *scheduler_;
+		scheduler *background_scheduler_;
+		heartbeat_batcher *heartbeat_batcher_;
+		transport *transport_;
+		//match index of peers and myself
+		quorum quorum_;
+		int quorum_slot_;
 		acl::locker peers_locker_;
 
+		//read_index()
+		std::list<read_request> read_requests_;
+		std::atomic<unsigned long long> read_round_;
+		//round acked by peers and myself.slots same to quorum_
+		quorum read_quorum_;
+		//last log index when elected.it has all entries
+		//committed by leaders before
+		log_index_t elected_index_;
+		acl::locker read_locker_;
+
 
 		load_snapshot_callback	*load_snapshot_callback_;
 		make_snapshot_callback  *make_snapshot_callback_;
@@ -608,6 +1138,18 @@ namespace raft
         size_t mini_log_count_;
         size_t max_snapshot_size_;
 
+		log_manager::sync_mode_t sync_mode_;
+		size_t sync_entries_;
+		unsigned int sync_micros_;
+		size_t log_cache_size_;
+		mmap_log::format_t log_format_;
+		mmap_log::verify_t log_verify_;
+		unsigned int log_verify_sample_rate_;
+		size_t log_preallocate_;
+		bool log_prefault_;
+		size_t max_inflight_;
+		acl::locker replicate_locker_;
+
 
 		vote_responses_t vote_responses_;
 		acl::locker		 vote_responses_locker_;
@@ -617,5 +1159,8 @@ namespace raft
 		apply_callback     *apply_callback_;
 		apply_log          apply_log_;
         metadata           *metadata_;
+		log_writer         log_writer_;
+		log_flusher        log_flusher_;
+		checkpoint_timer   checkpoint_timer_;
 	};
 }
@@ -5,15 +5,17 @@ namespace raft
 
 	/**
 	 * \brief peer mean other node in the cluster
-	 * one peer connect to one node, and it has one thread
-	 * to do replicate data,election,install snapshot request
+	 * one peer connect to one node, and it is a task run by
+	 * node's scheduler to do replicate data,election,install
+	 * snapshot request.requests are sent by async calls of
+	 * transport,so a run of peer never wait for responses
 	 * node control peer to talk to other node
 	 * match_index of the peer mean that the node has recevie
 	 * the index of log entry. 
 	 * next_index mean next index to replicate to the node
 	 * normal next_index = match_index + 1
 	 */
-	class peer :private acl::thread
+	class peer :private scheduler::task
 	{
 	public:
         /**
@@ -60,25 +62,197 @@ namespace raft
 		void set_match_index(log_index_t index);
 
         void start();
+
+		/**
+		 * \brief set max count of replicate requests in flight.
+		 * if count > 1,peer send next replicate request before
+		 * the response of prev one come back.must be invoked
+		 * before start().1 if transport not pipeline()
+		 * \param count max count of in flight requests.default 1
+		 */
+		void set_max_inflight(size_t count);
+
+		/**
+		 * \brief set slot of this peer in node's quorum.
+		 * match index reported to node with it
+		 * \param slot slot return by quorum::add_member()
+		 */
+		void set_quorum_slot(int slot);
+
+		/**
+		 * \brief heartbeat_batcher send back the response of
+		 * heartbeat.
+		 * \param ok false if rpc failed
+		 * \param resp response of heartbeat
+		 */
+		void heartbeat_done(bool ok,
+							const replicate_log_entries_response &resp);
 	private:
-		void notify_stop();
+		/**
+		 * \brief replicate request in flight.requests are sent in
+		 * order by transport::async_replicate(),so peer receive
+		 * them in the order of req_id
+		 */
+		struct replicate_call : public transport::callback
+		{
+			explicit replicate_call(peer &_peer);
+
+			/**
+			 * \brief response come back.queue it to done_
+			 */
+			virtual void rpc_done(bool ok);
+
+			peer &peer_;
+			//fields of request but entries
+			replicate_log_entries_request req_;
+			//serialized request sent.entries and req_
+			std::string body_;
+			replicate_log_entries_response resp_;
+			//false if rpc error
+			bool ok_;
+			//index of the last entry in req_
+			log_index_t last_index_;
+			//node's read round when req_ sent
+			unsigned long long read_round_;
+		};
+
+		/**
+		 * \brief vote request in flight
+		 */
+		struct vote_call : public transport::callback
+		{
+			explicit vote_call(peer &_peer);
+
+			virtual void rpc_done(bool ok);
+
+			peer &peer_;
+			vote_request req_;
+			vote_response resp_;
+			bool ok_;
+			bool inflight_;
+		};
+
+		/**
+		 * \brief snapshot sending to peer.one chunk in flight
+		 */
+		struct snapshot_call : public transport::callback
+		{
+			explicit snapshot_call(peer &_peer);
+
+			virtual void rpc_done(bool ok);
+
+			peer &peer_;
+			install_snapshot_request req_;
+			install_snapshot_response resp_;
+			bool ok_;
+			bool inflight_;
+			//snapshot is sending
+			bool active_;
+			acl::ifstream file_;
+			long long file_size_;
+			//version of snapshot
+			term_t last_term_;
+			log_index_t last_index_;
+		};
+
+		/**
+		 * \brief send replicate requests until max_inflight_ ones
+		 * in flight.not wait for responses
+		 * \param heartbeat send one request at least
+		 */
+		void do_replicate(bool heartbeat);
+
+		/**
+		 * \brief handle responses of replicate requests
+		 * \param event TO_REPLICATE set if more to send
+		 * \param heartbeat set if peer must be probed again
+		 */
+		void do_replicate_done(int &event, bool &heartbeat);
+
+		void push_replicate_done(replicate_call *call);
+
+		/**
+		 * \brief get a replicate call from free_calls_,or new one
+		 */
+		replicate_call *new_replicate_call();
+
+		/**
+		 * \brief clear call and keep it in free_calls_ to reuse.
+		 * messages cleared keep their memory
+		 */
+		void free_replicate_call(replicate_call *call);
 
-		void do_replicate();
+		/**
+		 * \brief open the last snapshot and send the first chunk
+		 */
+		void do_install_snapshot();
 
-		bool do_install_snapshot();
+		/**
+		 * \brief send the chunk of snapshot at offset
+		 */
+		void send_snapshot_chunk(long long offset);
+
+		void do_snapshot_done(int &event);
+
+		void stop_install_snapshot();
 
 		void do_election();
 
-		bool wait_event(int &event);
+		void do_vote_done(int &event);
+
+		/**
+		 * \brief an async call sent.peer not destroyed until it done
+		 */
+		void begin_call();
+
+		/**
+		 * \brief an async call done.set event and schedule peer
+		 */
+		void call_done(int event);
+
+		int take_event();
+
+		/**
+		 * \brief send heartbeat by heartbeat_batcher
+		 * \return false if heartbeat can't build
+		 */
+		bool send_heartbeat();
+
+		void do_heartbeat_done(int &event);
+
+		/**
+		 * \brief next index after replicate request rejected for
+		 * log not match.skip the whole conflict term
+		 * \param resp response of rejected request
+		 */
+		log_index_t backtrack_next_index(
+			const replicate_log_entries_response &resp);
 
 		/**
-		 * \brief thread routine
-		 * \return 
+		 * \brief response in the term of request confirm node is
+		 * leader for reads of round.report to node
+		 * \param round node's read round when req sent
 		 */
-		virtual void* run();
+		void ack_read_round(const replicate_log_entries_request &req,
+							const replicate_log_entries_response &resp,
+							unsigned long long round);
+
+		/**
+		 * \brief milliseconds before next heartbeat.0 if it is
+		 * time to send heartbeat
+		 */
+		long long heartbeat_delay();
+
+		/**
+		 * \brief task routine.run by worker of scheduler.
+		 * handle responses come back and send requests,never
+		 * wait for responses
+		 */
+		virtual void run();
 
 	private:
 		node		&node_;
+		scheduler	&scheduler_;
 		std::string peer_id_;
 		acl::locker locker_;
 
@@ -87,19 +261,48 @@ namespace raft
 
 		int event_;
 
-		acl_pthread_cond_t cond_;
 		acl_pthread_mutex_t mutex_;
 		
 		timeval last_heartbeat_time_;
 		long long heart_inter_;
 		
-		acl::string replicate_service_path_;
-		acl::string election_service_path_;
-		acl::string install_snapshot_service_path_;
-
-		acl::http_rpc_client &rpc_client_;
+		transport &transport_;
 		size_t rpc_fails_;
 		size_t req_id_;
-		
+		int quorum_slot_;
+		//max read round reported to node
+		unsigned long long read_round_;
+
+		//coalesced heartbeat
+		heartbeat_batcher *heartbeat_batcher_;
+		replicate_log_entries_request heartbeat_req_;
+		replicate_log_entries_response heartbeat_resp_;
+		bool heartbeat_inflight_;
+		bool heartbeat_ok_;
+		//index of the last entry in heartbeat_req_
+		log_index_t heartbeat_index_;
+		unsigned long long heartbeat_read_round_;
+
+		//replicate requests
+		size_t max_inflight_;
+		size_t stale_req_id_;
+		//term requests in flight sent in
+		term_t replicate_term_;
+		//1 when finding match index of peer
+		int entry_size_;
+		//requests in flight by req_id
+		std::map<size_t, replicate_call*> inflight_;
+		//guarded by mutex_
+		std::list<replicate_call*> done_;
+		std::vector<replicate_call*> free_calls_;
+
+		vote_call vote_call_;
+		//election started when vote in flight
+		bool vote_again_;
+		snapshot_call snapshot_call_;
+
+		//async calls not done.guarded by mutex_
+		int calls_;
+		acl_pthread_cond_t calls_cond_;
 	};
 }
\ No newline at end of file
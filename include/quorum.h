@@ -0,0 +1,67 @@
+#pragma once
+namespace raft
+{
+	/**
+	 * \brief track match index of members,and the index that
+	 * a quorum of members reach.members kept sorted by match
+	 * index,so one member move forward just move it in the
+	 * order,without sort all of them again.
+	 * for joint consensus,track each configuration with one
+	 * quorum,and take the min of their quorum_index()
+	 */
+	class quorum
+	{
+	public:
+		quorum();
+
+		/**
+		 * \brief add a member.
+		 * \param weight weight of member vote.default 1
+		 * \return slot of the member,for update()
+		 */
+		int add_member(unsigned int weight = 1);
+
+		/**
+		 * \brief remove all members
+		 */
+		void clear();
+
+		/**
+		 * \brief set match index of all the members
+		 * \param index match index
+		 */
+		void reset(log_index_t index);
+
+		/**
+		 * \brief update match index of member
+		 * \param slot slot return by add_member()
+		 * \param index match index of member
+		 * \return return quorum index after update
+		 */
+		log_index_t update(int slot, log_index_t index);
+
+		/**
+		 * \brief get the max index that match index of members
+		 * with more than half of total weight reach
+		 * \return return quorum index.0 if no member
+		 */
+		log_index_t quorum_index();
+
+		size_t size();
+	private:
+		void swap(size_t i, size_t j);
+
+		log_index_t get_quorum_index();
+
+		//match index and weight of each slot
+		std::vector<log_index_t> indexes_;
+		std::vector<unsigned int> weights_;
+		//slots sorted by match index desc
+		std::vector<int> order_;
+		//position of slot in order_
+		std::vector<size_t> ranks_;
+		unsigned int total_weight_;
+		bool same_weight_;
+		acl::locker locker_;
+	};
+}
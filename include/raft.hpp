@@ -1,16 +1,28 @@
 #pragma once
 #include <string>
+#include <atomic>
+#include <list>
+#include <map>
+#include <deque>
 #ifndef _WIN32
 #include<sys/mman.h> //mmap
 #endif
 #include "proto_gen/raft.pb.h"
 #include "http_rpc.h"
 #include "common.hpp"
+#include "crc32c.h"
 #include "log.hpp"
 #include "log_manager.h"
 #include "mmap_log.hpp"
+#include "quorum.h"
+#include "scheduler.h"
+#include "transport.h"
+#include "heartbeat_batcher.h"
 #include "peer.h"
 #include "node.h"
+#include "multi_raft.h"
+#include "loopback_transport.h"
+#include "tcp_transport.h"
 #include "metadata.h"
 
 /*  raft paper https://raft.github.io/raft.pdf
@@ -0,0 +1,125 @@
+#pragma once
+namespace raft
+{
+	/**
+	 * \brief run tasks of peers and nodes with a fixed count of
+	 * worker threads and one timer thread.thread count not grow
+	 * with the count of peers or nodes in the process.
+	 */
+	class scheduler
+	{
+	public:
+		/**
+		 * \brief task run by scheduler.one task never runs in two
+		 * workers at the same time.schedule a running task make it
+		 * run again after this run return.
+		 */
+		class task
+		{
+		public:
+			task();
+
+			virtual ~task();
+
+			/**
+			 * \brief invoked by worker thread.
+			 * must not block for long,other tasks wait for workers
+			 */
+			virtual void run() = 0;
+		private:
+			friend class scheduler;
+
+			typedef std::multimap<long long, task*>::iterator timer_t;
+
+			int state_;
+			bool removed_;
+			bool has_timer_;
+			timer_t timer_;
+		};
+
+		/**
+		 * \param workers count of worker threads
+		 */
+		explicit scheduler(size_t workers = 4);
+
+		~scheduler();
+
+		/**
+		 * \brief run task as soon as possible
+		 * \param _task task to run
+		 */
+		void schedule(task *_task);
+
+		/**
+		 * \brief run task after delay.it replace the timer set before
+		 * \param _task task to run
+		 * \param delay milliseconds to delay
+		 */
+		void set_timer(task *_task, unsigned int delay);
+
+		/**
+		 * \brief cancel the timer of task
+		 * \param _task task of timer
+		 */
+		void cancel_timer(task *_task);
+
+		/**
+		 * \brief remove task from scheduler.and wait it done if it
+		 * is running.task can be deleted after it. must not be
+		 * invoked in run() of the task
+		 * \param _task task to remove
+		 */
+		void remove(task *_task);
+
+		/**
+		 * \brief scheduler shared by nodes in the process
+		 * \return scheduler
+		 */
+		static scheduler &get_instance();
+
+		/**
+		 * \brief scheduler shared by nodes in the process to run
+		 * tasks that may block long,like applying log entries and
+		 * making snapshot
+		 * \return scheduler
+		 */
+		static scheduler &get_background_instance();
+
+	private:
+		class worker : public acl::thread
+		{
+		public:
+			explicit worker(scheduler &_scheduler);
+		private:
+			virtual void *run();
+			scheduler &scheduler_;
+		};
+
+		class timer : public acl::thread
+		{
+		public:
+			explicit timer(scheduler &_scheduler);
+		private:
+			virtual void *run();
+			scheduler &scheduler_;
+		};
+
+		void push_task(task *_task);
+
+		task *pop_task();
+
+		void task_done(task *_task);
+
+		void run_timers();
+
+		bool stop_;
+		std::list<task*> tasks_;
+		std::multimap<long long, task*> timers_;
+		std::vector<worker*> workers_;
+		timer *timer_;
+		acl_pthread_mutex_t mutex_;
+		acl_pthread_cond_t task_cond_;
+		acl_pthread_cond_t timer_cond_;
+		acl_pthread_cond_t done_cond_;
+	};
+}
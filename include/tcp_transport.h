@@ -0,0 +1,343 @@
+#pragma once
+namespace raft
+{
+	/**
+	 * \brief binary transport on persistent tcp connections.
+	 * one connection for each peer.a frame is 16 bytes header
+	 * [body length, type, frame id] and protobuf body.requests
+	 * of many threads to the same peer share the connection,
+	 * and responses are matched to them by frame id.
+	 * async calls return after request queued,and the io thread
+	 * of connection connect,write and read sockets non-blocking,
+	 * and invoke callbacks,so callers never wait for a slow or
+	 * dead peer.calls fail at once while reconnect backoff.
+	 * peers must serve by tcp_transport_server.
+	 */
+	class tcp_transport : public transport
+	{
+	public:
+		/**
+		 * \param timeout milliseconds to wait for response
+		 */
+		explicit tcp_transport(unsigned int timeout = 3000);
+
+		~tcp_transport();
+
+		/**
+		 * \param addr ip:port of tcp_transport_server of peer
+		 */
+		virtual void add_peer(const std::string &peer_id,
+							  const std::string &addr);
+
+		virtual bool vote(const std::string &peer_id,
+						  const vote_request &req,
+						  vote_response &resp);
+
+		virtual bool replicate(const std::string &peer_id,
+							   const replicate_log_entries_request &req,
+							   replicate_log_entries_response &resp);
+
+		virtual bool install_snapshot(const std::string &peer_id,
+									  const install_snapshot_request &req,
+									  install_snapshot_response &resp);
+
+		virtual bool heartbeat(const std::string &peer_id,
+							   const heartbeat_request &req,
+							   heartbeat_response &resp);
+
+		virtual void async_vote(const std::string &peer_id,
+								const vote_request &req,
+								vote_response &resp,
+								callback *_callback);
+
+		virtual void async_replicate(const std::string &peer_id,
+									 const replicate_log_entries_request &req,
+									 replicate_log_entries_response &resp,
+									 callback *_callback);
+
+		virtual void async_replicate(const std::string &peer_id,
+									 const std::string &req,
+									 replicate_log_entries_response &resp,
+									 callback *_callback);
+
+		virtual void async_install_snapshot(
+				const std::string &peer_id,
+				const install_snapshot_request &req,
+				install_snapshot_response &resp,
+				callback *_callback);
+
+		virtual void async_heartbeat(const std::string &peer_id,
+									 const heartbeat_request &req,
+									 heartbeat_response &resp,
+									 callback *_callback);
+
+		/**
+		 * \return return true.frames are written one after
+		 * another without waiting for responses
+		 */
+		virtual bool pipeline();
+	private:
+		class connection;
+
+		/**
+		 * \brief all the io of connection.connect,write frames
+		 * queued,read responses,and fail the calls wait for
+		 * response too long.callers never block on socket
+		 */
+		class io_thread : public acl::thread
+		{
+		public:
+			explicit io_thread(connection &conn);
+		private:
+			virtual void *run();
+
+			connection &conn_;
+		};
+
+		class connection
+		{
+		public:
+			/**
+			 * \param timeout milliseconds to wait for connect
+			 */
+			connection(const std::string &addr, unsigned int timeout);
+
+			~connection();
+
+			bool call(unsigned int type,
+					  const google::protobuf::Message &req,
+					  google::protobuf::Message &resp,
+					  unsigned int timeout);
+
+			/**
+			 * \brief queue request and return.callback invoked
+			 * when response come back,timeout or connection broken.
+			 * fail at once while reconnect backoff
+			 */
+			void async_call(unsigned int type,
+							const google::protobuf::Message &req,
+							google::protobuf::Message &resp,
+							callback *_callback,
+							unsigned int timeout);
+
+			/**
+			 * \brief same as above.body is serialized request
+			 */
+			void async_call(unsigned int type,
+							const std::string &body,
+							google::protobuf::Message &resp,
+							callback *_callback,
+							unsigned int timeout);
+		private:
+			friend class io_thread;
+
+			//response wait for
+			struct pending
+			{
+				google::protobuf::Message *resp_;
+				callback *callback_;
+				//microseconds
+				long long deadline_;
+			};
+
+			/**
+			 * \brief one round of io_thread.
+			 * \return return false if stopped
+			 */
+			bool run_once();
+
+			/**
+			 * \brief start non-blocking connect.must hold mutex_
+			 * \return return false if connect failed at once
+			 */
+			bool open();
+
+			/**
+			 * \brief fd writable after open().check the result
+			 * and write the requests queued
+			 * \return return false if connect failed
+			 */
+			bool connected();
+
+			/**
+			 * \brief write bytes queued as many as socket take.
+			 * must hold mutex_
+			 * \return return false if socket error
+			 */
+			bool flush();
+
+			/**
+			 * \brief read bytes ready and handle the frames in them
+			 * \return return false if socket error or closed
+			 */
+			bool read_frames();
+
+			/**
+			 * \brief response of frame come back
+			 */
+			void done(unsigned long long frame_id,
+					  unsigned int type,
+					  const char *body,
+					  size_t len);
+
+			/**
+			 * \brief fail the calls timeout
+			 */
+			void sweep();
+
+			/**
+			 * \brief connection broken or connect failed.close it,
+			 * fail all the pending calls,and backoff reconnect.
+			 */
+			void broken();
+
+			/**
+			 * \brief wake io_thread up from poll
+			 */
+			void wakeup();
+
+			std::string addr_;
+			unsigned int timeout_;
+			int fd_;
+			//non-blocking connect in progress
+			bool connecting_;
+			long long connect_deadline_;
+			//no call until then after connect failed or broken
+			long long retry_time_;
+			//milliseconds.doubled on each failure
+			unsigned int backoff_;
+			//frames not written yet from out_pos_
+			std::string out_;
+			size_t out_pos_;
+			//bytes read not make a frame yet.io_thread only
+			std::string in_;
+			unsigned long long frame_id_;
+			bool stop_;
+			int wakeup_fds_[2];
+			io_thread *io_thread_;
+			std::map<unsigned long long, pending*> pendings_;
+			acl_pthread_mutex_t mutex_;
+		};
+
+		connection *get_connection(const std::string &peer_id);
+
+		bool call(const std::string &peer_id,
+				  unsigned int type,
+				  const google::protobuf::Message &req,
+				  google::protobuf::Message &resp);
+
+		void async_call(const std::string &peer_id,
+						unsigned int type,
+						const google::protobuf::Message &req,
+						google::protobuf::Message &resp,
+						callback *_callback);
+
+		void async_call(const std::string &peer_id,
+						unsigned int type,
+						const std::string &body,
+						google::protobuf::Message &resp,
+						callback *_callback);
+
+		unsigned int timeout_;
+		std::map<std::string, connection*> connections_;
+		acl::locker locker_;
+	};
+
+	/**
+	 * \brief serve requests of tcp_transport.requests of one
+	 * connection are handled in order by the thread of connection.
+	 */
+	class tcp_transport_server
+	{
+	public:
+		tcp_transport_server();
+
+		~tcp_transport_server();
+
+		/**
+		 * \brief requests are handled by _node.
+		 * must be invoked before open()
+		 */
+		void bind(node *_node);
+
+		/**
+		 * \brief requests are handled by host.multi_raft route
+		 * them to its groups.must be invoked before open()
+		 */
+		void bind(multi_raft *host);
+
+		/**
+		 * \brief listen and serve
+		 * \param addr ip:port to listen.port 0 to pick one
+		 * \return return false if listen error
+		 */
+		bool open(const std::string &addr);
+
+		/**
+		 * \brief address listened.ip:port
+		 */
+		std::string addr() const;
+
+		/**
+		 * \brief close listener and all the connections.wait for
+		 * requests in process done
+		 */
+		void stop();
+	private:
+		class session : public acl::thread
+		{
+		public:
+			session(tcp_transport_server &server, int fd);
+
+			~session();
+
+			void shutdown();
+
+			bool done();
+		private:
+			virtual void *run();
+
+			bool handle(unsigned int type, const std::string &body);
+
+			tcp_transport_server &server_;
+			int fd_;
+			std::atomic<bool> done_;
+
+			//reused for requests of the connection
+			std::string buffer_;
+			vote_request vote_req_;
+			vote_response vote_resp_;
+			replicate_log_entries_request replicate_req_;
+			replicate_log_entries_response replicate_resp_;
+			install_snapshot_request install_snapshot_req_;
+			install_snapshot_response install_snapshot_resp_;
+			heartbeat_request heartbeat_req_;
+			heartbeat_response heartbeat_resp_;
+		};
+
+		class acceptor : public acl::thread
+		{
+		public:
+			explicit acceptor(tcp_transport_server &server);
+		private:
+			virtual void *run();
+
+			tcp_transport_server &server_;
+		};
+
+		/**
+		 * \brief wait for sessions done and delete them.
+		 * \param all shutdown all the sessions and wait
+		 */
+		void reap_sessions(bool all);
+
+		node *node_;
+		multi_raft *host_;
+		int listen_fd_;
+		std::string addr_;
+		bool stop_;
+		acceptor acceptor_;
+		std::list<session*> sessions_;
+		acl::locker sessions_locker_;
+	};
+}
@@ -0,0 +1,235 @@
+#pragma once
+namespace raft
+{
+	/**
+	 * \brief send raft requests to other nodes.peer and
+	 * heartbeat_batcher talk to other nodes through it only,so
+	 * raft can run on top of any rpc framework.
+	 * calls block until response come back or error happend.
+	 * async calls return at once and invoke callback with the
+	 * response later.peers use async calls,so workers of scheduler
+	 * don't wait for peers.one transport must support calls from
+	 * many threads at the same time.
+	 */
+	class transport
+	{
+	public:
+		/**
+		 * \brief completion of async call
+		 */
+		class callback
+		{
+		public:
+			virtual ~callback(){}
+
+			/**
+			 * \brief invoked once when response come back or rpc
+			 * error.it may be invoked before the async call return,
+			 * or by threads of transport.it must not block.
+			 * \param ok false if rpc error.resp is undefined then
+			 */
+			virtual void rpc_done(bool ok) = 0;
+		};
+
+		transport();
+
+		virtual ~transport();
+
+		/**
+		 * \brief tell transport the address of peer.invoked when
+		 * peer created,before any request sent to it
+		 * \param peer_id node id of peer
+		 * \param addr address of peer
+		 */
+		virtual void add_peer(const std::string &peer_id,
+							  const std::string &addr) = 0;
+
+		/**
+		 * \return return false if rpc error.resp is undefined then
+		 */
+		virtual bool vote(const std::string &peer_id,
+						  const vote_request &req,
+						  vote_response &resp) = 0;
+
+		virtual bool replicate(const std::string &peer_id,
+							   const replicate_log_entries_request &req,
+							   replicate_log_entries_response &resp) = 0;
+
+		/**
+		 * \brief blocking call of async_replicate with request
+		 * serialized.default one parse it and make the call above.
+		 * transports able to send bytes override it
+		 * \param req serialized replicate_log_entries_request
+		 */
+		virtual bool replicate(const std::string &peer_id,
+							   const std::string &req,
+							   replicate_log_entries_response &resp);
+
+		virtual bool install_snapshot(const std::string &peer_id,
+									  const install_snapshot_request &req,
+									  install_snapshot_response &resp) = 0;
+
+		virtual bool heartbeat(const std::string &peer_id,
+							   const heartbeat_request &req,
+							   heartbeat_response &resp) = 0;
+
+		/**
+		 * \brief async calls.req and resp must keep valid until
+		 * _callback invoked.requests to the same peer are sent in
+		 * the order of calls.
+		 * default ones queue the blocking calls to a thread for each
+		 * peer,which make them in order,so the caller never wait for
+		 * the response.transports able to wait for many responses at
+		 * the same time override them.
+		 */
+		virtual void async_vote(const std::string &peer_id,
+								const vote_request &req,
+								vote_response &resp,
+								callback *_callback);
+
+		virtual void async_replicate(const std::string &peer_id,
+									 const replicate_log_entries_request &req,
+									 replicate_log_entries_response &resp,
+									 callback *_callback);
+
+		/**
+		 * \brief send replicate_log_entries_request serialized
+		 * already.peers build it from entries serialized in log
+		 * cache.default one queue the blocking call of it
+		 * \param req serialized replicate_log_entries_request
+		 */
+		virtual void async_replicate(const std::string &peer_id,
+									 const std::string &req,
+									 replicate_log_entries_response &resp,
+									 callback *_callback);
+
+		virtual void async_install_snapshot(
+				const std::string &peer_id,
+				const install_snapshot_request &req,
+				install_snapshot_response &resp,
+				callback *_callback);
+
+		virtual void async_heartbeat(const std::string &peer_id,
+									 const heartbeat_request &req,
+									 heartbeat_response &resp,
+									 callback *_callback);
+
+		/**
+		 * \brief whether requests to one peer overlap on the wire.
+		 * default async calls of a peer are made one by one by its
+		 * thread,so replicate pipeline of peers works only if the
+		 * transport override async calls and return true.
+		 */
+		virtual bool pipeline();
+	private:
+		//async call queued to rpc_thread
+		struct rpc
+		{
+			int type_;
+			std::string peer_id_;
+			const google::protobuf::Message *req_;
+			//serialized req_ if not NULL
+			const std::string *body_;
+			google::protobuf::Message *resp_;
+			callback *callback_;
+		};
+
+		/**
+		 * \brief make the blocking calls to one peer in order
+		 */
+		class rpc_thread : public acl::thread
+		{
+		public:
+			explicit rpc_thread(transport &_transport);
+
+			~rpc_thread();
+
+			void push(const rpc &_rpc);
+
+			/**
+			 * \brief wait for rpcs queued done and exit
+			 */
+			void stop();
+		private:
+			virtual void *run();
+
+			transport &transport_;
+			bool stop_;
+			std::deque<rpc> rpcs_;
+			acl_pthread_mutex_t mutex_;
+			acl_pthread_cond_t cond_;
+		};
+
+		/**
+		 * \brief queue rpc to the thread of its peer
+		 */
+		void async_call(const rpc &_rpc);
+
+		/**
+		 * \brief make blocking call of rpc
+		 */
+		bool invoke(const rpc &_rpc);
+
+		std::map<std::string, rpc_thread*> rpc_threads_;
+		acl::locker rpc_threads_locker_;
+	};
+
+	/**
+	 * \brief transport on acl::http_rpc_client.requests are sent to
+	 * service paths /memkv{peer_id}/raft/{interface}.default
+	 * transport of node and multi_raft.
+	 * http_rpc_client call blocks,so async calls are the blocking
+	 * ones made by threads of transport.
+	 */
+	class http_rpc_transport : public transport
+	{
+	public:
+		http_rpc_transport();
+
+		static http_rpc_transport &get_instance();
+
+		virtual void add_peer(const std::string &peer_id,
+							  const std::string &addr);
+
+		virtual bool vote(const std::string &peer_id,
+						  const vote_request &req,
+						  vote_response &resp);
+
+		virtual bool replicate(const std::string &peer_id,
+							   const replicate_log_entries_request &req,
+							   replicate_log_entries_response &resp);
+
+		/**
+		 * \brief post the bytes as they are
+		 */
+		virtual bool replicate(const std::string &peer_id,
+							   const std::string &req,
+							   replicate_log_entries_response &resp);
+
+		virtual bool install_snapshot(const std::string &peer_id,
+									  const install_snapshot_request &req,
+									  install_snapshot_response &resp);
+
+		virtual bool heartbeat(const std::string &peer_id,
+							   const heartbeat_request &req,
+							   heartbeat_response &resp);
+	private:
+		struct service_paths
+		{
+			acl::string vote_;
+			acl::string replicate_;
+			acl::string install_snapshot_;
+			acl::string heartbeat_;
+		};
+
+		const service_paths *get_paths(const std::string &peer_id);
+
+		template<class REQ, class RESP>
+		bool call(const acl::string &path, const REQ &req, RESP &resp);
+
+		acl::http_rpc_client &rpc_client_;
+		//paths never removed,so pointers to them keep valid
+		std::map<std::string, service_paths*> paths_;
+		acl::locker locker_;
+	};
+}
@@ -0,0 +1,170 @@
+#include "raft.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32C_X64
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <nmmintrin.h>
+#endif
+#endif
+
+//reflected polynomial of crc32c
+#define __CRC32C_POLY__ 0x82f63b78
+
+namespace raft
+{
+	namespace
+	{
+		struct crc32c_table
+		{
+			crc32c_table()
+			{
+				for (unsigned int i = 0; i < 256; i++)
+				{
+					unsigned int crc = i;
+					for (int j = 0; j < 8; j++)
+						crc = (crc >> 1) ^ (__CRC32C_POLY__ & (0 - (crc & 1)));
+					table_[0][i] = crc;
+				}
+				//slice by 8
+				for (unsigned int i = 0; i < 256; i++)
+				{
+					for (int j = 1; j < 8; j++)
+					{
+						unsigned int crc = table_[j - 1][i];
+						table_[j][i] = (crc >> 8) ^ table_[0][crc & 0xff];
+					}
+				}
+			}
+			unsigned int table_[8][256];
+		};
+
+		const crc32c_table &get_table()
+		{
+			static crc32c_table table;
+			return table;
+		}
+
+		unsigned int crc32c_sw(const unsigned char *buffer,
+							   size_t len,
+							   unsigned int crc)
+		{
+			const unsigned int (*table)[256] = get_table().table_;
+
+			while (len >= 8)
+			{
+				unsigned char *ptr = (unsigned char*)buffer;
+				unsigned int low = get_le_uint32(ptr) ^ crc;
+				unsigned int high = get_le_uint32(ptr);
+
+				crc = table[7][low & 0xff] ^
+					table[6][(low >> 8) & 0xff] ^
+					table[5][(low >> 16) & 0xff] ^
+					table[4][low >> 24] ^
+					table[3][high & 0xff] ^
+					table[2][(high >> 8) & 0xff] ^
+					table[1][(high >> 16) & 0xff] ^
+					table[0][high >> 24];
+
+				buffer += 8;
+				len -= 8;
+			}
+			while (len--)
+				crc = (crc >> 8) ^ table[0][(crc ^ *buffer++) & 0xff];
+			return crc;
+		}
+
+#ifdef CRC32C_X64
+#if defined(_MSC_VER)
+		unsigned int crc32c_hw(const unsigned char *buffer,
+							   size_t len,
+							   unsigned int crc)
+		{
+			unsigned long long crc64 = crc;
+
+			while (len >= 8)
+			{
+				unsigned long long value;
+				memcpy(&value, buffer, sizeof(value));
+				crc64 = _mm_crc32_u64(crc64, value);
+				buffer += 8;
+				len -= 8;
+			}
+			crc = static_cast<unsigned int>(crc64);
+			while (len--)
+				crc = _mm_crc32_u8(crc, *buffer++);
+			return crc;
+		}
+
+		bool cpu_support_sse42()
+		{
+			int info[4];
+			__cpuid(info, 1);
+			return (info[2] & (1 << 20)) != 0;
+		}
+#else
+		__attribute__((target("sse4.2")))
+		unsigned int crc32c_hw(const unsigned char *buffer,
+							   size_t len,
+							   unsigned int crc)
+		{
+			unsigned long long crc64 = crc;
+
+			while (len >= 8)
+			{
+				unsigned long long value;
+				memcpy(&value, buffer, sizeof(value));
+				crc64 = __builtin_ia32_crc32di(crc64, value);
+				buffer += 8;
+				len -= 8;
+			}
+			crc = static_cast<unsigned int>(crc64);
+			while (len--)
+				crc = __builtin_ia32_crc32qi(crc, *buffer++);
+			return crc;
+		}
+
+		bool cpu_support_sse42()
+		{
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse4.2") != 0;
+		}
+#endif
+#endif
+		typedef unsigned int (*crc32c_func_t)(const unsigned char *,
+											  size_t,
+											  unsigned int);
+
+		crc32c_func_t get_crc32c_func()
+		{
+#ifdef CRC32C_X64
+			if (cpu_support_sse42())
+				return crc32c_hw;
+#endif
+			return crc32c_sw;
+		}
+
+		const crc32c_func_t crc32c_func = get_crc32c_func();
+	}
+
+	unsigned int crc32c(const void *data, size_t len, unsigned int crc)
+	{
+		return ~crc32c_func(static_cast<const unsigned char*>(data),
+							len,
+							~crc);
+	}
+
+	unsigned int crc32c_software(const void *data,
+								 size_t len,
+								 unsigned int crc)
+	{
+		return ~crc32c_sw(static_cast<const unsigned char*>(data),
+						  len,
+						  ~crc);
+	}
+
+	bool crc32c_hardware()
+	{
+		return crc32c_func != crc32c_sw;
+	}
+}
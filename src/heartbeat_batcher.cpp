@@ -0,0 +1,152 @@
+#include <algorithm>
+#include "raft.hpp"
+
+namespace raft
+{
+	heartbeat_batcher::heartbeat_batcher(scheduler &_scheduler,
+										 transport &_transport,
+										 unsigned int window)
+		:scheduler_(_scheduler),
+		 window_(window),
+		 transport_(_transport)
+	{
+		acl_pthread_mutex_init(&mutex_, NULL);
+		acl_pthread_cond_init(&cond_, NULL);
+	}
+
+	heartbeat_batcher::~heartbeat_batcher()
+	{
+		std::map<std::string, host*>::iterator it = hosts_.begin();
+		for (; it != hosts_.end(); ++it)
+		{
+			scheduler_.remove(it->second);
+
+			//wait for the request in flight done
+			acl_pthread_mutex_lock(&mutex_);
+			while (!it->second->sending_.empty())
+				acl_pthread_cond_wait(&cond_, &mutex_);
+			acl_pthread_mutex_unlock(&mutex_);
+
+			delete it->second;
+		}
+		acl_pthread_mutex_destroy(&mutex_);
+		acl_pthread_cond_destroy(&cond_);
+	}
+
+	void heartbeat_batcher::push(peer *_peer,
+								 const std::string &peer_id,
+								 const replicate_log_entries_request &req)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+
+		host *_host = NULL;
+		std::map<std::string, host*>::iterator it = hosts_.find(peer_id);
+		if (it == hosts_.end())
+		{
+			_host = new host(*this, peer_id);
+			hosts_[peer_id] = _host;
+		}
+		else
+			_host = it->second;
+
+		_host->peers_.push_back(_peer);
+		_host->req_.add_requests()->CopyFrom(req);
+
+		//wait for heartbeats of other peers to the host
+		if (_host->peers_.size() == 1)
+			scheduler_.set_timer(_host, window_);
+
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	void heartbeat_batcher::remove(peer *_peer)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+
+		std::map<std::string, host*>::iterator it = hosts_.begin();
+		for (; it != hosts_.end(); ++it)
+		{
+			host *_host = it->second;
+
+			for (size_t i = 0; i < _host->peers_.size();)
+			{
+				if (_host->peers_[i] != _peer)
+				{
+					i++;
+					continue;
+				}
+				_host->peers_.erase(_host->peers_.begin() + i);
+				_host->req_.mutable_requests()->
+					DeleteSubrange(static_cast<int>(i), 1);
+			}
+			while (std::find(_host->sending_.begin(),
+							 _host->sending_.end(),
+							 _peer) != _host->sending_.end())
+			{
+				acl_pthread_cond_wait(&cond_, &mutex_);
+			}
+		}
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	void heartbeat_batcher::set_window(unsigned int window)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		window_ = window;
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	heartbeat_batcher::host::host(heartbeat_batcher &batcher,
+								  const std::string &peer_id)
+		:batcher_(batcher),
+		 peer_id_(peer_id)
+	{
+
+	}
+
+	void heartbeat_batcher::host::run()
+	{
+		acl_pthread_mutex_lock(&batcher_.mutex_);
+		//the last one in flight.rpc_done() schedule it again
+		if (!sending_.empty() || peers_.empty())
+		{
+			acl_pthread_mutex_unlock(&batcher_.mutex_);
+			return;
+		}
+		sending_.swap(peers_);
+		sending_req_.Swap(&req_);
+		acl_pthread_mutex_unlock(&batcher_.mutex_);
+
+		resp_.Clear();
+		batcher_.transport_.async_heartbeat(peer_id_,
+											sending_req_,
+											resp_,
+											this);
+	}
+
+	void heartbeat_batcher::host::rpc_done(bool ok)
+	{
+		if (!ok)
+			logger_error("send heartbeat_request error");
+
+		replicate_log_entries_response empty;
+		for (size_t i = 0; i < sending_.size(); i++)
+		{
+			int index = static_cast<int>(i);
+			if (ok && index < resp_.responses_size())
+				sending_[i]->heartbeat_done(true, resp_.responses(index));
+			else
+				sending_[i]->heartbeat_done(false, empty);
+		}
+
+		acl_pthread_mutex_lock(&batcher_.mutex_);
+		sending_.clear();
+		//keep memory of requests for next time
+		sending_req_.Clear();
+		//heartbeats pushed when it in flight
+		if (!peers_.empty())
+			batcher_.scheduler_.schedule(this);
+		acl_pthread_cond_broadcast(&batcher_.cond_);
+		acl_pthread_mutex_unlock(&batcher_.mutex_);
+	}
+}
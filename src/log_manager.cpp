@@ -1,16 +1,111 @@
 #include <cstring>
 #include <map>
+#include <algorithm>
+#include <sched.h>
 #include "raft.hpp"
 
 #ifndef __LOG_EXT__ 
 #define __LOG_EXT__ ".log"
 #endif // !__LOG_EXT__ 
 
+#ifndef __SPARE_EXT__
+#define __SPARE_EXT__ ".spare"
+#endif // !__SPARE_EXT__
+
+#ifndef __BROKEN_EXT__
+#define __BROKEN_EXT__ ".broken"
+#endif // !__BROKEN_EXT__
+
+//wire types of protobuf
+#define WIRE_VARINT	0
+#define WIRE_BYTES	2
+
 namespace raft
 {
+	static size_t varint_size(unsigned long long value)
+	{
+		size_t size = 1;
+		while (value >= 0x80)
+		{
+			value >>= 7;
+			size++;
+		}
+		return size;
+	}
+
+	static void append_varint(std::string &buffer, unsigned long long value)
+	{
+		while (value >= 0x80)
+		{
+			buffer.push_back(static_cast<char>(value | 0x80));
+			value >>= 7;
+		}
+		buffer.push_back(static_cast<char>(value));
+	}
+
+	//field numbers are less than 16,so keys are one byte
+	static void append_key(std::string &buffer, int field, int wire_type)
+	{
+		buffer.push_back(static_cast<char>(field << 3 | wire_type));
+	}
+
+	//append serialized log_entry as entries of replicate request
+	static void append_entry(std::string &entries, const std::string &entry)
+	{
+		append_key(entries,
+				   replicate_log_entries_request::kEntriesFieldNumber,
+				   WIRE_BYTES);
+		append_varint(entries, entry.size());
+		entries.append(entry);
+	}
+
+	//same as above,but encode view directly.fields of default
+	//value are skipped as protobuf does
+	static void append_entry(std::string &entries,
+							 const log_entry_view &view)
+	{
+		unsigned long long type = static_cast<unsigned long long>(view.type_);
+		size_t size = 0;
+
+		if (view.index_)
+			size += 1 + varint_size(view.index_);
+		if (view.term_)
+			size += 1 + varint_size(view.term_);
+		if (type)
+			size += 1 + varint_size(type);
+		if (view.len_)
+			size += 1 + varint_size(view.len_) + view.len_;
+
+		append_key(entries,
+				   replicate_log_entries_request::kEntriesFieldNumber,
+				   WIRE_BYTES);
+		append_varint(entries, size);
+		if (view.index_)
+		{
+			append_key(entries, log_entry::kIndexFieldNumber, WIRE_VARINT);
+			append_varint(entries, view.index_);
+		}
+		if (view.term_)
+		{
+			append_key(entries, log_entry::kTermFieldNumber, WIRE_VARINT);
+			append_varint(entries, view.term_);
+		}
+		if (type)
+		{
+			append_key(entries, log_entry::kTypeFieldNumber, WIRE_VARINT);
+			append_varint(entries, type);
+		}
+		if (view.len_)
+		{
+			append_key(entries, log_entry::kLogDataFieldNumber, WIRE_BYTES);
+			append_varint(entries, view.len_);
+			entries.append(view.data_, view.len_);
+		}
+	}
 
 	log_manager::log_manager(const std::string &path) 
-		:path_(path)
+		:path_(path),
+		preallocator_(*this)
 	{
 		if(path_.empty())
         {
@@ -22,13 +117,44 @@ namespace raft
         append_slash(path_);
 
 		log_size_	= 4 * 1024 * 1024;
+		reload_threads_ = 4;
+		last_seq_	= 0;
 		last_index_ = 0;
 		last_log_	= NULL;
 		last_term_	= 0;
+
+		log_table_		= new log_table;
+		table_epoch_	= 0;
+		table_readers_[0] = 0;
+		table_readers_[1] = 0;
+
+		sync_mode_		= e_sync_none;
+		sync_entries_	= 0;
+		sync_micros_	= 0;
+		syncing_		= false;
+		synced_index_	= 0;
+		written_index_	= 0;
+		gettimeofday(&first_written_time_, NULL);
+
+		cache_bytes_	= 0;
+		max_cache_bytes_ = 0;
+
+		spare_count_	= 0;
+		spare_seq_		= 0;
+		prefault_		= false;
+		preallocator_stop_ = false;
+		preallocator_started_ = false;
+
+		acl_pthread_mutex_init(&sync_mutex_, NULL);
+		acl_pthread_cond_init(&sync_cond_, NULL);
+		acl_pthread_mutex_init(&spare_mutex_, NULL);
+		acl_pthread_cond_init(&spare_cond_, NULL);
 	}
 
 	log_manager::~log_manager()
 	{
+		stop_preallocator();
+
 		acl::lock_guard lg(locker_);
 
 		std::map<log_index_t, log*>::iterator it = logs_.begin();
@@ -36,6 +162,133 @@ namespace raft
 		{
 			it->second->dec_ref();
 		}
+		acl_pthread_mutex_destroy(&sync_mutex_);
+		acl_pthread_cond_destroy(&sync_cond_);
+		acl_pthread_mutex_destroy(&spare_mutex_);
+		acl_pthread_cond_destroy(&spare_cond_);
+		delete log_table_.load();
+	}
+
+	void log_manager::set_preallocate(size_t count, bool prefault)
+	{
+		acl_pthread_mutex_lock(&spare_mutex_);
+		spare_count_ = count;
+		prefault_ = prefault;
+		bool start = count && !preallocator_started_;
+		preallocator_started_ = preallocator_started_ || start;
+		acl_pthread_cond_signal(&spare_cond_);
+		acl_pthread_mutex_unlock(&spare_mutex_);
+
+		if (start)
+			preallocator_.start();
+	}
+
+	void log_manager::stop_preallocator()
+	{
+		acl_pthread_mutex_lock(&spare_mutex_);
+		preallocator_stop_ = true;
+		bool started = preallocator_started_;
+		preallocator_started_ = false;
+		acl_pthread_cond_signal(&spare_cond_);
+		acl_pthread_mutex_unlock(&spare_mutex_);
+
+		if (started)
+			preallocator_.wait();
+
+		std::list<log*>::iterator it = spare_logs_.begin();
+		for (; it != spare_logs_.end(); ++it)
+		{
+			(*it)->auto_delete(true);
+			(*it)->dec_ref();
+		}
+		spare_logs_.clear();
+	}
+
+	log *log_manager::pop_spare_log()
+	{
+		log *_log = NULL;
+
+		acl_pthread_mutex_lock(&spare_mutex_);
+		if (spare_logs_.size())
+		{
+			_log = spare_logs_.front();
+			spare_logs_.pop_front();
+			//create next one
+			acl_pthread_cond_signal(&spare_cond_);
+		}
+		acl_pthread_mutex_unlock(&spare_mutex_);
+		return _log;
+	}
+
+	/*
+	 * create log file for entries after last_index_.
+	 * use spare log file if there is one.
+	 */
+	log *log_manager::new_log()
+	{
+		acl::string file_path(path_.c_str());
+
+		file_path.format_append("%llu%s",
+								last_index_ + 1,
+								__LOG_EXT__);
+
+		log *_log = pop_spare_log();
+		if (_log)
+		{
+			if (_log->reset(file_path.c_str(), last_index_))
+				return _log;
+
+			logger_error("reset spare log error");
+			_log->auto_delete(true);
+			_log->dec_ref();
+		}
+		return create(file_path.c_str());
+	}
+
+	log_manager::preallocator::preallocator(log_manager &manager)
+		:manager_(manager)
+	{
+
+	}
+
+	void *log_manager::preallocator::run()
+	{
+		while (true)
+		{
+			acl_pthread_mutex_lock(&manager_.spare_mutex_);
+			while (!manager_.preallocator_stop_ &&
+				   manager_.spare_logs_.size() >= manager_.spare_count_)
+			{
+				acl_pthread_cond_wait(&manager_.spare_cond_,
+									  &manager_.spare_mutex_);
+			}
+			if (manager_.preallocator_stop_)
+			{
+				acl_pthread_mutex_unlock(&manager_.spare_mutex_);
+				break;
+			}
+			bool prefault = manager_.prefault_;
+			acl::string file_path(manager_.path_.c_str());
+			file_path.format_append("%lu%s",
+									(unsigned long)++manager_.spare_seq_,
+									__SPARE_EXT__);
+			acl_pthread_mutex_unlock(&manager_.spare_mutex_);
+
+			log *_log = manager_.create(file_path.c_str());
+			if (!_log)
+			{
+				logger_error("create spare log error");
+				acl_doze(1000);
+				continue;
+			}
+			if (prefault)
+				_log->prefault();
+
+			acl_pthread_mutex_lock(&manager_.spare_mutex_);
+			manager_.spare_logs_.push_back(_log);
+			acl_pthread_mutex_unlock(&manager_.spare_mutex_);
+		}
+		return NULL;
 	}
 	
 	log_index_t log_manager::write(const log_entry &entry)
@@ -49,13 +302,7 @@ namespace raft
 			if (last_log_)
 				acl_assert(last_log_->eof());
 
-			acl::string file_path(path_.c_str());
-
-			file_path.format_append("%llu%s",
-                                    last_index_ + 1,
-                                    __LOG_EXT__);
-
-			last_log_ = create(file_path.c_str());
+			last_log_ = new_log();
 			if (!last_log_)
 			{
 				logger_error("create log error");
@@ -71,27 +318,315 @@ namespace raft
 			}
 			log_index_t start_index = last_log_->start_index();
 			logs_.insert(std::make_pair(start_index, last_log_));
+			publish_log_table();
 		}
 		//update begin ,term. 
-		last_index_ = index;
-		last_term_ = entry.term();
+		set_last_log(index, entry.term());
+
+		cache_entry(entry);
 
 		return index;
 	}
 
+	log_index_t log_manager::write(const std::vector<log_entry> &entries)
+	{
+		size_t count = 0;
+
+		acl::lock_guard lg(locker_);
+
+		while (count < entries.size())
+		{
+			size_t n = 0;
+
+			if (!last_log_ || (n = last_log_->write_batch(entries, count)) == 0)
+			{
+				if (last_log_)
+					acl_assert(last_log_->eof());
+
+				last_log_ = new_log();
+				if (!last_log_)
+				{
+					logger_error("create log error");
+					return 0;
+				}
+
+				if ((n = last_log_->write_batch(entries, count)) == 0)
+				{
+					logger_error("write log error");
+					last_log_->dec_ref();
+					last_log_ = NULL;
+					return 0;
+				}
+				log_index_t start_index = last_log_->start_index();
+				logs_.insert(std::make_pair(start_index, last_log_));
+				publish_log_table();
+			}
+			for (size_t i = count; i < count + n; i++)
+				cache_entry(entries[i]);
+
+			count += n;
+
+			set_last_log(entries[count - 1].index(),
+						 entries[count - 1].term());
+		}
+
+		return last_index_;
+	}
+
+	void log_manager::set_sync_mode(sync_mode_t mode,
+									size_t sync_entries,
+									unsigned int sync_micros)
+	{
+		acl_pthread_mutex_lock(&sync_mutex_);
+		sync_mode_ = mode;
+		sync_entries_ = sync_entries;
+		sync_micros_ = sync_micros;
+		acl_pthread_mutex_unlock(&sync_mutex_);
+	}
+
+	void log_manager::set_cache_size(size_t max_bytes)
+	{
+		acl::lock_guard lg(cache_locker_);
+		max_cache_bytes_ = max_bytes;
+
+		while (cache_.size() && cache_bytes_ > max_cache_bytes_)
+		{
+			cache_bytes_ -= cache_.front().bytes_.size();
+			cache_.pop_front();
+		}
+	}
+
+	void log_manager::cache_entry(const log_entry &entry)
+	{
+		acl::lock_guard lg(cache_locker_);
+
+		if (!max_cache_bytes_)
+			return;
+
+		//keep cache continuous
+		if (cache_.size() && cache_.back().index_ + 1 != entry.index())
+		{
+			cache_.clear();
+			cache_bytes_ = 0;
+		}
+
+		cache_.push_back(cached_entry());
+		cache_.back().index_ = entry.index();
+		entry.SerializeToString(&cache_.back().bytes_);
+		cache_bytes_ += cache_.back().bytes_.size();
+
+		while (cache_.size() && cache_bytes_ > max_cache_bytes_)
+		{
+			cache_bytes_ -= cache_.front().bytes_.size();
+			cache_.pop_front();
+		}
+	}
+
+	bool log_manager::read_cache(log_index_t index,
+		int max_bytes,
+		int max_count,
+		std::vector<log_entry*> &entries)
+	{
+		acl::lock_guard lg(cache_locker_);
+
+		if (cache_.empty() ||
+			index < cache_.front().index_ ||
+			index > cache_.back().index_)
+		{
+			return false;
+		}
+
+		size_t i = static_cast<size_t>(index - cache_.front().index_);
+		for (; i < cache_.size(); i++)
+		{
+			if (max_bytes <= 0 || max_count <= 0)
+				break;
+
+			//no need to read it from log file
+			log_entry *entry = new log_entry;
+			entry->ParseFromString(cache_[i].bytes_);
+			entries.push_back(entry);
+
+			max_bytes -= static_cast<int>(cache_[i].bytes_.size());
+			--max_count;
+		}
+		return true;
+	}
+
+	void log_manager::truncate_cache(log_index_t index)
+	{
+		acl::lock_guard lg(cache_locker_);
+
+		while (cache_.size() && cache_.back().index_ >= index)
+		{
+			cache_bytes_ -= cache_.back().bytes_.size();
+			cache_.pop_back();
+		}
+	}
+
+	log_manager::sync_mode_t log_manager::sync_mode()
+	{
+		acl_pthread_mutex_lock(&sync_mutex_);
+		sync_mode_t mode = sync_mode_;
+		acl_pthread_mutex_unlock(&sync_mutex_);
+		return mode;
+	}
+
+	log_index_t log_manager::sync_index()
+	{
+		if (sync_mode() == e_sync_none)
+			return last_index();
+
+		acl_pthread_mutex_lock(&sync_mutex_);
+		log_index_t index = synced_index_;
+		acl_pthread_mutex_unlock(&sync_mutex_);
+		return index;
+	}
+
+	bool log_manager::sync(log_index_t index, bool group)
+	{
+		if (sync_mode() == e_sync_none)
+			return true;
+
+		acl_pthread_mutex_lock(&sync_mutex_);
+
+		update_written_index(index);
+
+		while (synced_index_ < index)
+		{
+			//other one is flushing.wait for it and check again
+			if (syncing_)
+			{
+				acl_pthread_cond_wait(&sync_cond_, &sync_mutex_);
+				continue;
+			}
+
+			if (group && sync_mode_ == e_sync_group &&
+				!wait_for_group(index))
+				continue;
+
+			/**
+			 * this thread flush for all the waiters.
+			 * entries written before now will be flushed together.
+			 */
+			syncing_ = true;
+			log_index_t synced_index = synced_index_;
+			acl_pthread_mutex_unlock(&sync_mutex_);
+
+			bool rc = do_sync(synced_index);
+
+			acl_pthread_mutex_lock(&sync_mutex_);
+			syncing_ = false;
+			if (rc && synced_index_ < synced_index)
+				synced_index_ = synced_index;
+			acl_pthread_cond_broadcast(&sync_cond_);
+
+			if (!rc)
+			{
+				acl_pthread_mutex_unlock(&sync_mutex_);
+				logger_error("sync log error");
+				return false;
+			}
+		}
+		acl_pthread_mutex_unlock(&sync_mutex_);
+		return true;
+	}
+
+	void log_manager::update_written_index(log_index_t index)
+	{
+		if (written_index_ >= index)
+			return;
+
+		if (written_index_ <= synced_index_)
+			gettimeofday(&first_written_time_, NULL);
+		written_index_ = index;
+
+		if (sync_mode_ == e_sync_group &&
+			written_index_ - synced_index_ >= sync_entries_)
+		{
+			acl_pthread_cond_broadcast(&sync_cond_);
+		}
+	}
+
+	bool log_manager::wait_for_group(log_index_t index)
+	{
+		timespec timeout;
+
+		timeout.tv_sec = first_written_time_.tv_sec;
+		timeout.tv_nsec = first_written_time_.tv_usec * 1000;
+
+		timeout.tv_sec += sync_micros_ / 1000000;
+		timeout.tv_nsec += sync_micros_ % 1000000 * 1000;
+
+		if (timeout.tv_nsec >= 1000000000)
+		{
+			timeout.tv_sec += 1;
+			timeout.tv_nsec -= 1000000000;
+		}
+
+		//wait for more entries to flush in one go
+		while (!syncing_ && synced_index_ < index &&
+			   written_index_ - synced_index_ < sync_entries_)
+		{
+			int status = acl_pthread_cond_timedwait(&sync_cond_,
+													&sync_mutex_,
+													&timeout);
+			if (status == ACL_ETIMEDOUT)
+				break;
+		}
+		return !syncing_ && synced_index_ < index;
+	}
+
+	bool log_manager::do_sync(log_index_t &synced_index)
+	{
+		std::vector<log*> logs;
+		log_index_t index = 0;
+
+		locker_.lock();
+		//entries [1, last_index_] are all in the mmap now
+		index = last_index_;
+		std::map<log_index_t, log*>::iterator it = logs_.begin();
+		for (; it != logs_.end(); ++it)
+		{
+			if (it->second->last_index() > synced_index)
+			{
+				it->second->inc_ref();
+				logs.push_back(it->second);
+			}
+		}
+		locker_.unlock();
+
+		bool rc = true;
+		for (size_t i = 0; i < logs.size(); i++)
+		{
+			if (rc && !logs[i]->sync())
+				rc = false;
+			logs[i]->dec_ref();
+		}
+		if (rc)
+			synced_index = index;
+		return rc;
+	}
+
 	bool log_manager::read(log_index_t index, log_entry &entry)
 	{
+		{
+			acl::lock_guard lg(cache_locker_);
+			if (cache_.size() &&
+				index >= cache_.front().index_ &&
+				index <= cache_.back().index_)
+			{
+				return entry.ParseFromString(
+					cache_[index - cache_.front().index_].bytes_);
+			}
+		}
 
-		if (index > last_index() ||
-            index < start_index() ||
-            !log_count())
-        {
-            return false;
-        }
+		if (index > last_index())
+			return false;
 
-		
 		log *log_ = find_log(index);
-		acl_assert(log_);
+		if (!log_)
+			return false;
 
 		bool result = log_->read(index, entry);
 		log_->dec_ref();
@@ -101,6 +636,17 @@ namespace raft
 
 	void log_manager::truncate(log_index_t index)
 	{
+		acl_pthread_mutex_lock(&sync_mutex_);
+		if (synced_index_ >= index)
+			synced_index_ = index - 1;
+		if (written_index_ >= index)
+			written_index_ = index - 1;
+		acl_pthread_mutex_unlock(&sync_mutex_);
+
+		truncate_cache(index);
+
+		std::vector<log*> removed;
+
 		acl::lock_guard lg(locker_);
 		std::map<log_index_t, log*>::iterator it = logs_.begin();
 		for(;it != logs_.end();)
@@ -108,13 +654,21 @@ namespace raft
 			log* _log = it->second;
 			if(_log->last_index() <= index)
 			{
-				_log->auto_delete(true);
-				_log->dec_ref();
+				removed.push_back(_log);
 				logs_.erase(it++);
 				continue;
 			}
 			_log->truncate(index);
+			break;
+		}
+		if (removed.empty())
 			return;
+
+		publish_log_table();
+		for (size_t i = 0; i < removed.size(); i++)
+		{
+			removed[i]->auto_delete(true);
+			removed[i]->dec_ref();
 		}
 	}
 
@@ -126,6 +680,10 @@ namespace raft
 		int bytes = 0;
 		log_index_t begin = index;
 
+		//entries in cache are all the latest ones
+		if (read_cache(index, max_bytes, max_count, entries))
+			return !entries.empty();
+
 		do
 		{
 			if ( max_bytes <= 0 ||
@@ -164,18 +722,162 @@ namespace raft
 		return !entries.empty();
 	}
 
+	bool log_manager::read(log_index_t index,
+		int max_bytes,
+		int max_count,
+		std::vector<log_entry_view> &views)
+	{
+		int bytes = 0;
+		log_index_t begin = index;
+		size_t count = views.size();
+
+		while (max_bytes > 0 &&
+			   max_count > 0 &&
+			   begin <= last_index())
+		{
+			log *log_ = find_log(begin);
+			if (!log_)
+				break;
+
+			size_t size = views.size();
+			bool rc = log_->read(begin, max_bytes, max_count, views, bytes);
+			log_->dec_ref();
+
+			if (!rc)
+			{
+				logger("read log error. "
+					   "last_log_index(%llu),"
+					   "index(%llu)",
+					   last_index(),
+					   begin);
+				break;
+			}
+			begin += views.size() - size;
+			max_count -= static_cast<int>(views.size() - size);
+			max_bytes -= bytes;
+			bytes = 0;
+		}
+
+		return views.size() != count;
+	}
+
+	bool log_manager::read(log_index_t index, log_entry_view &view)
+	{
+		std::vector<log_entry_view> views;
+
+		if (!read(index, 1, 1, views))
+			return false;
+
+		view = views[0];
+		return true;
+	}
+
+	bool log_manager::read(log_index_t index,
+		int max_bytes,
+		int max_count,
+		log_entries_t &entries)
+	{
+		int count = entries.size();
+
+		cache_locker_.lock();
+		if (cache_.size() &&
+			index >= cache_.front().index_ &&
+			index <= cache_.back().index_)
+		{
+			size_t i = static_cast<size_t>(index - cache_.front().index_);
+			for (; i < cache_.size(); i++)
+			{
+				if (max_bytes <= 0 || max_count <= 0)
+					break;
+
+				//reuse cleared one
+				log_entry *entry = entries.Add();
+				entry->ParseFromString(cache_[i].bytes_);
+
+				max_bytes -= static_cast<int>(cache_[i].bytes_.size());
+				--max_count;
+			}
+			cache_locker_.unlock();
+			return entries.size() != count;
+		}
+		cache_locker_.unlock();
+
+		std::vector<log_entry_view> views;
+		if (!read(index, max_bytes, max_count, views))
+			return false;
+
+		for (size_t i = 0; i < views.size(); i++)
+		{
+			log_entry *entry = entries.Add();
+			entry->set_index(views[i].index_);
+			entry->set_term(views[i].term_);
+			entry->set_type(views[i].type_);
+			entry->mutable_log_data()->assign(views[i].data_, views[i].len_);
+		}
+		return true;
+	}
+
+	bool log_manager::read(log_index_t index,
+		int max_bytes,
+		int max_count,
+		std::string &entries,
+		int &count)
+	{
+		count = 0;
+
+		cache_locker_.lock();
+		if (cache_.size() &&
+			index >= cache_.front().index_ &&
+			index <= cache_.back().index_)
+		{
+			size_t i = static_cast<size_t>(index - cache_.front().index_);
+			for (; i < cache_.size(); i++)
+			{
+				if (max_bytes <= 0 || max_count <= 0)
+					break;
+
+				append_entry(entries, cache_[i].bytes_);
+
+				max_bytes -= static_cast<int>(cache_[i].bytes_.size());
+				--max_count;
+				++count;
+			}
+			cache_locker_.unlock();
+			return count != 0;
+		}
+		cache_locker_.unlock();
+
+		std::vector<log_entry_view> views;
+		if (!read(index, max_bytes, max_count, views))
+			return false;
+
+		for (size_t i = 0; i < views.size(); i++)
+			append_entry(entries, views[i]);
+
+		count = static_cast<int>(views.size());
+		return true;
+	}
+
 	size_t log_manager::log_count()
 	{
-		acl::lock_guard lg(locker_);
-		return logs_.size();
+		int slot = lock_log_table();
+		size_t count = log_table_.load(std::memory_order_acquire)->logs_.size();
+		unlock_log_table(slot);
+		return count;
 	}
 
 	raft::log_index_t log_manager::start_index()
 	{
-		acl::lock_guard lg(locker_);
+		int slot = lock_log_table();
+		log_table *table = log_table_.load(std::memory_order_acquire);
+		log_index_t index = 0;
+		if (table->start_indexes_.size())
+			index = table->start_indexes_.front();
+		unlock_log_table(slot);
+
+		if (index)
+			return index;
 
-		if (logs_.size())
-			return logs_.begin()->first;
 		/*
 		 * when log_manager empty. and
 		 * last_index_ eq start_index_;
@@ -185,14 +887,37 @@ namespace raft
 
 	raft::log_index_t log_manager::last_index()
 	{
-		acl::lock_guard lg(locker_);
-		return last_index_;
+		return last_index_.load(std::memory_order_acquire);
 	}
 
 	term_t log_manager::last_term()
 	{
-		acl::lock_guard lg(locker_);
-		return last_term_;
+		return last_term_.load(std::memory_order_acquire);
+	}
+
+	void log_manager::last_log(log_index_t &index, term_t &term)
+	{
+		unsigned int seq;
+
+		do
+		{
+			seq = last_seq_.load(std::memory_order_acquire);
+			index = last_index_.load(std::memory_order_relaxed);
+			term = last_term_.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+		} while ((seq & 1) ||
+				 seq != last_seq_.load(std::memory_order_relaxed));
+	}
+
+	void log_manager::set_last_log(log_index_t index, term_t term)
+	{
+		unsigned int seq = last_seq_.load(std::memory_order_relaxed);
+
+		last_seq_.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		last_index_.store(index, std::memory_order_release);
+		last_term_.store(term, std::memory_order_release);
+		last_seq_.store(seq + 2, std::memory_order_release);
 	}
 
 	log_infos_t log_manager::logs_info()
@@ -216,27 +941,38 @@ namespace raft
 		typedef std::map<log_index_t, log*>::iterator
                 iterator_t;
 
+		cache_locker_.lock();
+		while (cache_.size() && cache_.front().index_ <= last_index)
+		{
+			cache_bytes_ -= cache_.front().bytes_.size();
+			cache_.pop_front();
+		}
+		cache_locker_.unlock();
+
 		acl::lock_guard lg(locker_);
-		int del_count_ = 0;
+		std::vector<log*> removed;
 		iterator_t it = logs_.begin();
 
-		for(; it!= logs_.end(); ++it)
+		while (it != logs_.end())
 		{
-			if (it->second->last_index() <= last_index)
-			{
-				std::string file_path = it->second->file_path();
-				it->second->auto_delete(true);
-				it->second->dec_ref();
-				logs_.erase(it++);
-				del_count_++;
-				logger("log_manager discard log( %s )",
-                       file_path.c_str());
-			}
-			else
+			if (it->second->last_index() > last_index)
 				break;
+
+			removed.push_back(it->second);
+			it = logs_.erase(it);
 		}
+		if (removed.size())
+			publish_log_table();
 
-		return del_count_;
+		for (size_t i = 0; i < removed.size(); i++)
+		{
+			logger("log_manager discard log( %s )",
+				   removed[i]->file_path().c_str());
+			removed[i]->auto_delete(true);
+			removed[i]->dec_ref();
+		}
+
+		return static_cast<int>(removed.size());
 	}
 
 	void log_manager::set_log_size(size_t log_size)
@@ -246,56 +982,199 @@ namespace raft
 
 	void log_manager::set_last_index(log_index_t index)
 	{
+		acl_pthread_mutex_lock(&sync_mutex_);
+		synced_index_ = written_index_ = index;
+		acl_pthread_mutex_unlock(&sync_mutex_);
+
+		truncate_cache(0);
+
 		acl::lock_guard lg(locker_);
-		last_index_ = index;
+		set_last_log(index, last_term_);
 	}
 
 	void log_manager::set_last_term(term_t term)
 	{
 		acl::lock_guard lg(locker_);
-		last_term_ = term;
+		set_last_log(last_index_, term);
 	}
 
 	log * log_manager::find_log(log_index_t index)
 	{
-		acl::lock_guard lg(locker_);
+		log *_log = NULL;
+		int slot = lock_log_table();
+		log_table *table = log_table_.load(std::memory_order_acquire);
 
-		if (last_log_ && index >= last_log_->start_index())
+		//last one which start_index <= index
+		std::vector<log_index_t>::const_iterator it =
+			std::upper_bound(table->start_indexes_.begin(),
+							 table->start_indexes_.end(),
+							 index);
+		if (it != table->start_indexes_.begin())
 		{
-			last_log_->inc_ref();
-			return last_log_;
+			_log = table->logs_[it - table->start_indexes_.begin() - 1];
+			_log->inc_ref();
 		}
+		unlock_log_table(slot);
+		return _log;
+	}
+
+	int log_manager::lock_log_table()
+	{
+		while (true)
+		{
+			unsigned int epoch = table_epoch_.load();
+			int slot = epoch & 1;
+
+			table_readers_[slot].fetch_add(1);
+			//publish_log_table() not flip epoch yet
+			if (table_epoch_.load() == epoch)
+				return slot;
+			table_readers_[slot].fetch_sub(1);
+		}
+	}
+
+	void log_manager::unlock_log_table(int slot)
+	{
+		table_readers_[slot].fetch_sub(1, std::memory_order_release);
+	}
+
+	void log_manager::publish_log_table()
+	{
+		log_table *table = new log_table;
 
-		std::map<log_index_t, log*>::reverse_iterator it
-                = logs_.rbegin();
+		table->start_indexes_.reserve(logs_.size());
+		table->logs_.reserve(logs_.size());
 
-		for (; it != logs_.rend(); ++it)
+		std::map<log_index_t, log*>::iterator it = logs_.begin();
+		for (; it != logs_.end(); ++it)
 		{
-			if (it->first <= index)
-			{
-				it->second->inc_ref();
-				return it->second;
-			}
+			table->start_indexes_.push_back(it->first);
+			table->logs_.push_back(it->second);
 		}
+		table = log_table_.exchange(table);
+
+		//new readers count in the other slot,and see the new table.
+		//wait for readers may see the old one
+		unsigned int epoch = table_epoch_.fetch_add(1);
+		while (table_readers_[epoch & 1].load() != 0)
+			sched_yield();
+
+		delete table;
+	}
+
+	log_manager::reload_worker::reload_worker(log_manager &manager,
+		const std::vector<std::string> &files,
+		std::vector<log*> &logs,
+		size_t begin,
+		size_t step)
+		:manager_(manager),
+		files_(files),
+		logs_(logs),
+		begin_(begin),
+		step_(step)
+	{
+
+	}
+
+	void *log_manager::reload_worker::run()
+	{
+		for (size_t i = begin_; i < files_.size(); i += step_)
+			logs_[i] = manager_.create(files_[i]);
 		return NULL;
 	}
 
+	void log_manager::set_reload_threads(size_t count)
+	{
+		reload_threads_ = count ? count : 1;
+	}
+
+	/*
+	 * keep the files of log for checking by hand.
+	 * they are not reloaded any more.
+	 */
+	void log_manager::quarantine_log(log *_log)
+	{
+		std::string file_path = _log->file_path();
+		_log->dec_ref();
+
+		std::string index_path = file_path + ".index";
+		if (rename(file_path.c_str(),
+				   (file_path + __BROKEN_EXT__).c_str()) != 0 ||
+			(acl_file_size(index_path.c_str()) != -1 &&
+			 rename(index_path.c_str(),
+					(index_path + __BROKEN_EXT__).c_str()) != 0))
+		{
+			logger_error("rename log file(%s) error.%s",
+						 file_path.c_str(),
+						 acl::last_serror());
+			return;
+		}
+		logger("log file(%s) moved to %s%s",
+			   file_path.c_str(),
+			   file_path.c_str(),
+			   __BROKEN_EXT__);
+	}
+
 	bool log_manager::reload_logs()
 	{
 		acl::lock_guard lg(locker_);
 
-        std::set<std::string> files =
+		//spare log files of last run
+		std::set<std::string> spare_files = list_dir(path_, __SPARE_EXT__);
+		for (std::set<std::string>::iterator it = spare_files.begin();
+			 it != spare_files.end(); ++it)
+		{
+			remove(it->c_str());
+			remove((*it + ".index").c_str());
+		}
+
+        std::set<std::string> file_set =
                 list_dir(path_, __LOG_EXT__);
+		std::vector<std::string> files(file_set.begin(), file_set.end());
+		std::vector<log*> logs(files.size(), (log*)NULL);
+
+		//open log files in parallel
+		size_t count = std::min(reload_threads_, files.size());
+		std::vector<reload_worker*> workers;
+
+		for (size_t i = 1; i < count; i++)
+		{
+			reload_worker *worker =
+				new reload_worker(*this, files, logs, i, count);
+			worker->start();
+			workers.push_back(worker);
+		}
+		for (size_t i = 0; count && i < files.size(); i += count)
+			logs[i] = create(files[i]);
+
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			workers[i]->wait();
+			delete workers[i];
+		}
+
+		std::map<log_index_t, log*> reloaded;
 
-        for(std::set<std::string>::iterator it=
-                files.begin(); it != files.end(); ++it)
+        for(size_t i = 0; i < files.size(); ++i)
 		{
-            log *_log = create(*it);
+            log *_log = logs[i];
             if(!_log)
             {
                 logger_error("create log error "
                              "file_path(%s)",
-							 it->c_str());
+							 files[i].c_str());
+				//release logs opened by workers
+				for (size_t j = i + 1; j < logs.size(); j++)
+				{
+					if (logs[j])
+						logs[j]->dec_ref();
+				}
+				//and the ones opened before
+				for (std::map<log_index_t, log*>::iterator it =
+						 reloaded.begin(); it != reloaded.end(); ++it)
+				{
+					it->second->dec_ref();
+				}
                 return false;
             }
             //delete empty log
@@ -306,15 +1185,46 @@ namespace raft
                 continue;
             }
             log_index_t index = _log->start_index();
-            acl_assert(logs_.insert(
-                    std::make_pair(index, _log)).second);
+            if (!reloaded.insert(std::make_pair(index, _log)).second)
+            {
+                logger_error("log file(%s) start_index(%llu) duplicated",
+                             files[i].c_str(),
+                             index);
+                quarantine_log(_log);
+            }
         }
+
+		//a log truncated by reload leaves a hole before the next one.
+		//logs after the hole must not be used
+		log_index_t last_index = 0;
+		for (std::map<log_index_t, log*>::iterator it = reloaded.begin();
+			 it != reloaded.end(); ++it)
+		{
+			log *_log = it->second;
+			if (last_index && _log->start_index() != last_index + 1)
+			{
+				logger_error("log file(%s) start_index(%llu) not "
+							 "follow last_index(%llu)",
+							 _log->file_path().c_str(),
+							 _log->start_index(),
+							 last_index);
+				for (; it != reloaded.end(); ++it)
+					quarantine_log(it->second);
+				break;
+			}
+			last_index = _log->last_index();
+			logs_.insert(std::make_pair(_log->start_index(), _log));
+		}
+		publish_log_table();
 		if(logs_.size())
 		{
             log *_log = logs_.rbegin()->second;
-			last_index_ =_log->last_index();
-            last_term_ = _log->last_term();
+			set_last_log(_log->last_index(), _log->last_term());
 		}
+		//logs reload from disk are synced
+		acl_pthread_mutex_lock(&sync_mutex_);
+		synced_index_ = written_index_ = last_index_;
+		acl_pthread_mutex_unlock(&sync_mutex_);
         return true;
 	}
 
@@ -0,0 +1,238 @@
+#include "raft.hpp"
+
+#define LOOPBACK_SECTION 14
+
+namespace raft
+{
+	loopback_transport::loopback_transport()
+	{
+		acl_pthread_mutex_init(&mutex_, NULL);
+		acl_pthread_cond_init(&cond_, NULL);
+	}
+
+	loopback_transport::~loopback_transport()
+	{
+		std::map<std::string, endpoint*>::iterator it = endpoints_.begin();
+		for (; it != endpoints_.end(); ++it)
+			delete it->second;
+
+		acl_pthread_mutex_destroy(&mutex_);
+		acl_pthread_cond_destroy(&cond_);
+	}
+
+	void loopback_transport::bind(const std::string &peer_id, node *_node)
+	{
+		bind(peer_id, _node, NULL);
+	}
+
+	void loopback_transport::bind(const std::string &peer_id,
+								  multi_raft *host)
+	{
+		bind(peer_id, NULL, host);
+	}
+
+	void loopback_transport::bind(const std::string &peer_id,
+								  node *_node,
+								  multi_raft *host)
+	{
+		unbind(peer_id);
+
+		endpoint *_endpoint = new endpoint;
+		_endpoint->node_ = _node;
+		_endpoint->host_ = host;
+		_endpoint->connected_ = true;
+		_endpoint->ref_ = 0;
+
+		acl_pthread_mutex_lock(&mutex_);
+		endpoints_[peer_id] = _endpoint;
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	void loopback_transport::unbind(const std::string &peer_id)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+
+		std::map<std::string, endpoint*>::iterator
+			it = endpoints_.find(peer_id);
+		if (it == endpoints_.end())
+		{
+			acl_pthread_mutex_unlock(&mutex_);
+			return;
+		}
+		endpoint *_endpoint = it->second;
+		endpoints_.erase(it);
+
+		while (_endpoint->ref_)
+			acl_pthread_cond_wait(&cond_, &mutex_);
+
+		acl_pthread_mutex_unlock(&mutex_);
+
+		delete _endpoint;
+	}
+
+	void loopback_transport::set_connected(const std::string &peer_id,
+										   bool connected)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+
+		std::map<std::string, endpoint*>::iterator
+			it = endpoints_.find(peer_id);
+		if (it != endpoints_.end())
+			it->second->connected_ = connected;
+
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	void loopback_transport::add_peer(const std::string &,
+									  const std::string &)
+	{
+		//peers found by id.address not used
+	}
+
+	loopback_transport::endpoint *
+	loopback_transport::acquire_endpoint(const std::string &peer_id)
+	{
+		endpoint *_endpoint = NULL;
+
+		acl_pthread_mutex_lock(&mutex_);
+
+		std::map<std::string, endpoint*>::iterator
+			it = endpoints_.find(peer_id);
+		if (it != endpoints_.end() && it->second->connected_)
+		{
+			_endpoint = it->second;
+			_endpoint->ref_++;
+		}
+		acl_pthread_mutex_unlock(&mutex_);
+
+		if (!_endpoint)
+			logger_debug(LOOPBACK_SECTION, 10,
+						 "peer not reachable.%s", peer_id.c_str());
+		return _endpoint;
+	}
+
+	void loopback_transport::release_endpoint(endpoint *_endpoint)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		if (--_endpoint->ref_ == 0)
+			acl_pthread_cond_broadcast(&cond_);
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	bool loopback_transport::vote(const std::string &peer_id,
+								  const vote_request &req,
+								  vote_response &resp)
+	{
+		endpoint *_endpoint = acquire_endpoint(peer_id);
+		if (!_endpoint)
+			return false;
+
+		bool rc = _endpoint->host_ ?
+			_endpoint->host_->handle_vote_request(req, resp) :
+			_endpoint->node_->handle_vote_request(req, resp);
+
+		release_endpoint(_endpoint);
+		return rc;
+	}
+
+	bool loopback_transport::replicate(
+		const std::string &peer_id,
+		const replicate_log_entries_request &req,
+		replicate_log_entries_response &resp)
+	{
+		endpoint *_endpoint = acquire_endpoint(peer_id);
+		if (!_endpoint)
+			return false;
+
+		bool rc = _endpoint->host_ ?
+			_endpoint->host_->handle_replicate_log_request(req, resp) :
+			_endpoint->node_->handle_replicate_log_request(req, resp);
+
+		release_endpoint(_endpoint);
+		return rc;
+	}
+
+	bool loopback_transport::install_snapshot(
+		const std::string &peer_id,
+		const install_snapshot_request &req,
+		install_snapshot_response &resp)
+	{
+		endpoint *_endpoint = acquire_endpoint(peer_id);
+		if (!_endpoint)
+			return false;
+
+		bool rc = _endpoint->host_ ?
+			_endpoint->host_->handle_install_snapshot_request(req, resp) :
+			_endpoint->node_->handle_install_snapshot_request(req, resp);
+
+		release_endpoint(_endpoint);
+		return rc;
+	}
+
+	bool loopback_transport::heartbeat(const std::string &peer_id,
+									   const heartbeat_request &req,
+									   heartbeat_response &resp)
+	{
+		endpoint *_endpoint = acquire_endpoint(peer_id);
+		if (!_endpoint)
+			return false;
+
+		bool rc = _endpoint->host_ ?
+			_endpoint->host_->handle_heartbeat_request(req, resp) :
+			_endpoint->node_->handle_heartbeat_request(req, resp);
+
+		release_endpoint(_endpoint);
+		return rc;
+	}
+
+	void loopback_transport::async_vote(const std::string &peer_id,
+										const vote_request &req,
+										vote_response &resp,
+										callback *_callback)
+	{
+		_callback->rpc_done(vote(peer_id, req, resp));
+	}
+
+	void loopback_transport::async_replicate(
+		const std::string &peer_id,
+		const replicate_log_entries_request &req,
+		replicate_log_entries_response &resp,
+		callback *_callback)
+	{
+		_callback->rpc_done(replicate(peer_id, req, resp));
+	}
+
+	void loopback_transport::async_replicate(
+		const std::string &peer_id,
+		const std::string &req,
+		replicate_log_entries_response &resp,
+		callback *_callback)
+	{
+		//handlers take messages
+		replicate_log_entries_request _req;
+		if (!_req.ParseFromString(req))
+		{
+			logger_error("parse replicate_log_entries_request error");
+			_callback->rpc_done(false);
+			return;
+		}
+		_callback->rpc_done(replicate(peer_id, _req, resp));
+	}
+
+	void loopback_transport::async_install_snapshot(
+		const std::string &peer_id,
+		const install_snapshot_request &req,
+		install_snapshot_response &resp,
+		callback *_callback)
+	{
+		_callback->rpc_done(install_snapshot(peer_id, req, resp));
+	}
+
+	void loopback_transport::async_heartbeat(const std::string &peer_id,
+											 const heartbeat_request &req,
+											 heartbeat_response &resp,
+											 callback *_callback)
+	{
+		_callback->rpc_done(heartbeat(peer_id, req, resp));
+	}
+}
@@ -2,451 +2,595 @@
 #include <cstdlib>
 #include "raft.hpp"
 
-#define __METADATA_EXT__ ".meta"
+#define __METADATA_FILE__ "metadata.slot"
+
+//old append only journal files
+#define __METADATA_JOURNAL_EXT__ ".meta"
 
 #ifndef __MAGIC_START__
 #define __MAGIC_START__ 123456789
-#endif // __MAGIC_START__ 
+#endif // __MAGIC_START__
 
 #ifndef __MAGIC_END__
 #define __MAGIC_END__ 987654321
 #endif // __MAGIC_END__
 
+//record types of journal
 #define APPLIED_INDEX	1
 #define COMMITTED_INDEX 2
 #define VOTE_FOR		3
 #define CURRENT_TERM	4
 #define PEER_INFO       5
 
-#define CURRENT_TERM_LEN    \
-(sizeof(int) * 2 + sizeof(term_t) + sizeof(char))
-
-#define COMMITTED_INDEX_LEN \
-(sizeof(int) * 2 + sizeof(log_index_t) + sizeof(char))
+//magic start of slot with crc32c
+#define __MAGIC_CHECKSUM__ 192837465
 
-#define APPLIED_INDEX_LEN	\
-(sizeof(int) * 2 + sizeof(log_index_t) + sizeof(char))
+//magic | len | crc32c
+#define SLOT_HEADER_LEN   (sizeof(int) * 3)
 
 #define METADATA_SECTION 102
 /*
-metafile format:
+metafile is made of two slots of page_size bytes.
+each slot holds the whole status:
+
+|__MAGIC_CHECKSUM__|uint32{len}|uint32{crc32c}|uint64{seq}|
+uint64{current_term}|uint64{vote_term}|uint64{committed_index}|
+uint64{applied_index}|string{vote_for}|uint32{peer count}|
+{string{peer_id}|string{addr}}...|
+
+len and crc32c are of data after the header.
+
+a write goes to the slot which is not the durable one,
+with seq + 1. term,vote_for and peer_infos are flushed
+to disk before return and the written slot becomes the
+durable one. committed/applied index overwrite the other
+slot in place until sync() or the next durable write.
+
+reload picks the valid slot with the biggest seq.
+a torn write breaks the crc32c and the older slot is used.
+
+old journal files({n}.meta) are migrated on the first reload:
 
-|__MAGIC_START__|char{value type}|value|char{id of value}|__MAGIC_START__|
+|__MAGIC_START__|char{value type}|value|__MAGIC_END__|
 
+or record with crc32c of {value type} and value:
 
+|__MAGIC_CHECKSUM__|uint32{len}|uint32{crc32c}|char{value type}|value|__MAGIC_END__|
+
+the newest journal is replayed,written to a slot and
+then the journal files are removed.
 */
 namespace raft
 {
 
-	metadata::metadata(size_t max_file_size)
+	metadata::metadata(size_t page_size)
 	{
 		current_term_    = 0;
 		committed_index_ = 0;
 		applied_index_   = 0;
-        vote_term_       = 0;
+		vote_term_       = 0;
+
+		seq_          = 0;
+		durable_slot_ = 1;
+		dirty_        = false;
 
-		write_pos_  = 0;
-		buf_        = 0;
-		file_index_ = 0;
+		buf_       = NULL;
+		page_size_ = page_size;
+	}
 
-		max_buffer_size_ = max_file_size;
+	metadata::~metadata ()
+	{
+		if(buf_)
+		{
+			sync();
+			close_mmap(buf_, page_size_ * 2);
+		}
 	}
-    metadata::~metadata ()
-    {
-        if(buf_)
-        {
-            close_mmap(buf_, max_buffer_size_);
-        }
-    }
+
 	bool metadata::reload(const std::string &path)
 	{
-        path_ = path;
+		file_path_ = path + __METADATA_FILE__;
+
+		if (!open(file_path_))
+		{
+			logger_error("open metadata file(%s) error",
+						 file_path_.c_str());
+			return false;
+		}
 
-        //list metadata files.
-		std::set<std::string> files
-                = list_dir(path, __METADATA_EXT__);
+		unsigned long long seq[2] = {0, 0};
+		bool valid[2];
 
-		if (files.empty())
+		valid[0] = check_slot(0, seq[0]);
+		valid[1] = check_slot(1, seq[1]);
+
+		if (!valid[0] && !valid[1])
 		{
-			acl::string file;
-			file_index_++;
-			file.format("%s%lu%s",
-				path.c_str(), 
-				file_index_, 
-				__METADATA_EXT__);
+			unsigned char *slot0 = slot_addr(0);
+			unsigned char *slot1 = slot_addr(1);
 
-			if (open(file.c_str(), true))
+			//new file
+			if (get_uint32(slot0) == 0 && get_uint32(slot1) == 0)
 			{
-				if(check_point())
-                {
-                    file_path_ = file;
-                    return true;
-                }
+				logger("create metadata file(%s)",
+					   file_path_.c_str());
+
+				//status of old journal goes to the first slot
+				if (!load_journal(path) || !write_slot(true))
+					return false;
+				remove_journal(path);
+				return true;
 			}
-			logger_error("create metadata file error");
+			logger_error("metadata broken.file(%s)",
+						 file_path_.c_str());
 			return false;
 		}
-        std::map<size_t, std::string> metafile;
 
-        for (std::set<std::string>::reverse_iterator it =files.rbegin();
-             it != files.rend(); ++it)
-        {
-            logger("--> %s", it->c_str());
-            std::string tmp = get_filename(*it);
-            metafile.insert(std::make_pair(atoll(tmp.c_str()), *it));
-        }
+		int slot = 0;
+		if (!valid[0] || (valid[1] && seq[1] > seq[0]))
+			slot = 1;
 
-		for (std::map<size_t, std::string>::reverse_iterator
-                     it = metafile.rbegin();it != metafile.rend();++it)
+		load_slot(slot);
+		seq_ = seq[slot];
+		durable_slot_ = slot;
+		dirty_ = false;
+
+		//the newest slot maybe a lazy write not on disk yet.
+		//flush it before the other slot takes writes.
+		if (!sync_mmap(slot_addr(slot), page_size_))
 		{
-			//reload the new metadata file.
-			//the new one in the files last one.
-			if (!open(it->second, false))
-			{
-				logger_error("open file error. "
-							 "file_path(%s)",
-							 it->second.c_str());
-				continue;
-			}
-			if (reload())
+			logger_error("sync metadata error");
+			return false;
+		}
+		logger("reload metadata ok.file(%s) slot(%d) seq(%llu)",
+			   file_path_.c_str(),
+			   slot,
+			   seq_);
+
+		//crash after migration before journal removed
+		remove_journal(path);
+		return true;
+	}
+
+	bool metadata::load_journal(const std::string &path)
+	{
+		std::set<std::string> files =
+			list_dir(path, __METADATA_JOURNAL_EXT__);
+
+		if (files.empty())
+			return true;
+
+		//the newest journal has the biggest file index
+		std::string file_path;
+		unsigned long long file_index = 0;
+
+		for (std::set<std::string>::iterator it = files.begin();
+			 it != files.end(); ++it)
+		{
+			unsigned long long index =
+				strtoull(get_filename(*it).c_str(), NULL, 10);
+			if (file_path.empty() || index > file_index)
 			{
-                file_index_ = it->first;
-                file_path_ = it->second;
-                logger("reload_file ok."
-                       "file_index(%lu) file_path(%s)",
-                       file_index_,
-                       it->second.c_str());
-				return true;
+				file_index = index;
+				file_path = *it;
 			}
 		}
-		return  true;
+
+		long long size = acl_file_size(file_path.c_str());
+		if (size <= 0)
+		{
+			logger("empty metadata journal(%s)", file_path.c_str());
+			return true;
+		}
+
+		ACL_FILE_HANDLE fd = acl_file_open(file_path.c_str(), O_RDWR, 0600);
+		if (fd == ACL_FILE_INVALID)
+		{
+			logger_error("open metadata journal(%s) error.%s",
+						 file_path.c_str(),
+						 acl::last_serror());
+			return false;
+		}
+
+		unsigned char *buf = static_cast<unsigned char *>(
+			open_mmap(fd, (size_t) size));
+		acl_file_close(fd);
+
+		if (!buf)
+		{
+			logger_error("mmap metadata journal(%s) error",
+						 file_path.c_str());
+			return false;
+		}
+
+		size_t count = replay_journal(buf, (size_t) size);
+		close_mmap(buf, (size_t) size);
+
+		logger("migrate metadata journal(%s) ok.record count(%lu)",
+			   file_path.c_str(),
+			   count);
+		return true;
 	}
-	bool metadata::reload()
+
+	size_t metadata::replay_journal(unsigned char *buf, size_t size)
 	{
-        size_t count = 0;
-        acl_assert(write_pos_ );
-
-		do
-		{
-			//check if reach end of file.
-            size_t diff = write_pos_ - buf_;
-			if (diff >= max_buffer_size_)
-            {
-                logger("read end of file.reload ok");
-                return true;
-            }
-
-			//if has not magic num. it has not data anymore.
-			if (get_uint32(write_pos_) != __MAGIC_START__)
-            {
-                //get_uint32 will move write_pos_ forward
-                //read failed. reset write_pos_ to the end
-                write_pos_ -= sizeof(__MAGIC_START__);
-                logger("reload ok. "
-                       "metadata entry count :%lu",
-                       count);
-                break;
-            }
-            count ++;
-
-            char ch = get_uint8(write_pos_);
-			switch (ch)
-			{
-			case COMMITTED_INDEX:
+		unsigned char *end = buf + size;
+		unsigned char *buffer = buf;
+		size_t count = 0;
+
+		//magic + type + the smallest value + __MAGIC_END__
+		while (end - buffer >= (long) (sizeof(int) * 2 + 1))
+		{
+			unsigned char *record = buffer;
+			unsigned int magic = get_uint32(buffer);
+			unsigned char *record_end = end;
+
+			if (magic == __MAGIC_CHECKSUM__)
 			{
-				if (load_committed_index())
-					continue;
-                logger_error("load_committed_index error");
-				return false;
+				if (end - buffer < (long) (sizeof(int) * 2))
+					break;
+
+				unsigned int len = get_uint32(buffer);
+				unsigned int crc = get_uint32(buffer);
+
+				//broken record.the records after it were dropped
+				//by the journal too
+				if (len == 0 ||
+					(size_t) (end - buffer) < len + sizeof(int) ||
+					crc32c(buffer, len) != crc)
+				{
+					logger_error("metadata journal broken at "
+								 "offset(%lu)",
+								 (unsigned long) (record - buf));
+					break;
+				}
+				record_end = buffer + len + sizeof(int);
 			}
-			case APPLIED_INDEX:
+			else if (magic != __MAGIC_START__)
 			{
-				if (load_applied_index())
-					continue;
-                logger_error("load_applied_index error");
-				return false;
+				//end of journal
+				break;
 			}
-			case VOTE_FOR:
+
+			if (!replay_record(buffer, record_end))
 			{
-				if (load_vote_for())
-					continue;
-                logger_error("load_vote_for error");
-				return false;
+				logger_error("metadata journal broken at "
+							 "offset(%lu)",
+							 (unsigned long) (record - buf));
+				break;
 			}
-			case CURRENT_TERM:
-			{
-				if (load_current_term())
-					continue;
-                logger_error("load_current_term error");
+			count++;
+		}
+		return count;
+	}
+
+	bool metadata::replay_record(unsigned char *&buffer, unsigned char *end)
+	{
+		unsigned char type = get_uint8(buffer);
+
+		switch (type)
+		{
+		case COMMITTED_INDEX:
+		case APPLIED_INDEX:
+		case CURRENT_TERM:
+		{
+			if (end - buffer < (long) (sizeof(long long) + sizeof(int)))
 				return false;
-			}case PEER_INFO:
-            {
-                if(load_peer_info())
-                    continue;
-                logger_error("load_peer_info error");
-                return false;
-            }
-			default:
-				break;
+
+			unsigned long long value = get_uint64(buffer);
+			if (type == COMMITTED_INDEX)
+				committed_index_ = value;
+			else if (type == APPLIED_INDEX)
+				applied_index_ = value;
+			else
+				current_term_ = value;
+			break;
+		}
+		case VOTE_FOR:
+		{
+			if (end - buffer < (long) (sizeof(long long) + sizeof(int)))
+				return false;
+
+			term_t term = get_uint64(buffer);
+			if (!check_string(buffer, end))
+				return false;
+
+			vote_for_ = get_string(buffer);
+			vote_term_ = term;
+			break;
+		}
+		case PEER_INFO:
+		{
+			if (end - buffer < (long) sizeof(int))
+				return false;
+
+			std::vector<peer_info> infos;
+			unsigned int size = get_uint32(buffer);
+			for (unsigned int i = 0; i < size; ++i)
+			{
+				peer_info info;
+				if (!check_string(buffer, end))
+					return false;
+				info.peer_id_ = get_string(buffer);
+				if (!check_string(buffer, end))
+					return false;
+				info.addr_ = get_string(buffer);
+				infos.push_back(info);
 			}
-		} while (true);
-        return true;
+			peer_infos_ = infos;
+			break;
+		}
+		default:
+			return false;
+		}
+
+		if (end - buffer < (long) sizeof(int))
+			return false;
+		return get_uint32(buffer) == __MAGIC_END__;
 	}
 
+	bool metadata::check_string(unsigned char *buffer, unsigned char *end)
+	{
+		if (end - buffer < (long) sizeof(int))
+			return false;
+
+		size_t len = get_uint32(buffer);
+		return (size_t) (end - buffer) >= len;
+	}
 
-    void metadata::print_status()
-    {
-
-        acl::string buffer;
-        for(size_t i = 0; i < peer_infos_.size(); i++)
-        {
-            buffer.format_append("---> [peer_id_(%s)  peer_addr_(%s)]\n",
-                                 peer_infos_[i].peer_id_.c_str(),
-                                 peer_infos_[i].addr_.c_str());
-        }
-
-        logger("\n"
-               "---> current_term_(%llu) \n"
-               "---> applied_index_(%llu) \n"
-               "---> committed_index_(%llu) \n"
-               "---> vote_for_(%s) \n"
-               "---> vote_term_(%llu) \n"
-               "%s",
-               current_term_,
-               applied_index_,
-               committed_index_,
-               vote_for_.c_str(),
-               vote_term_,
-               buffer.c_str());
-
-    }
-
-	bool metadata::load_committed_index()
+	void metadata::remove_journal(const std::string &path)
 	{
-		committed_index_ = get_uint64(write_pos_);
-		if (get_uint32(write_pos_) != __MAGIC_END__)
+		std::set<std::string> files =
+			list_dir(path, __METADATA_JOURNAL_EXT__);
+
+		for (std::set<std::string>::iterator it = files.begin();
+			 it != files.end(); ++it)
 		{
-			logger_error("metadata broken!!!");
-			return false;
+			if (remove(it->c_str()) != 0)
+			{
+				logger_error("remove metadata journal(%s) error.%s",
+							 it->c_str(),
+							 acl::last_serror());
+			}
 		}
-		return true;
 	}
 
-    bool metadata::load_applied_index()
+	void metadata::print_status()
 	{
-		applied_index_ = get_uint64(write_pos_);
-		if (get_uint32(write_pos_) != __MAGIC_END__)
+
+		acl::string buffer;
+		for(size_t i = 0; i < peer_infos_.size(); i++)
 		{
-			logger_error("metadata broken!!!");
-			return false;
+			buffer.format_append("---> [peer_id_(%s)  peer_addr_(%s)]\n",
+								 peer_infos_[i].peer_id_.c_str(),
+								 peer_infos_[i].addr_.c_str());
 		}
-		return true;
+
+		logger("\n"
+			   "---> current_term_(%llu) \n"
+			   "---> applied_index_(%llu) \n"
+			   "---> committed_index_(%llu) \n"
+			   "---> vote_for_(%s) \n"
+			   "---> vote_term_(%llu) \n"
+			   "%s",
+			   current_term_.load(),
+			   applied_index_.load(),
+			   committed_index_.load(),
+			   vote_for_.c_str(),
+			   vote_term_,
+			   buffer.c_str());
+
+	}
+
+	unsigned char *metadata::slot_addr(int slot)
+	{
+		return buf_ + page_size_ * slot;
 	}
 
-	bool metadata::load_current_term()
+	bool metadata::check_slot(int slot, unsigned long long &seq)
 	{
-		current_term_ = get_uint64(write_pos_);
-		if (get_uint32(write_pos_) != __MAGIC_END__)
+		unsigned char *buffer = slot_addr(slot);
+
+		if (get_uint32(buffer) != __MAGIC_CHECKSUM__)
+			return false;
+
+		unsigned int len = get_uint32(buffer);
+		unsigned int crc = get_uint32(buffer);
+
+		if (len < sizeof(seq) || len > page_size_ - SLOT_HEADER_LEN)
+			return false;
+
+		if (crc32c(buffer, len) != crc)
 		{
-			logger_error("metadata broken!!!");
+			logger_error("slot(%d) of metadata crc32c error", slot);
 			return false;
 		}
+		seq = get_uint64(buffer);
 		return true;
 	}
 
-    bool metadata::load_peer_info()
-    {
-        std::vector<peer_info> infos;
-        unsigned int size = get_uint32(write_pos_);
-        for (unsigned int i = 0; i < size; ++i)
-        {
-            peer_info info;
-            info.peer_id_ = get_string(write_pos_);
-            info.addr_    = get_string(write_pos_);
-            infos.push_back(info);
-        }
-        if (get_uint32(write_pos_) != __MAGIC_END__)
-        {
-            logger_error("metadata broken!!!");
-            return false;
-        }
-        peer_infos_ = infos;
-        return true;
-    }
-
-	bool metadata::load_vote_for()
+	void metadata::load_slot(int slot)
+	{
+		//skip header and seq
+		unsigned char *buffer = slot_addr(slot) + SLOT_HEADER_LEN;
+		get_uint64(buffer);
+
+		current_term_    = get_uint64(buffer);
+		vote_term_       = get_uint64(buffer);
+		committed_index_ = get_uint64(buffer);
+		applied_index_   = get_uint64(buffer);
+		vote_for_        = get_string(buffer);
+
+		std::vector<peer_info> infos;
+		unsigned int size = get_uint32(buffer);
+		for (unsigned int i = 0; i < size; ++i)
+		{
+			peer_info info;
+			info.peer_id_ = get_string(buffer);
+			info.addr_    = get_string(buffer);
+			infos.push_back(info);
+		}
+		peer_infos_ = infos;
+	}
+
+	bool metadata::write_slot(bool durable)
 	{
-		vote_term_ = get_uint64(write_pos_);
-		vote_for_ = get_string(write_pos_);
-		if (get_uint32(write_pos_) != __MAGIC_END__)
+		if (buf_ == NULL)
 		{
-			logger_error("metadata broken!!!");
+			logger_error("metadata not open");
 			return false;
 		}
+
+		size_t len = sizeof(unsigned long long) * 5 +
+			sizeof(unsigned int) + vote_for_.size() +
+			sizeof(unsigned int);
+
+		for (size_t i = 0; i < peer_infos_.size(); ++i)
+		{
+			len += sizeof(unsigned int) + peer_infos_[i].peer_id_.size();
+			len += sizeof(unsigned int) + peer_infos_[i].addr_.size();
+		}
+
+		if (len > page_size_ - SLOT_HEADER_LEN)
+		{
+			logger_error("metadata too big(%lu) for page_size(%lu)",
+						 len,
+						 page_size_);
+			return false;
+		}
+
+		int slot = 1 - durable_slot_;
+		unsigned char *header = slot_addr(slot);
+		unsigned char *data = header + SLOT_HEADER_LEN;
+		unsigned char *buffer = data;
+
+		put_uint64(buffer, seq_ + 1);
+		put_uint64(buffer, current_term_);
+		put_uint64(buffer, vote_term_);
+		put_uint64(buffer, committed_index_);
+		put_uint64(buffer, applied_index_);
+		put_string(buffer, vote_for_);
+		put_uint32(buffer, (unsigned int) peer_infos_.size());
+		for (size_t j = 0; j < peer_infos_.size(); ++j)
+		{
+			put_string(buffer, peer_infos_[j].peer_id_);
+			put_string(buffer, peer_infos_[j].addr_);
+		}
+		acl_assert(buffer - data == (long) len);
+
+		put_uint32(header, __MAGIC_CHECKSUM__);
+		put_uint32(header, static_cast<unsigned int>(len));
+		put_uint32(header, crc32c(data, len));
+		seq_++;
+
+		if (!durable)
+		{
+			dirty_ = true;
+			return true;
+		}
+
+		if (!sync_mmap(slot_addr(slot), page_size_))
+		{
+			logger_error("sync metadata error");
+			return false;
+		}
+		durable_slot_ = slot;
+		dirty_ = false;
 		return true;
 	}
 
-    bool metadata::create_new_file ()
-    {
-        acl::string file_path;
-
-        file_index_ ++;
-        file_path.format("%s%lu%s",
-                         path_.c_str(),
-                         file_index_,
-                         __METADATA_EXT__);
-
-        //close the old file mmap
-        close_mmap(buf_, max_buffer_size_);
-        buf_ = write_pos_ = NULL;
-
-        if(!open(file_path.c_str(), true))
-        {
-            logger_error("create file error. "
-                         "file_path:%s."
-                         " error:%s",
-                         file_path.c_str(),
-                         acl::last_serror());
-            return false;
-        }
-        //write current status to new file;
-        if(!check_point())
-        {
-            logger_fatal("check_point failed");
-            return false;
-        }
-
-        //delete old file from disk
-        if(remove(file_path_.c_str()) != 0)
-        {
-            logger_error("remove old metadata file(%s) error.%s",
-                         file_path_.c_str(),
-                         acl::last_serror());
-        }
-        file_path_ = file_path;
-
-        return true;
-    }
-
-	bool metadata::check_remain_buffer(size_t size)
+	bool metadata::sync()
 	{
-        if(write_pos_ == NULL)
-        {
-            logger_error("metadata not open");
-            return false;
-        }
-
-        //end of file
-        if((write_pos_ - buf_) == max_buffer_size_ )
-            return false;
-
-        size_t diff = write_pos_ - buf_;
-         acl_assert(diff < max_buffer_size_);
-
-        size_t remain = max_buffer_size_ -(write_pos_ - buf_);
-
-        /**
-         * 4 bytes(sizeof(int)) length buffer for reading
-         * next __MAGIC_START__.entry in file begin with
-         * __MAGIC_START__
-         * when metadata reload file and the data full
-         * of the file. read next __MAGIC_START__ will
-         * over fo mmap.it will crash
-         */
-        if(remain > size + sizeof(int))
-            return true;
-
-        return create_new_file();
+		acl::lock_guard lg(locker_);
+		if (!dirty_)
+			return true;
+
+		int slot = 1 - durable_slot_;
+		if (!sync_mmap(slot_addr(slot), page_size_))
+		{
+			logger_error("sync metadata error");
+			return false;
+		}
+		durable_slot_ = slot;
+		dirty_ = false;
+		return true;
 	}
 
 	bool metadata::set_committed_index(log_index_t index)
 	{
 		acl::lock_guard lg(locker_);
-		if (!check_remain_buffer(COMMITTED_INDEX_LEN))
+		log_index_t old = committed_index_;
+
+		committed_index_ = index;
+		if (!write_slot(false))
 		{
+			committed_index_ = old;
 			logger_error("write metadata error");
 			return false;
 		}
-			
-		put_uint32(write_pos_, __MAGIC_START__);
-		put_uint8(write_pos_, COMMITTED_INDEX);
-		put_uint64(write_pos_, index);
-		put_uint32(write_pos_, __MAGIC_END__);
-		committed_index_ = index;
 		return true;
 	}
 
 	log_index_t metadata::get_committed_index()
 	{
-		acl::lock_guard lg(locker_);
-		return committed_index_;
+		return committed_index_.load(std::memory_order_acquire);
 	}
 
 	bool metadata::set_applied_index(log_index_t index)
 	{
 		acl::lock_guard lg(locker_);
-		if (!check_remain_buffer(APPLIED_INDEX_LEN))
+		log_index_t old = applied_index_;
+
+		applied_index_ = index;
+		if (!write_slot(false))
 		{
-            logger_error("write metadata error");
+			applied_index_ = old;
+			logger_error("write metadata error");
 			return false;
 		}
-
-		put_uint32(write_pos_, __MAGIC_START__);
-		put_uint8(write_pos_, APPLIED_INDEX);
-		put_uint64(write_pos_, index);
-		put_uint32(write_pos_, __MAGIC_END__);
-		applied_index_ = index;
 		return true;
 	}
 
 	log_index_t metadata::get_applied_index()
 	{
-		acl::lock_guard lg(locker_);
-		return applied_index_;
+		return applied_index_.load(std::memory_order_acquire);
 	}
 
 	bool metadata::set_current_term(term_t term)
 	{
 		acl::lock_guard lg(locker_);
-		if (!check_remain_buffer(CURRENT_TERM_LEN))
+		term_t old = current_term_;
+
+		current_term_ = term;
+		if (!write_slot(true))
 		{
-            logger_error("write metadata error");
+			current_term_ = old;
+			logger_error("write metadata error");
 			return false;
 		}
-
-		put_uint32(write_pos_, __MAGIC_START__);
-		put_uint8(write_pos_, CURRENT_TERM);
-		put_uint64(write_pos_, term);
-		put_uint32(write_pos_, __MAGIC_END__);
-		current_term_ = term;
 		return true;
 	}
 
 	term_t metadata::get_current_term()
 	{
-		acl::lock_guard lg(locker_);
-		return current_term_;
+		return current_term_.load(std::memory_order_acquire);
 	}
 
 	bool metadata::set_vote_for(const std::string &id, term_t term)
 	{
 		acl::lock_guard lg(locker_);
+		std::string old_vote_for = vote_for_;
+		term_t old_vote_term = vote_term_;
 
-		size_t len = APPLIED_INDEX_LEN + sizeof(int) + id.size();
-		if (!check_remain_buffer(len))
+		vote_for_ = id;
+		vote_term_ = term;
+		if (!write_slot(true))
 		{
-            logger_error("write metadata error");
+			vote_for_ = old_vote_for;
+			vote_term_ = old_vote_term;
+			logger_error("write metadata error");
 			return false;
 		}
-
-		put_uint32(write_pos_, __MAGIC_START__);
-		put_uint8(write_pos_, VOTE_FOR);
-		put_uint64(write_pos_, term);
-		put_string(write_pos_, id);
-		put_uint32(write_pos_, __MAGIC_END__);
-		vote_for_ = id;
-		vote_term_ = term;
-
 		return true;
 	}
 
@@ -456,96 +600,71 @@ namespace raft
 		return std::make_pair(vote_term_, vote_for_);
 	}
 
-    bool metadata::set_peer_infos(const std::vector<peer_info> &infos)
-    {
-        acl::lock_guard lg(locker_);
-
-        size_t len = sizeof(int);
-
-        for (size_t i = 0; i < infos.size(); ++i)
-        {
-            len += sizeof(unsigned int);
-            len += infos[i].addr_.size();
-
-            len += sizeof(unsigned int);
-            len += infos[i].peer_id_.size();
-        }
-
-        len += sizeof(unsigned int) * 2 + sizeof(char);
-
-        if (!check_remain_buffer(len))
-        {
-            logger_error("write metadata error");
-            return false;
-        }
-
-        put_uint32(write_pos_, __MAGIC_START__);
-        put_uint8(write_pos_, PEER_INFO);
-        //write vector size
-        put_uint32(write_pos_, (unsigned int) infos.size());
-        //write peer_info entry
-        for (size_t j = 0; j < infos.size(); ++j)
-        {
-            put_string(write_pos_, infos[j].peer_id_);
-            put_string(write_pos_, infos[j].addr_);
-        }
-        put_uint32(write_pos_, __MAGIC_END__);
-        peer_infos_ = infos;
-        return true;
-    }
-
-    std::vector<peer_info> metadata::get_peer_info()
-    {
-        acl::lock_guard lg(locker_);
-        return peer_infos_;
-    }
-
-	bool metadata::open(const std::string &file_path, bool create)
+	bool metadata::set_peer_infos(const std::vector<peer_info> &infos)
+	{
+		acl::lock_guard lg(locker_);
+		std::vector<peer_info> old = peer_infos_;
+
+		peer_infos_ = infos;
+		if (!write_slot(true))
+		{
+			peer_infos_ = old;
+			logger_error("write metadata error");
+			return false;
+		}
+		return true;
+	}
+
+	std::vector<peer_info> metadata::get_peer_info()
+	{
+		acl::lock_guard lg(locker_);
+		return peer_infos_;
+	}
+
+	bool metadata::open(const std::string &file_path)
 	{
 		long long size = acl_file_size(file_path.c_str());
+
 		//file not exist
-		if (size == -1 )
+		if (size == -1)
 		{
 			logger_debug(METADATA_SECTION, 10,
-                         "open file(%s) "
-                         "failed:%s",
-                         file_path.c_str(),
-                         acl::last_serror());
-
-			if (!create)
-				return false;
+						 "open file(%s) "
+						 "failed:%s",
+						 file_path.c_str(),
+						 acl::last_serror());
+		}
+		else if (size != (long long) page_size_ * 2)
+		{
+			//keep the page size the file created with
+			page_size_ = (size_t) size / 2;
+			logger("metadata page_size(%lu)", page_size_);
+		}
 
-			//default max size of metadata file
-			size = (long long int) max_buffer_size_;
+		if (page_size_ <= SLOT_HEADER_LEN)
+		{
+			logger_error("metadata page_size(%lu) too small",
+						 page_size_);
+			return false;
 		}
 
-		ACL_FILE_HANDLE fd = acl_file_open( 
-			file_path.c_str(), O_RDWR | O_CREAT,0600);
+		ACL_FILE_HANDLE fd = acl_file_open(
+			file_path.c_str(), O_RDWR | O_CREAT, 0600);
 
 		if (fd == ACL_FILE_INVALID)
 		{
-            logger("create new file(%s) failed:%s",
-                   file_path.c_str(),
-                   acl::last_serror());
+			logger("create new file(%s) failed:%s",
+				   file_path.c_str(),
+				   acl::last_serror());
 			return false;
 		}
 
-		//open mmap
-		write_pos_ = buf_ = 
-			static_cast<unsigned char *>(open_mmap(fd, size));
-		
+		buf_ = static_cast<unsigned char *>(
+			open_mmap(fd, page_size_ * 2));
+
 		//close fd.we don't need anymore
 		acl_file_close(fd);
 
 		return buf_ != NULL;
 	}
-
-	bool metadata::check_point()
-	{
-		return 
-			set_applied_index(applied_index_) && 
-			set_committed_index(committed_index_) && 
-			set_current_term(current_term_) && 
-			set_vote_for(vote_for_, vote_term_);
-	}
-}
\ No newline at end of file
+}
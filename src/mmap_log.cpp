@@ -1,6 +1,19 @@
 #include "raft.hpp"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
 #define __MAGIC_START__ 123456789
 #define __MAGIC_END__   987654321
+//magic of e_format_binary entry.little endian
+#define __MAGIC_BINARY__ 135797531
+//magic,index,term,type,len,crc32c
+#define __BINARY_HEADER_SIZE__ 32
+//offset of crc32c in header
+#define __BINARY_CRC_OFFSET__ 28
+//footer of sealed log in the end of index file.little endian
+//magic | start_index | start_term | last_index | last_term |
+//data offset | index offset | crc32c
+#define __MAGIC_FOOTER__ 246813579
+#define __FOOTER_SIZE__ (sizeof(int) * 2 + sizeof(long long) * 6)
 #define __64k__			(64*1024)
 
 #ifndef __INDEX__EXT__
@@ -11,7 +24,13 @@
 namespace raft
 {
 
-    mmap_log::mmap_log(log_index_t last_index, size_t file_size)
+    mmap_log::mmap_log(log_index_t last_index,
+                       size_t file_size,
+                       format_t format)
+        :format_(format),
+         verify_(e_verify_reload),
+         sample_rate_(0),
+         read_count_(0)
     {
         data_buf_size_ = 0;
         index_buf_size_ = 0;
@@ -20,12 +39,15 @@ namespace raft
             data_buf_size_ += __64k__;
 
         index_buf_size_ = max_index_size(data_buf_size_);
+        data_sync_offset_ = 0;
+        index_sync_offset_ = 0;
 
         last_index_ = last_index;
         start_index_ = 0;
         last_term_ = 0;
         start_term_ = 0;
         eof_ = false;
+        footer_dirty_ = false;
         is_open_ = false;
     }
 
@@ -139,6 +161,9 @@ namespace raft
                 return false;
             }
         }
+        //data reload from disk is synced already
+        data_sync_offset_ = data_wbuf_ - data_buf_;
+        index_sync_offset_ = index_wbuf_ - index_buf_;
         is_open_ = true;
         return true;
     }
@@ -186,16 +211,7 @@ namespace raft
         //set log index to it
         entry2.set_index(index);
         //entry size
-        size_t len = entry2.ByteSizeLong();
-
-        //for store the entry size
-        len += sizeof(int);
-
-        //for __MAGIC_START__
-        len += sizeof(int);
-
-        //__MAGIC_END__
-        len += sizeof(int);
+        size_t len = entry_size(entry2);
 
         //remain for reload check __MAGIC_START__
         //if write to end of file
@@ -203,18 +219,18 @@ namespace raft
         //it will crash!!!!
         len += sizeof(int);
 
-        //check remain buffer ok
-        if (remain_len < len)
+        //check remain buffer ok.
+        //index may be full before data with small entries
+        if (remain_len < len || !index_remain())
         {
             logger("mmap_log eof");
             eof_ = true;
+            write_footer();
             //write failed. return 0
             return 0;
         }
 
-        put_uint32(data_wbuf_, __MAGIC_START__);
-        put_message(data_wbuf_, entry2);
-        put_uint32(data_wbuf_, __MAGIC_END__);
+        put_entry(data_wbuf_, entry2);
 
         put_uint32(index_wbuf_, __MAGIC_START__);
         put_uint64(index_wbuf_, index);
@@ -238,8 +254,181 @@ namespace raft
         return index;
     }
 
+    size_t mmap_log::write_batch(const std::vector<log_entry> &entries,
+                                 size_t begin)
+    {
+        acl::lock_guard lg(write_locker_);
+
+        size_t offset = data_wbuf_ - data_buf_;
+        acl_assert(offset < data_buf_size_);
+        size_t remain_len = data_buf_size_ - offset;
+
+        //remain for reload check __MAGIC_START__
+        size_t total = sizeof(int);
+        log_index_t index = last_index_;
+        size_t count = 0;
+        size_t max_count = index_remain();
+
+        //reserve buffer for entries as many as possible
+        for (size_t i = begin; i < entries.size() && count < max_count; i++)
+        {
+            log_entry &entry = const_cast<log_entry &>(entries[i]);
+            entry.set_index(++index);
+
+            size_t len = entry_size(entry);
+            if (total + len > remain_len)
+                break;
+            total += len;
+            count++;
+        }
+
+        if (!count)
+        {
+            logger("mmap_log eof");
+            eof_ = true;
+            write_footer();
+            return 0;
+        }
+
+        //encode entries back to back
+        for (size_t i = 0; i < count; i++)
+        {
+            const log_entry &entry = entries[begin + i];
+
+            offset = data_wbuf_ - data_buf_;
+
+            put_entry(data_wbuf_, entry);
+
+            put_uint32(index_wbuf_, __MAGIC_START__);
+            put_uint64(index_wbuf_, entry.index());
+            put_uint32(index_wbuf_, static_cast<unsigned int>(offset));
+            put_uint32(index_wbuf_, __MAGIC_END__);
+        }
+
+        const log_entry &last = entries[begin + count - 1];
+        last_index_ = last.index();
+        last_term_ = last.term();
+
+        if (start_index_ == 0)
+            start_index_ = entries[begin].index();
+        if (start_term_ == 0)
+            start_term_ = entries[begin].term();
+
+        return count;
+    }
+
+    bool mmap_log::sync()
+    {
+        acl::lock_guard sync_lg(sync_locker_);
+
+        write_locker_.lock();
+        size_t data_offset = data_wbuf_ - data_buf_;
+        size_t index_offset = index_wbuf_ - index_buf_;
+        bool footer_dirty = footer_dirty_;
+        footer_dirty_ = false;
+        write_locker_.unlock();
+
+        //nothing to sync
+        if (data_offset <= data_sync_offset_ &&
+            index_offset <= index_sync_offset_ &&
+            !footer_dirty)
+            return true;
+
+        /**
+         * flush without write_locker_,writers can go on
+         * appending entries behind the flushed range.
+         */
+        bool rc = false;
+
+        if (data_offset > data_sync_offset_ &&
+            !sync_mmap(data_buf_ + data_sync_offset_,
+                       data_offset - data_sync_offset_))
+        {
+            logger_error("sync data error.%s", data_filepath_.c_str());
+        }
+        else if (index_offset > index_sync_offset_ &&
+                 !sync_mmap(index_buf_ + index_sync_offset_,
+                            index_offset - index_sync_offset_))
+        {
+            logger_error("sync index error.%s", index_filepath_.c_str());
+        }
+        //footer after entries it describe
+        else if (footer_dirty &&
+                 !sync_mmap(index_buf_ + index_buf_size_ - __FOOTER_SIZE__,
+                            __FOOTER_SIZE__))
+        {
+            data_sync_offset_ = data_offset;
+            index_sync_offset_ = index_offset;
+            logger_error("sync footer error.%s", index_filepath_.c_str());
+        }
+        else
+        {
+            data_sync_offset_ = data_offset;
+            index_sync_offset_ = index_offset;
+            rc = true;
+        }
+
+        if (!rc && footer_dirty)
+        {
+            write_locker_.lock();
+            footer_dirty_ = true;
+            write_locker_.unlock();
+        }
+        return rc;
+    }
+
+    bool mmap_log::reset(const std::string &file_path,
+                         log_index_t last_index)
+    {
+        acl::lock_guard lg(write_locker_);
+
+        if (!is_open_ || data_wbuf_ != data_buf_)
+        {
+            logger_error("log not empty.%s", data_filepath_.c_str());
+            return false;
+        }
+
+        std::string index_filepath = file_path + __INDEX__EXT__;
+
+        if (::rename(data_filepath_.c_str(), file_path.c_str()) != 0)
+        {
+            logger_error("rename %s to %s error.%s",
+                         data_filepath_.c_str(),
+                         file_path.c_str(),
+                         acl::last_serror());
+            return false;
+        }
+        data_filepath_ = file_path;
+
+        if (::rename(index_filepath_.c_str(), index_filepath.c_str()) != 0)
+        {
+            logger_error("rename %s to %s error.%s",
+                         index_filepath_.c_str(),
+                         index_filepath.c_str(),
+                         acl::last_serror());
+            return false;
+        }
+        index_filepath_ = index_filepath;
+
+        last_index_ = last_index;
+        start_index_ = 0;
+        last_term_ = 0;
+        start_term_ = 0;
+        eof_ = false;
+        return true;
+    }
+
+    void mmap_log::prefault()
+    {
+        acl::lock_guard lg(write_locker_);
+
+        prefault_mmap(data_buf_, data_buf_size_);
+        prefault_mmap(index_buf_, index_buf_size_);
+    }
+
     bool mmap_log::truncate(log_index_t index)
     {
+        acl::lock_guard sync_lg(sync_locker_);
         acl::lock_guard lg(write_locker_);
 
         if (!is_open_)
@@ -278,13 +467,24 @@ namespace raft
         //write 0 to truncate
         put_uint32(buffer, 0);
 
+        //not sealed any more
+        clear_footer();
+
         last_index_ = index - 1;
 
         //update index
         if (start_index_ < last_index_)
             start_index_ = last_index_;
 
-        return set_data_wbuf(last_index_);
+        if (!set_data_wbuf(last_index_))
+            return false;
+
+        //entries after truncate point must be synced again
+        if (data_sync_offset_ > (size_t)(data_wbuf_ - data_buf_))
+            data_sync_offset_ = data_wbuf_ - data_buf_;
+        if (index_sync_offset_ > (size_t)(index_wbuf_ - index_buf_))
+            index_sync_offset_ = index_wbuf_ - index_buf_;
+        return true;
     }
 
     bool mmap_log::read(log_index_t index,
@@ -352,6 +552,64 @@ namespace raft
         return entries.size() != 0;
     }
 
+    bool mmap_log::read(log_index_t index,
+                        int max_bytes,
+                        int max_count,
+                        std::vector<log_entry_view> &views,
+                        int &bytes)
+    {
+        if (max_bytes <= 0 || max_count <= 0)
+        {
+            logger_error("param error");
+            return false;
+        }
+
+        if (index < start_index() || index > last_index())
+        {
+            logger_error("index error,%llu", index);
+            return false;
+        }
+
+        unsigned char *buffer = get_data_buffer(index);
+        if (!buffer)
+        {
+            logger("last_index(%llu) index(%llu) error",
+                   last_index(),
+                   index);
+            return false;
+        }
+
+        size_t count = views.size();
+        while (true)
+        {
+            size_t remain = data_buf_size_ - (buffer - data_buf_);
+
+            //reach the of file
+            if (remain < sizeof(unsigned int))
+                break;
+
+            log_entry_view view;
+            if (!get_entry_view(buffer, view))
+                break;
+
+            //views hold ref of this log
+            view.set_log(this);
+            views.push_back(view);
+
+            bytes += static_cast<int>(view.len_);
+
+            max_bytes -= static_cast<int>(view.len_);
+            --max_count;
+
+            if (max_bytes <= 0 || max_count <= 0)
+                break;
+            //read the last one
+            if (view.index_ == last_index())
+                break;
+        }
+        return views.size() != count;
+    }
+
     bool mmap_log::read(log_index_t index, log_entry &entry)
     {
         if (!is_open_)
@@ -393,8 +651,127 @@ namespace raft
         return start_index_;
     }
 
+    size_t mmap_log::entry_size(const log_entry &entry) const
+    {
+        if (format_ == e_format_binary)
+            return __BINARY_HEADER_SIZE__ + entry.log_data().size();
+
+        //__MAGIC_START__,entry size,entry,__MAGIC_END__
+        return entry.ByteSizeLong() + sizeof(int) * 3;
+    }
+
+    /*
+     * entry_size() must be invoked before,for e_format_protobuf
+     * use the cached size of entry.
+     */
+    void mmap_log::put_entry(unsigned char *&buffer,
+                             const log_entry &entry) const
+    {
+        if (format_ == e_format_binary)
+        {
+            const std::string &data = entry.log_data();
+            const unsigned char *record = buffer;
+
+            put_le_uint32(buffer, __MAGIC_BINARY__);
+            put_le_uint64(buffer, entry.index());
+            put_le_uint64(buffer, entry.term());
+            put_le_uint32(buffer, static_cast<unsigned int>(entry.type()));
+            put_le_uint32(buffer, static_cast<unsigned int>(data.size()));
+
+            //crc32c of the header fields before it and log data
+            unsigned int crc = crc32c(record + sizeof(int),
+                                      __BINARY_CRC_OFFSET__ - sizeof(int));
+            crc = crc32c(data.data(), data.size(), crc);
+            put_le_uint32(buffer, crc);
+
+            memcpy(buffer, data.data(), data.size());
+            buffer += data.size();
+            return;
+        }
+
+        put_uint32(buffer, __MAGIC_START__);
+        put_message(buffer, entry, entry.GetCachedSize());
+        put_uint32(buffer, __MAGIC_END__);
+    }
+
+    /*
+     * binary entry must end in the mapping.broken length
+     * return false,never read past it.
+     */
+    bool mmap_log::check_len(const unsigned char *record)
+    {
+        size_t remain = data_buf_size_ - (record - data_buf_);
+
+        if (remain < __BINARY_HEADER_SIZE__)
+            return false;
+
+        unsigned char *header = (unsigned char *)record +
+            __BINARY_CRC_OFFSET__ - sizeof(int);
+
+        return get_le_uint32(header) <= remain - __BINARY_HEADER_SIZE__;
+    }
+
+    bool mmap_log::check_crc(const unsigned char *record)
+    {
+        if (!check_len(record))
+            return false;
+
+        unsigned char *header = (unsigned char *)record +
+            __BINARY_CRC_OFFSET__ - sizeof(int);
+
+        unsigned int len = get_le_uint32(header);
+        unsigned int crc = crc32c(record + sizeof(int),
+                                  __BINARY_CRC_OFFSET__ - sizeof(int));
+        crc = crc32c(record + __BINARY_HEADER_SIZE__, len, crc);
+
+        return get_le_uint32(header) == crc;
+    }
+
+    bool mmap_log::verify_read()
+    {
+        if (verify_ == e_verify_always)
+            return true;
+        if (verify_ == e_verify_sampled && sample_rate_)
+            return ++read_count_ % sample_rate_ == 0;
+        return false;
+    }
+
+    void mmap_log::set_verify(verify_t verify, unsigned int sample_rate)
+    {
+        verify_ = verify;
+        sample_rate_ = sample_rate;
+    }
+
     bool mmap_log::get_entry(unsigned char *& buffer, log_entry &entry)
     {
+        unsigned char *header = buffer;
+
+        if (get_le_uint32(header) == __MAGIC_BINARY__)
+        {
+            if (!check_len(buffer))
+            {
+                logger_error("log entry length error.%s",
+                             data_filepath_.c_str());
+                return false;
+            }
+            if (verify_read() && !check_crc(buffer))
+            {
+                logger_error("log entry crc32c error.%s",
+                             data_filepath_.c_str());
+                return false;
+            }
+            entry.set_index(get_le_uint64(header));
+            entry.set_term(get_le_uint64(header));
+            entry.set_type(static_cast<log_entry_type>(
+                get_le_uint32(header)));
+            unsigned int len = get_le_uint32(header);
+            //checksum
+            get_le_uint32(header);
+            entry.set_log_data((const char*)header, len);
+            buffer = header + len;
+            return true;
+        }
+
         if (get_uint32(buffer) != __MAGIC_START__)
             return false;
 
@@ -412,6 +789,96 @@ namespace raft
         return true;
     }
 
+    bool mmap_log::get_entry_view(unsigned char *&buffer,
+                                  log_entry_view &view)
+    {
+        typedef google::protobuf::io::CodedInputStream input_t;
+        typedef google::protobuf::internal::WireFormatLite wire_format_t;
+
+        unsigned char *header = buffer;
+
+        if (get_le_uint32(header) == __MAGIC_BINARY__)
+        {
+            if (!check_len(buffer))
+            {
+                logger_error("log entry length error.%s",
+                             data_filepath_.c_str());
+                return false;
+            }
+            if (verify_read() && !check_crc(buffer))
+            {
+                logger_error("log entry crc32c error.%s",
+                             data_filepath_.c_str());
+                return false;
+            }
+            view.index_ = get_le_uint64(header);
+            view.term_ = get_le_uint64(header);
+            view.type_ = static_cast<log_entry_type>(get_le_uint32(header));
+            view.len_ = get_le_uint32(header);
+            //checksum
+            get_le_uint32(header);
+            view.data_ = (const char*)header;
+            buffer = header + view.len_;
+            return true;
+        }
+
+        if (get_uint32(buffer) != __MAGIC_START__)
+            return false;
+
+        unsigned int len = get_uint32(buffer) - sizeof(int);
+
+        //decode fields of log_entry in place.data_ point to buffer
+        input_t input(buffer, static_cast<int>(len));
+        google::protobuf::uint32 tag = 0;
+        google::protobuf::uint64 value = 0;
+        google::protobuf::uint32 size = 0;
+
+        while ((tag = input.ReadTag()) != 0)
+        {
+            int number = wire_format_t::GetTagFieldNumber(tag);
+            if (number == log_entry::kLogDataFieldNumber)
+            {
+                if (!input.ReadVarint32(&size))
+                    break;
+                view.data_ = (const char*)buffer + input.CurrentPosition();
+                view.len_ = size;
+                if (!input.Skip(static_cast<int>(size)))
+                    break;
+                continue;
+            }
+            if (wire_format_t::GetTagWireType(tag) !=
+                wire_format_t::WIRETYPE_VARINT)
+            {
+                if (!wire_format_t::SkipField(&input, tag))
+                    break;
+                continue;
+            }
+            if (!input.ReadVarint64(&value))
+                break;
+            if (number == log_entry::kIndexFieldNumber)
+                view.index_ = value;
+            else if (number == log_entry::kTermFieldNumber)
+                view.term_ = value;
+            else if (number == log_entry::kTypeFieldNumber)
+                view.type_ = static_cast<log_entry_type>(value);
+        }
+
+        if (!input.ConsumedEntireMessage() ||
+            input.CurrentPosition() != static_cast<int>(len))
+        {
+            logger_fatal("mmap error");
+            return false;
+        }
+        buffer += len;
+
+        if (get_uint32(buffer) != __MAGIC_END__)
+        {
+            logger_fatal("mmap error");
+            return false;
+        }
+        return true;
+    }
+
     unsigned char* mmap_log::get_data_buffer(log_index_t index)
     {
         unsigned int offset = 0;
@@ -457,10 +924,18 @@ namespace raft
         size_t one_entry_len =
             entry.ByteSize() + sizeof(int) + sizeof(int) * 2;
 
+        //e_format_binary entry with empty log_data
+        //is only the header
+        if (one_entry_len > __BINARY_HEADER_SIZE__)
+            one_entry_len = __BINARY_HEADER_SIZE__;
+
         size_t one_index_len = sizeof(long long) + sizeof(int) * 3;
 
         size_t size = (max_mmap_size / one_entry_len + 1)* one_index_len;
 
+        //room for footer
+        size += __FOOTER_SIZE__;
+
         size_t max_size = __64k__;
 
         while (max_size < size)
@@ -474,8 +949,137 @@ namespace raft
         return sizeof(log_index_t) + sizeof(int) * 3;
     }
 
+    size_t mmap_log::index_remain() const
+    {
+        //index file of an old segment may be sized
+        //for bigger entries than the ones written now
+        unsigned char *end = index_buf_ + index_buf_size_ - __FOOTER_SIZE__;
+        if (index_wbuf_ >= end)
+            return 0;
+        return (end - index_wbuf_) / one_index_size();
+    }
+
+    void mmap_log::write_footer()
+    {
+        if (!last_index_ ||
+            (size_t)(index_wbuf_ - index_buf_) >
+            index_buf_size_ - __FOOTER_SIZE__)
+        {
+            return;
+        }
+
+        //term of the first entry
+        log_entry_view view;
+        unsigned char *data_buffer = get_data_buffer(start_index_);
+        if (!data_buffer || !get_entry_view(data_buffer, view))
+            return;
+
+        unsigned char *footer = index_buf_ + index_buf_size_ - __FOOTER_SIZE__;
+        unsigned char *buffer = footer;
+
+        put_le_uint32(buffer, __MAGIC_FOOTER__);
+        put_le_uint64(buffer, start_index_);
+        put_le_uint64(buffer, view.term_);
+        put_le_uint64(buffer, last_index_);
+        put_le_uint64(buffer, last_term_);
+        put_le_uint64(buffer, data_wbuf_ - data_buf_);
+        put_le_uint64(buffer, index_wbuf_ - index_buf_);
+        put_le_uint32(buffer, crc32c(footer + sizeof(int),
+                                     __FOOTER_SIZE__ - sizeof(int) * 2));
+        footer_dirty_ = true;
+    }
+
+    void mmap_log::clear_footer()
+    {
+        unsigned char *footer = index_buf_ + index_buf_size_ - __FOOTER_SIZE__;
+
+        if (get_le_uint32(footer) != __MAGIC_FOOTER__)
+            return;
+
+        footer -= sizeof(int);
+        put_le_uint32(footer, 0);
+        footer_dirty_ = true;
+    }
+
+    /*
+     * sealed log has footer.open it without scan
+     * the index file.
+     */
+    bool mmap_log::load_footer()
+    {
+        if (index_buf_size_ < __FOOTER_SIZE__)
+            return false;
+
+        unsigned char *footer = index_buf_ + index_buf_size_ - __FOOTER_SIZE__;
+        unsigned char *buffer = footer;
+
+        if (get_le_uint32(buffer) != __MAGIC_FOOTER__)
+            return false;
+
+        log_index_t start_index = get_le_uint64(buffer);
+        term_t start_term = get_le_uint64(buffer);
+        log_index_t last_index = get_le_uint64(buffer);
+        term_t last_term = get_le_uint64(buffer);
+        unsigned long long data_offset = get_le_uint64(buffer);
+        unsigned long long index_offset = get_le_uint64(buffer);
+
+        if (get_le_uint32(buffer) != crc32c(footer + sizeof(int),
+                                            __FOOTER_SIZE__ - sizeof(int) * 2))
+        {
+            logger_error("footer crc32c error.%s", index_filepath_.c_str());
+            return false;
+        }
+
+        if (!start_index || last_index < start_index ||
+            data_offset > data_buf_size_ ||
+            index_offset < one_index_size() ||
+            index_offset > index_buf_size_ - __FOOTER_SIZE__)
+        {
+            logger_error("footer error.%s", index_filepath_.c_str());
+            return false;
+        }
+
+        //check the last entry
+        buffer = index_buf_ + index_offset - one_index_size();
+        if (get_uint32(buffer) != __MAGIC_START__ ||
+            get_uint64(buffer) != last_index)
+        {
+            logger_error("footer not match index.%s", index_filepath_.c_str());
+            return false;
+        }
+
+        unsigned int offset = get_uint32(buffer);
+        if (get_uint32(buffer) != __MAGIC_END__ ||
+            !check_entry(offset, last_index))
+        {
+            logger_error("footer not match data.%s", data_filepath_.c_str());
+            return false;
+        }
+
+        //reads will not verify.scan it to truncate at the broken one
+        if (verify_ == e_verify_reload &&
+            !check_entries(start_index, index_offset))
+        {
+            logger_error("sealed log broken.%s", data_filepath_.c_str());
+            return false;
+        }
+
+        start_index_ = start_index;
+        start_term_ = start_term;
+        last_index_ = last_index;
+        last_term_ = last_term;
+        data_wbuf_ = data_buf_ + data_offset;
+        index_wbuf_ = index_buf_ + index_offset;
+        eof_ = true;
+        return true;
+    }
+
     bool mmap_log::reload_log()
     {
+        //sealed log
+        if (load_footer())
+            return true;
+
         unsigned int value = get_uint32(index_wbuf_);
 
         //empty file.
@@ -490,85 +1094,152 @@ namespace raft
             logger_error("reload_log error.not log file");
             return false;
         }
+        index_wbuf_ -= sizeof(unsigned int);
 
-        //get index
-        last_index_ = start_index_ = get_uint64(index_wbuf_);
+        last_index_ = start_index_ = 0;
 
-        //get offset
-        get_uint32(index_wbuf_);
-        if (get_uint32(index_wbuf_) != __MAGIC_END__)
-        {
-            logger_error("mmap_error");
-            return false;
-        }
-
-        size_t max_size = index_buf_size_ - sizeof(int);
+        //index entries never go into the footer
+        size_t max_size = index_buf_size_ - __FOOTER_SIZE__;
 
         while (index_wbuf_ - index_buf_ < static_cast<int>(max_size))
         {
+            unsigned char *index_buffer = index_wbuf_;
+
             value = get_uint32(index_wbuf_);
             //end of index log
             if (value == 0)
             {
-                index_wbuf_ -= sizeof(unsigned int);
+                index_wbuf_ = index_buffer;
                 return set_data_wbuf(last_index_);
-
             }
-            else if (value == __MAGIC_START__)
+
+            if (value != __MAGIC_START__ ||
+                max_size - (index_buffer - index_buf_) < one_index_size())
             {
-                //index
-                last_index_ = get_uint64(index_wbuf_);
-                //offset
-                (void)get_uint32(index_wbuf_);
-
-                if (get_uint32(index_wbuf_) != __MAGIC_END__)
-                {
-                    logger_fatal("mmap index error");
-                    return false;
-                }
-                continue;
+                return truncate_reload(index_buffer);
             }
-            else
+
+            //index
+            log_index_t index = get_uint64(index_wbuf_);
+            //offset
+            unsigned int offset = get_uint32(index_wbuf_);
+
+            if (get_uint32(index_wbuf_) != __MAGIC_END__ ||
+                (last_index_ && index != last_index_ + 1) ||
+                !check_entry(offset, index))
             {
-                logger_fatal("mmap index error");
-                return false;
+                return truncate_reload(index_buffer);
             }
+
+            if (!start_index_)
+                start_index_ = index;
+            last_index_ = index;
         }
-        return false;
+        //index full.footer not written before crash
+        return set_data_wbuf(last_index_);
     }
 
-    bool mmap_log::set_data_wbuf(log_index_t index)
+    /*
+     * entry of index_buffer is broken.drop it and
+     * the entries after it.
+     */
+    bool mmap_log::truncate_reload(unsigned char *index_buffer)
     {
-        //index ==0 for empty
-        if (index == 0)
+        logger_error("log broken after index(%llu),truncate it.%s",
+                     last_index_,
+                     data_filepath_.c_str());
+
+        //clear index entries after,they must not come back
+        memset(index_buffer, 0, index_buf_size_ - (index_buffer - index_buf_));
+        index_wbuf_ = index_buffer;
+
+        //first entry broken.log is empty now
+        if (!last_index_)
+            start_index_ = 0;
+
+        return set_data_wbuf(last_index_);
+    }
+
+    /*
+     * check data entry in reload.it will not crash
+     * when data broken,just return false.
+     */
+    bool mmap_log::check_entry(size_t offset, log_index_t index)
+    {
+        if (offset >= data_buf_size_)
+            return false;
+
+        unsigned char *buffer = data_buf_ + offset;
+        size_t remain = data_buf_size_ - offset;
+
+        if (remain < sizeof(int) * 3)
+            return false;
+
+        unsigned char *header = buffer;
+        if (get_le_uint32(header) == __MAGIC_BINARY__)
         {
-            data_wbuf_ = data_buf_;
-            return true;
+            if (remain < __BINARY_HEADER_SIZE__ ||
+                get_le_uint64(header) != index)
+                return false;
+            return check_crc(buffer);
         }
 
-        log_entry entry;
-        unsigned char *data_buffer = get_data_buffer(index);
+        //e_format_protobuf.no checksum,check magic only
+        header = buffer;
+        if (get_uint32(header) != __MAGIC_START__)
+            return false;
 
-        if (!data_buffer || get_uint32(data_buffer) != __MAGIC_START__)
-        {
-            logger_fatal("mmap error");
+        size_t len = get_uint32(header);
+        if (len < sizeof(int) || remain - sizeof(int) * 2 < len)
             return false;
+
+        header += len - sizeof(int);
+        return get_uint32(header) == __MAGIC_END__;
+    }
+
+    /*
+     * check data entries of index [0, index_offset) in reload.
+     */
+    bool mmap_log::check_entries(log_index_t start_index,
+                                 size_t index_offset)
+    {
+        unsigned char *buffer = index_buf_;
+        log_index_t index = start_index;
+
+        while (static_cast<size_t>(buffer - index_buf_) < index_offset)
+        {
+            if (get_uint32(buffer) != __MAGIC_START__ ||
+                get_uint64(buffer) != index)
+                return false;
+
+            unsigned int offset = get_uint32(buffer);
+            if (get_uint32(buffer) != __MAGIC_END__ ||
+                !check_entry(offset, index))
+                return false;
+            index++;
         }
+        return true;
+    }
 
-        bool rc = get_message(data_buffer, entry);
-        if (!rc)
+    bool mmap_log::set_data_wbuf(log_index_t index)
+    {
+        //index ==0 for empty
+        if (index == 0)
         {
-            logger_fatal("get massage error");
-            return false;
+            data_wbuf_ = data_buf_;
+            return true;
         }
 
-        if (get_uint32(data_buffer) != __MAGIC_END__)
+        log_entry_view view;
+        unsigned char *data_buffer = get_data_buffer(index);
+
+        if (!data_buffer || !get_entry_view(data_buffer, view))
         {
             logger_fatal("mmap error");
             return false;
         }
 
-        last_term_ = entry.term();
+        last_term_ = view.term_;
         data_wbuf_ = data_buffer;
         return true;
     }
@@ -612,16 +1283,35 @@ namespace raft
         return index_buf_ + offset;
     }
 
-    mmap_log_manager::mmap_log_manager(const std::string &log_path)
-        :log_manager(log_path)
+    mmap_log_manager::mmap_log_manager(const std::string &log_path,
+                                       mmap_log::format_t format)
+        :log_manager(log_path),
+         format_(format),
+         verify_(mmap_log::e_verify_reload),
+         sample_rate_(0)
+    {
+
+    }
+
+    mmap_log_manager::~mmap_log_manager()
     {
+        //preallocator call create(),stop it before this destroyed
+        stop_preallocator();
+    }
 
+    void mmap_log_manager::set_verify(mmap_log::verify_t verify,
+                                      unsigned int sample_rate)
+    {
+        acl::lock_guard lg(locker_);
+        verify_ = verify;
+        sample_rate_ = sample_rate;
     }
 
     log *mmap_log_manager::create(const std::string &filepath)
     {
-        log *_log = new mmap_log(last_index_, log_size_);
+        mmap_log *_log = new mmap_log(last_index_, log_size_, format_);
 
+        _log->set_verify(verify_, sample_rate_);
         if (!_log->open(filepath))
         {
             logger_error("mmap_log open error,%s",
@@ -0,0 +1,248 @@
+#include "raft.hpp"
+
+namespace raft
+{
+	multi_raft::multi_raft(const std::string &node_id,
+						   const std::string &path,
+						   scheduler &_scheduler,
+						   transport &_transport)
+		:node_id_(node_id),
+		 path_(path),
+		 scheduler_(_scheduler),
+		 transport_(_transport),
+		 heartbeat_batcher_(_scheduler, _transport)
+	{
+		append_slash(path_);
+		acl_pthread_mutex_init(&mutex_, NULL);
+		acl_pthread_cond_init(&cond_, NULL);
+	}
+
+	multi_raft::~multi_raft()
+	{
+		std::vector<std::string> ids = groups();
+
+		for (size_t i = 0; i < ids.size(); i++)
+			remove_group(ids[i]);
+
+		acl_pthread_mutex_destroy(&mutex_);
+		acl_pthread_cond_destroy(&cond_);
+	}
+
+	node *multi_raft::create_group(const std::string &group_id,
+								   const std::vector<peer_info> &peer_infos)
+	{
+		std::string path = path_ + group_id + "/";
+		std::string log_path = path + "log/";
+		std::string metadata_path = path + "metadata/";
+		std::string snapshot_path = path + "snapshot/";
+
+		if (acl_make_dirs(log_path.c_str(), 0755) == -1 ||
+			acl_make_dirs(metadata_path.c_str(), 0755) == -1 ||
+			acl_make_dirs(snapshot_path.c_str(), 0755) == -1)
+		{
+			logger_error("make dirs of group error.%s.%s",
+						 path.c_str(),
+						 acl::last_serror());
+			return NULL;
+		}
+
+		node *_node = new node;
+		_node->set_node_id(node_id_);
+		_node->set_group_id(group_id);
+		_node->set_scheduler(scheduler_);
+		_node->set_transport(transport_);
+		_node->set_heartbeat_batcher(&heartbeat_batcher_);
+		_node->set_log_path(log_path);
+		_node->set_metadata_path(metadata_path);
+		_node->set_snapshot_path(snapshot_path);
+		_node->set_peers(peer_infos);
+		//a thread for each group is too many
+		_node->set_log_preallocate(0);
+
+		acl_pthread_mutex_lock(&mutex_);
+		if (groups_.find(group_id) != groups_.end())
+		{
+			acl_pthread_mutex_unlock(&mutex_);
+			logger_error("group exist.%s", group_id.c_str());
+			delete _node;
+			return NULL;
+		}
+		group *_group = new group;
+		_group->node_ = _node;
+		_group->ref_ = 0;
+		_group->added_ = false;
+		groups_[group_id] = _group;
+		acl_pthread_mutex_unlock(&mutex_);
+
+		return _node;
+	}
+
+	bool multi_raft::add_group(const std::string &group_id)
+	{
+		node *_node = NULL;
+
+		acl_pthread_mutex_lock(&mutex_);
+		std::map<std::string, group*>::iterator it = groups_.find(group_id);
+		if (it != groups_.end() && !it->second->added_)
+			_node = it->second->node_;
+		acl_pthread_mutex_unlock(&mutex_);
+
+		if (!_node)
+		{
+			logger_error("group not created or added.%s", group_id.c_str());
+			return false;
+		}
+		//no request reach the node before its metadata loaded
+		if (!_node->reload())
+		{
+			logger_error("reload group error.%s", group_id.c_str());
+			remove_group(group_id);
+			return false;
+		}
+
+		acl_pthread_mutex_lock(&mutex_);
+		it = groups_.find(group_id);
+		if (it != groups_.end())
+			it->second->added_ = true;
+		acl_pthread_mutex_unlock(&mutex_);
+
+		return true;
+	}
+
+	node *multi_raft::get_group(const std::string &group_id)
+	{
+		node *_node = NULL;
+
+		acl_pthread_mutex_lock(&mutex_);
+		std::map<std::string, group*>::iterator it = groups_.find(group_id);
+		if (it != groups_.end())
+			_node = it->second->node_;
+		acl_pthread_mutex_unlock(&mutex_);
+
+		return _node;
+	}
+
+	bool multi_raft::remove_group(const std::string &group_id)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		std::map<std::string, group*>::iterator it = groups_.find(group_id);
+		if (it == groups_.end())
+		{
+			acl_pthread_mutex_unlock(&mutex_);
+			return false;
+		}
+		group *_group = it->second;
+		groups_.erase(it);
+
+		//no more requests routed to it.wait for requests in process
+		while (_group->ref_ > 0)
+			acl_pthread_cond_wait(&cond_, &mutex_);
+		acl_pthread_mutex_unlock(&mutex_);
+
+		delete _group->node_;
+		delete _group;
+		return true;
+	}
+
+	void multi_raft::set_heartbeat_window(unsigned int window)
+	{
+		heartbeat_batcher_.set_window(window);
+	}
+
+	std::vector<std::string> multi_raft::groups()
+	{
+		std::vector<std::string> ids;
+
+		acl_pthread_mutex_lock(&mutex_);
+		std::map<std::string, group*>::iterator it = groups_.begin();
+		for (; it != groups_.end(); ++it)
+			ids.push_back(it->first);
+		acl_pthread_mutex_unlock(&mutex_);
+
+		return ids;
+	}
+
+	multi_raft::group *multi_raft::acquire_group(const std::string &group_id)
+	{
+		group *_group = NULL;
+
+		acl_pthread_mutex_lock(&mutex_);
+		std::map<std::string, group*>::iterator it = groups_.find(group_id);
+		if (it != groups_.end() && it->second->added_)
+		{
+			_group = it->second;
+			_group->ref_++;
+		}
+		acl_pthread_mutex_unlock(&mutex_);
+
+		if (!_group)
+			logger_error("group not found or added.%s", group_id.c_str());
+		return _group;
+	}
+
+	void multi_raft::release_group(group *_group)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		if (--_group->ref_ == 0)
+			acl_pthread_cond_broadcast(&cond_);
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	bool multi_raft::handle_vote_request(const vote_request &req,
+										 vote_response &resp)
+	{
+		group *_group = acquire_group(req.group_id());
+		if (!_group)
+		{
+			resp.set_req_id(req.req_id());
+			resp.set_vote_granted(false);
+			return true;
+		}
+		bool rc = _group->node_->handle_vote_request(req, resp);
+		release_group(_group);
+		return rc;
+	}
+
+	bool multi_raft::handle_replicate_log_request(
+		const replicate_log_entries_request &req,
+		replicate_log_entries_response &resp)
+	{
+		group *_group = acquire_group(req.group_id());
+		if (!_group)
+		{
+			resp.set_req_id(req.req_id());
+			resp.set_success(false);
+			return true;
+		}
+		bool rc = _group->node_->handle_replicate_log_request(req, resp);
+		release_group(_group);
+		return rc;
+	}
+
+	bool multi_raft::handle_install_snapshot_request(
+		const install_snapshot_request &req,
+		install_snapshot_response &resp)
+	{
+		group *_group = acquire_group(req.group_id());
+		if (!_group)
+		{
+			resp.set_req_id(req.req_id());
+			return true;
+		}
+		bool rc = _group->node_->handle_install_snapshot_request(req, resp);
+		release_group(_group);
+		return rc;
+	}
+
+	bool multi_raft::handle_heartbeat_request(const heartbeat_request &req,
+											  heartbeat_response &resp)
+	{
+		//one response for each request.in the same order
+		for (int i = 0; i < req.requests_size(); i++)
+		{
+			handle_replicate_log_request(req.requests(i),
+										 *resp.add_responses());
+		}
+		return true;
+	}
+}
@@ -13,6 +13,11 @@
 #define __SNAPSHOT_EXT__ ".snapshot"
 #endif
 
+//max milliseconds between apply retries after error
+#ifndef __APPLY_RETRY_MAX__
+#define __APPLY_RETRY_MAX__ 1000
+#endif
+
 #define NODE_SECTION 11
 #define ELECTION_SECTION 12
 
@@ -100,6 +105,9 @@ namespace raft
        role_(E_FOLLOWER),
        start_(false),
        log_ok_(false),
+       committed_index_(0),
+       applied_index_(0),
+       checkpoint_interval_(0),
        load_snapshot_callback_(NULL),
        make_snapshot_callback_(NULL),
        snapshot_info_(NULL),
@@ -110,31 +118,70 @@ namespace raft
        max_log_count_(5),
        mini_log_count_(max_log_count_ / 2),
        max_snapshot_size_(2),
+       sync_mode_(log_manager::e_sync_none),
+       sync_entries_(0),
+       sync_micros_(0),
+       log_cache_size_(0),
+       log_format_(mmap_log::e_format_protobuf),
+       log_verify_(mmap_log::e_verify_reload),
+       log_verify_sample_rate_(0),
+       log_preallocate_(1),
+       log_prefault_(false),
+       max_inflight_(1),
+       scheduler_(&scheduler::get_instance()),
+       background_scheduler_(&scheduler::get_background_instance()),
+       heartbeat_batcher_(NULL),
+       transport_(&http_rpc_transport::get_instance()),
+       quorum_slot_(-1),
+       read_round_(0),
+       elected_index_(0),
+       pending_callbacks_(4096),
        election_timer_(*this),
        log_compaction_worker_(*this),
        apply_callback_(NULL),
        apply_log_(*this),
-       metadata_(NULL)
+       metadata_(NULL),
+       log_writer_(*this),
+       log_flusher_(*this),
+       checkpoint_timer_(*this)
     {
         metadata_path_ = "metadata/";
         log_path_ = "log/";
         snapshot_path_ = "snapshot_path/";
+
+        acl_pthread_mutex_init(&pending_mutex_, NULL);
+        acl_pthread_cond_init(&pending_cond_, NULL);
     }
 
     node::~node()
     {
-        acl::lock_guard lg(peers_locker_);
+        //timer walks peers_.no more fire before peers deleted
+        election_timer_.stop();
+        log_writer_.stop();
+        log_flusher_.stop();
+        apply_log_.stop();
+        log_compaction_worker_.stop();
+        checkpoint_timer_.stop();
+
+        if (metadata_)
+            checkpoint_indexes();
+
+        peers_locker_.lock();
         std::map<std::string, peer *>::iterator it = peers_.begin();
         for (; it != peers_.end(); ++it)
         {
             delete it->second;
         }
+        peers_.clear();
+        peers_locker_.unlock();
+
+        acl_pthread_mutex_destroy(&pending_mutex_);
+        acl_pthread_cond_destroy(&pending_cond_);
     }
 
     bool node::replicate(const std::string &data,
                          replicate_callback *callback)
     {
-        term_t term = 0;
         log_index_t index = 0;
 
         if (!is_leader())
@@ -145,23 +192,128 @@ namespace raft
 
             return false;
         }
-        if (!write_log(data, index, term))
+
+        if (log_writer_.enabled())
         {
-            logger_error("write_log error.%s",
-                         acl::last_serror());
+            replicate_req *req = new replicate_req;
+            req->data_ = data;
+            req->callback_ = callback;
+            log_writer_.push(req);
+            return true;
+        }
+
+        std::vector<log_entry> entries(1);
+        std::vector<replicate_callback*> callbacks(1, callback);
+        bool kept = false;
+
+        entries[0].set_log_data(data);
+        return replicate_entries(entries, callbacks, kept);
+    }
+
+    bool node::replicate_batch(const std::vector<std::string> &data,
+                               const std::vector<replicate_callback*> &callbacks)
+    {
+        if (data.empty() || data.size() != callbacks.size())
+        {
+            logger_error("data size(%lu) callbacks size(%lu) error",
+                         data.size(),
+                         callbacks.size());
             return false;
         }
 
-        add_replicate_callback(version(index, term), callback);
+        std::vector<log_entry> entries(data.size());
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            entries[i].set_log_data(data[i]);
+        }
+        bool kept = false;
+        return replicate_entries(entries, callbacks, kept);
+    }
+
+    bool node::replicate_entries(
+        std::vector<log_entry> &entries,
+        const std::vector<replicate_callback*> &callbacks,
+        bool &kept,
+        log_index_t *written)
+    {
+        log_index_t index = 0;
+
+        kept = false;
+
+        if (!is_leader())
+        {
+            logger("node is not leader .is %s",
+                   role() == E_FOLLOWER ?
+                   "follower" : "candidate");
+
+            return false;
+        }
+        if (!write_entries(entries, callbacks, index))
+        {
+            logger_error("write_entries error.%s",
+                         acl::last_serror());
+            return false;
+        }
+        kept = true;
 
         notify_peers_replicate_log();
 
+        if (written)
+        {
+            *written = index;
+            return true;
+        }
+
+        if (!sync_log(index))
+        {
+            sync_log_failed(index - entries.size() + 1, index);
+            return false;
+        }
+        return true;
+    }
+
+    bool node::sync_log(log_index_t index, bool group)
+    {
+        if (log_manager_->sync_mode() == log_manager::e_sync_none)
+            return true;
+        /**
+         * flush log together with other replicate callers.
+         * and leader's match index move forward after flush.
+         */
+        if (!log_manager_->sync(index, group))
+        {
+            logger_error("log_manager sync error.index(%llu)", index);
+            return false;
+        }
+        replicate_log_callback(quorum_slot_, log_manager_->sync_index());
         return true;
     }
 
+    void node::sync_log_failed(log_index_t first, log_index_t last)
+    {
+        term_t term = current_term();
+        bool freed = false;
+
+        /**
+         * leader can't promise entries are durable.callbacks
+         * not invoked yet take E_ERROR,and the other pending
+         * ones take E_NO_LEADER when step down.
+         */
+        for (log_index_t index = first; index <= last; index++)
+            freed |= invoke_replicate_callback(index, term,
+                                               replicate_callback::E_ERROR);
+        if (freed)
+            notify_pending_freed();
+
+        logger_error("flush log [%llu, %llu] failed.step down",
+                     first,
+                     last);
+        step_down();
+    }
+
     bool node::read(log_index_t index, std::string &data, version &ver)
     {
-        log_entry log;
+        log_entry_view view;
         log_index_t _committed_index = committed_index();
         if (_committed_index < index)
         {
@@ -173,16 +325,16 @@ namespace raft
             return false;
         }
 
-        if (!log_manager_->read(index, log))
+        if (!log_manager_->read(index, view))
         {
             logger_error("log_manager read error"
                          ".index(%llu)",
                          index);
             return false;
         }
-        data = log.log_data();
-        ver.index_ = log.index();
-        ver.term_ = log.term();
+        data.assign(view.data_, view.len_);
+        ver.index_ = view.index_;
+        ver.term_ = view.term_;
         return true;
     }
 
@@ -231,6 +383,120 @@ namespace raft
             log_manager_->set_log_size(max_log_size_);
     }
 
+    void node::set_log_sync_mode(log_manager::sync_mode_t mode,
+                                 size_t group_entries,
+                                 unsigned int group_micros)
+    {
+        sync_mode_ = mode;
+        sync_entries_ = group_entries;
+        sync_micros_ = group_micros;
+        if (log_manager_)
+            log_manager_->set_sync_mode(sync_mode_,
+                                        sync_entries_,
+                                        sync_micros_);
+    }
+
+    void node::set_log_cache_size(size_t max_bytes)
+    {
+        log_cache_size_ = max_bytes;
+        if (log_manager_)
+            log_manager_->set_cache_size(log_cache_size_);
+    }
+
+    void node::set_log_format(mmap_log::format_t format)
+    {
+        log_format_ = format;
+    }
+
+    void node::set_log_verify(mmap_log::verify_t verify,
+                              unsigned int sample_rate)
+    {
+        log_verify_ = verify;
+        log_verify_sample_rate_ = sample_rate;
+    }
+
+    void node::set_log_preallocate(size_t count, bool prefault)
+    {
+        log_preallocate_ = count;
+        log_prefault_ = prefault;
+        if (log_manager_)
+            log_manager_->set_preallocate(log_preallocate_, log_prefault_);
+    }
+
+    void node::set_replicate_coalescing(size_t max_count,
+                                        size_t max_bytes,
+                                        unsigned int linger_micros)
+    {
+        log_writer_.set_limits(max_count, max_bytes, linger_micros);
+    }
+
+    void node::set_replicate_pipeline(size_t max_inflight)
+    {
+        max_inflight_ = max_inflight;
+    }
+
+    void node::set_max_pending_replicates(size_t count)
+    {
+        //slots are not copyable.replace them as a whole
+        std::vector<pending_callback>(count ? count : 1).
+            swap(pending_callbacks_);
+    }
+
+    void node::set_scheduler(scheduler &_scheduler)
+    {
+        scheduler_ = &_scheduler;
+    }
+
+    scheduler &node::get_scheduler()
+    {
+        return *scheduler_;
+    }
+
+    void node::set_background_scheduler(scheduler &_scheduler)
+    {
+        background_scheduler_ = &_scheduler;
+    }
+
+    scheduler &node::get_background_scheduler()
+    {
+        return *background_scheduler_;
+    }
+
+    void node::set_heartbeat_batcher(heartbeat_batcher *batcher)
+    {
+        heartbeat_batcher_ = batcher;
+    }
+
+    heartbeat_batcher *node::get_heartbeat_batcher()
+    {
+        return heartbeat_batcher_;
+    }
+
+    void node::set_transport(transport &_transport)
+    {
+        transport_ = &_transport;
+    }
+
+    transport &node::get_transport()
+    {
+        return *transport_;
+    }
+
+    void node::set_election_timeout(unsigned int timeout)
+    {
+        election_timeout_ = timeout ? timeout : 1;
+    }
+
+    unsigned int node::election_timeout()
+    {
+        return election_timeout_;
+    }
+
+    void node::set_index_checkpoint(unsigned int interval)
+    {
+        checkpoint_interval_ = interval;
+    }
+
     void node::set_max_log_count(size_t size)
     {
         max_log_count_ = size;
@@ -273,6 +539,16 @@ namespace raft
         return node_id_;
     }
 
+    void node::set_group_id(const std::string &id)
+    {
+        group_id_ = id;
+    }
+
+    std::string node::group_id() const
+    {
+        return group_id_;
+    }
+
     bool node::is_candidate()
     {
         acl::lock_guard lg(metadata_locker_);
@@ -383,7 +659,7 @@ namespace raft
 
     log_index_t node::applied_index()
     {
-        return metadata_->get_applied_index();
+        return applied_index_.load(std::memory_order_acquire);
     }
 
     void node::set_applied_index(log_index_t index)
@@ -393,19 +669,53 @@ namespace raft
             /**
              * apply should increase one by one
              */
-            if (metadata_->get_applied_index() != index - 1)
+            if (applied_index() != index - 1)
             {
                 logger_fatal("applied error."
                              "applied_index(%llu) "
                              "index(%llu)",
-                             metadata_->get_applied_index(),
+                             applied_index(),
                              index);
             }
         }
 
+        applied_index_.store(index, std::memory_order_release);
+        if (checkpoint_interval_)
+            return;
+
+        if (!metadata_->set_applied_index(index))
+            logger_fatal("metadata set_applied_index");
+    }
+
+    void node::set_applied_index(log_index_t index, size_t count)
+    {
+        if (applied_index() + count != index)
+        {
+            logger_fatal("applied error."
+                         "applied_index(%llu) "
+                         "index(%llu) count(%lu)",
+                         applied_index(),
+                         index,
+                         count);
+        }
+
+        applied_index_.store(index, std::memory_order_release);
+        if (checkpoint_interval_)
+            return;
+
         if (!metadata_->set_applied_index(index))
             logger_fatal("metadata set_applied_index");
     }
+
+    void node::checkpoint_indexes()
+    {
+        if (!metadata_->set_committed_index(committed_index()) ||
+            !metadata_->set_applied_index(applied_index()) ||
+            !metadata_->sync())
+        {
+            logger_error("checkpoint indexes error");
+        }
+    }
     raft::term_t node::last_log_term()const
     {
         acl_assert(log_manager_);
@@ -418,13 +728,109 @@ namespace raft
         return log_manager_->last_index();
     }
 
+    raft::log_index_t node::first_index_of_term(log_index_t index,
+                                                term_t term)
+    {
+        log_index_t low = start_log_index();
+        log_index_t high = index;
+
+        while (low < high)
+        {
+            log_index_t mid = low + (high - low) / 2;
+            log_entry_view view;
+
+            if (!log_manager_->read(mid, view))
+            {
+                logger_error("read log error.index:%llu", mid);
+                return index;
+            }
+            if (view.term_ < term)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        return high;
+    }
+
+    raft::log_index_t node::last_index_of_term(term_t term)
+    {
+        log_index_t low = start_log_index();
+        log_index_t high = last_log_index();
+        log_index_t index = 0;
+
+        if (!low)
+            low = 1;
+
+        while (low <= high)
+        {
+            log_index_t mid = low + (high - low) / 2;
+            log_entry_view view;
+
+            if (!log_manager_->read(mid, view))
+            {
+                logger_error("read log error.index:%llu", mid);
+                return 0;
+            }
+            if (view.term_ > term)
+            {
+                high = mid - 1;
+                continue;
+            }
+            if (view.term_ == term)
+                index = mid;
+            low = mid + 1;
+        }
+        return index;
+    }
+
     bool node::build_replicate_log_request(
         replicate_log_entries_request &request,
         log_index_t index,
         int entry_size)
     {
+        int count = 0;
+
+        if (!build_replicate_log_header(request, index, entry_size, count))
+            return false;
+
+        //log_entry cleared in request reused
+        return !count || log_manager_->read(index,
+                                            __10MB__,
+                                            count,
+                                            *request.mutable_entries());
+    }
+
+    bool node::build_replicate_log_request(
+        replicate_log_entries_request &request,
+        std::string &entries,
+        log_index_t index,
+        int entry_size,
+        int &count)
+    {
+        int max_count = 0;
+
+        count = 0;
+        if (!build_replicate_log_header(request, index, entry_size, max_count))
+            return false;
+
+        return !max_count || log_manager_->read(index,
+                                                __10MB__,
+                                                max_count,
+                                                entries,
+                                                count);
+    }
+
+    bool node::build_replicate_log_header(
+        replicate_log_entries_request &request,
+        log_index_t index,
+        int entry_size,
+        int &count)
+    {
+        count = 0;
+
         request.set_term(current_term());
         request.set_leader_id(node_id());
+        request.set_group_id(group_id_);
         request.set_leader_commit(committed_index());
 
         if (!entry_size)
@@ -444,45 +850,31 @@ namespace raft
         }
         else if (index == 1)
         {
-            log_entry entry;
-            if (log_manager_->read(1, entry))
-            {
-                request.set_prev_log_index(0);
-                request.set_prev_log_term(0);
+            //copy one entry
+            request.set_prev_log_index(0);
+            request.set_prev_log_term(0);
+            count = 1;
 
-                //copy one entry
-                *request.add_entries() = entry;
-                // read log ok
-                return true;
-            }
+            return true;
         }
         else if (index <= last_log_index())
         {
-            std::vector<log_entry*> entries;
-            log_entry* pre_entry;
+            log_entry_view pre_entry;
             //index -1 for prev_log_term, set_prev_log_index
-            if (log_manager_->read(index - 1,
-                                   __10MB__,
-                                   entry_size,
-                                   entries))
+            if (log_manager_->read(index - 1, pre_entry))
             {
-                pre_entry = entries[0];
-
-                request.set_prev_log_index(pre_entry->index());
-                request.set_prev_log_term(pre_entry->term());
+                request.set_prev_log_index(pre_entry.index_);
+                request.set_prev_log_term(pre_entry.term_);
 
                 logger_debug(NODE_SECTION, 10,
                              "pre_log_index(%lu) "
                              "pre_log_term(%lu) ",
-                             pre_entry->index(),
-                             pre_entry->term());
+                             pre_entry.index_,
+                             pre_entry.term_);
+
+                //entry_size count prev log in
+                count = entry_size - 1;
 
-                delete pre_entry;
-                //first one is prev log
-                for (size_t i = 1; i < entries.size(); i++)
-                {
-                    request.mutable_entries()->AddAllocated(entries[i]);
-                }
                 // read log ok
                 return true;
             }
@@ -491,12 +883,12 @@ namespace raft
         {
             logger_debug(NODE_SECTION, 10, "index > last_log_index()");
             /*peer match leader now .and just make heartbeat req*/
-            log_entry entry;
+            log_entry_view entry;
             /*index -1 for prev_log_term, prev_log_index */
             if (log_manager_->read(index - 1, entry))
             {
-                request.set_prev_log_index(entry.index());
-                request.set_prev_log_term(entry.term());
+                request.set_prev_log_index(entry.index_);
+                request.set_prev_log_term(entry.term_);
 
                 // read log ok
                 return true;
@@ -506,23 +898,7 @@ namespace raft
         return false;
     }
 
-    std::vector<log_index_t> node::get_peers_match_index()
-    {
-        std::vector<log_index_t> indexs;
-        std::map<std::string, peer*>::iterator it;
-
-        acl::lock_guard lg(peers_locker_);
-
-        for (it = peers_.begin();
-             it != peers_.end(); ++it)
-        {
-            indexs.push_back(it->second->match_index());
-        }
-
-        return indexs;
-    }
-
-    void node::replicate_log_callback()
+    void node::replicate_log_callback(int slot, log_index_t match_index)
     {
         /*
          * If there exists an N such that N > commitIndex, a majority
@@ -535,15 +911,10 @@ namespace raft
             return;
         }
 
-        std::vector<log_index_t>
-            match_indexs = get_peers_match_index();
+        //myself.only entries flushed to disk count
+        quorum_.update(quorum_slot_, log_manager_->sync_index());
 
-        match_indexs.push_back(last_log_index());//myself
-
-        std::sort(match_indexs.begin(), match_indexs.end());
-
-        log_index_t majority_index
-            = match_indexs[match_indexs.size() / 2];
+        log_index_t majority_index = quorum_.update(slot, match_index);
 
         if (committed_index() < majority_index)
         {
@@ -568,8 +939,13 @@ namespace raft
     {
 
         req.set_candidate(node_id());
-        req.set_last_log_index(last_log_index());
-        req.set_last_log_term(last_log_term());
+        req.set_group_id(group_id_);
+        log_index_t last_index;
+        term_t last_term;
+
+        log_manager_->last_log(last_index, last_term);
+        req.set_last_log_index(last_index);
+        req.set_last_log_term(last_term);
         req.set_term(current_term());
         logger_debug(2, 2, "req.term = %lu", req.term());
     }
@@ -666,6 +1042,12 @@ namespace raft
 
         cancel_election_timer();
 
+        {
+            //set before role.read_index() check them after role
+            acl::lock_guard lg(read_locker_);
+            elected_index_ = last_log_index();
+            read_quorum_.reset(0);
+        }
         set_role(E_LEADER);
 
         clear_vote_response();
@@ -680,6 +1062,7 @@ namespace raft
         update_peers_next_index(last_log_index() + 1);
 
         update_peers_match_index(0);
+        quorum_.reset(0);
 
         notify_peers_replicate_log();
     }
@@ -831,6 +1214,9 @@ namespace raft
         logger_debug(NODE_SECTION, 10,
                      "----do compacting log start ---------");
         std::string snapshot;
+        //one snapshot for each round.applied index may not move
+        //on,and the same snapshot discard nothing again
+        bool made = false;
 
     do_again:
         snapshot = get_snapshot();
@@ -841,6 +1227,7 @@ namespace raft
 
             if (make_snapshot())
             {
+                made = true;
                 logger_debug(NODE_SECTION, 10,
                              "make_snapshot ok. "
                              "do compacting log again");
@@ -888,13 +1275,14 @@ namespace raft
                 break;
             }
         }
-        if (!count)
+        if (!count && !made)
         {
             if (make_snapshot())
             {
                 logger_debug(NODE_SECTION, 10,
                              "make_snapshot ok. "
                              "do compacting log again");
+                made = true;
                 goto do_again;
             }
             else
@@ -910,6 +1298,10 @@ namespace raft
         logger_debug(NODE_SECTION, 10,
                      "set committed to %llu", index);
 
+        committed_index_.store(index, std::memory_order_release);
+        if (checkpoint_interval_)
+            return;
+
         if (!metadata_->set_committed_index(index))
             logger_fatal("metadata set_committed_index error");
     }
@@ -918,8 +1310,12 @@ namespace raft
     {
         unsigned int timeout = election_timeout_;
 
-        srand(static_cast<unsigned int>(time(NULL) % 0xffffffff));
-        timeout += static_cast<unsigned int>((rand() % timeout)*1.5);
+        //nodes in one process must not share the same seed
+        timeval now;
+        gettimeofday(&now, NULL);
+        unsigned int seed = static_cast<unsigned int>(
+                now.tv_sec ^ now.tv_usec ^ reinterpret_cast<size_t>(this));
+        timeout += static_cast<unsigned int>((rand_r(&seed) % timeout)*1.5);
 
         election_timer_.set_timer(timeout);
 
@@ -994,7 +1390,7 @@ namespace raft
 
     raft::log_index_t node::committed_index()
     {
-        return metadata_->get_committed_index();
+        return committed_index_.load(std::memory_order_acquire);
     }
 
     raft::log_index_t node::start_log_index()const
@@ -1070,13 +1466,17 @@ namespace raft
          * If votedFor is null or candidateId, and candidate's log is at
          * least as up-to-date as receiver's log, grant vote (5.2, 5.4)
          */
-        if (req.last_log_index() > last_log_index())
+        log_index_t last_index;
+        term_t last_term;
+
+        log_manager_->last_log(last_index, last_term);
+        if (req.last_log_index() > last_index)
         {
             resp.set_log_ok(true);
         }
-        else if (req.last_log_index() == last_log_index())
+        else if (req.last_log_index() == last_index)
         {
-            if (req.last_log_term() == log_manager_->last_term())
+            if (req.last_log_term() == last_term)
             {
                 resp.set_log_ok(true);
             }
@@ -1103,80 +1503,314 @@ namespace raft
         return true;
     }
 
-    void node::invoke_apply_callbacks()
+    /*
+     * leader and followers apply entries the same way.leader
+     * invoke replicate callbacks after entries applied
+     */
+    bool node::invoke_apply_callbacks()
     {
         log_index_t committed = committed_index();
+        log_index_t index = applied_index() + 1;
+
+        //callback after the entry has be flushed by leader
+        if (is_leader() && committed > log_manager_->sync_index())
+            committed = log_manager_->sync_index();
 
-        for (log_index_t index = applied_index() + 1;
-             index <= committed; ++index)
+        while (index <= committed)
         {
-            log_entry entry;
-            version ver;
-            if (log_manager_->read(index, entry))
+            //views point to log files.no copy of data
+            std::vector<log_entry_view> views;
+            int max_count = static_cast<int>(committed - index + 1);
+
+            if (max_count > __10000__)
+                max_count = __10000__;
+
+            if (!log_manager_->read(index, __10MB__, max_count, views))
             {
-                ver.index_ = entry.index();
-                ver.term_ = entry.term();
-                if (!(*apply_callback_)(entry.log_data(), ver))
-                {
-                    logger_error("apply_callback::operator() error");
-                    return;
-                }
-                set_applied_index(index);
-                continue;
+                logger_error("read log error");
+                return false;
+            }
+            if (views.empty())
+            {
+                logger_error("read log empty.index(%llu)", index);
+                return false;
             }
-            logger_error("read log error");
-            return;
-        }
-    }
 
-    void node::notify_replicate_failed()
-    {
-        logger_debug(ELECTION_SECTION, 2, "trace");
+            size_t count = views.size();
+            size_t applied = count;
 
-        acl::lock_guard lg(replicate_callbacks_locker_);
-        replicate_callbacks_t::iterator it = replicate_callbacks_.begin();
-        for (; it != replicate_callbacks_.end();)
-        {
-            if (!(*(it->second))(
-                replicate_callback::E_NO_LEADER, it->first))
+            if (apply_callback_)
+                applied = apply_callback_->apply_batch(&views[0], count);
+
+            //persist applied index once for the batch
+            if (applied)
             {
-                return;
+                index += applied;
+                set_applied_index(index - 1, applied);
+                serve_read_index();
             }
-        }
-    }
-    void node::invoke_replicate_callback(replicate_callback::status_t status)
-    {
-        logger_debug(NODE_SECTION, 10, "---------------------");
-        log_index_t committed = committed_index();
 
-        acl::lock_guard lg(replicate_callbacks_locker_);
+            bool freed = false;
+            for (size_t i = 0; i < applied; i++)
+            {
+                freed |= invoke_replicate_callback(views[i].index_,
+                                                   views[i].term_,
+                                                   replicate_callback::E_OK);
+            }
+            if (freed)
+                notify_pending_freed();
 
-        replicate_callbacks_t::iterator it = replicate_callbacks_.begin();
-        for (; it != replicate_callbacks_.end();)
-        {
-            if (it->first.index_ <= committed)
+            if (applied < count)
             {
-                if (!(*(it->second))(status, it->first))
-                {
-                    logger_error("replicate_callback::operator()() .error");
-                    return;
-                }
-                set_applied_index(it->first.index_);
-                replicate_callbacks_.erase(it++);
-                continue;
+                logger_error("apply_callback::apply_batch error");
+                return false;
             }
-            break;
         }
+        return true;
     }
 
-    bool node::handle_replicate_log_request(
-        const replicate_log_entries_request &req,
-        replicate_log_entries_response &resp)
+    bool node::read_index(read_index_callback *callback)
     {
-        logger_debug(NODE_SECTION, 10,
-                     "-----handle_replicate_log_request----\n"
-                     "req.term(%lu), "
-                     "req.prev_log_index(%lu),"
+        read_request req;
+
+        req.callback_ = callback;
+        req.indexed_ = false;
+        req.index_ = 0;
+        {
+            acl::lock_guard lg(read_locker_);
+            if (!is_leader())
+            {
+                logger("node is not leader .is %s",
+                       role() == E_FOLLOWER ?
+                       "follower" : "candidate");
+                return false;
+            }
+            /**
+             * committed index of new leader maybe older than
+             * the one of cluster,until it commit entries of its
+             * log when elected.serve_read_index() take it then.
+             */
+            if (committed_index() >= elected_index_)
+            {
+                req.indexed_ = true;
+                req.index_ = committed_index();
+            }
+
+            //reads before peers take the round share it
+            req.round_ = ++read_round_;
+            read_quorum_.update(quorum_slot_, req.round_);
+            read_requests_.push_back(req);
+        }
+        //request to peers as heartbeat
+        notify_peers_replicate_log();
+
+        //no peers
+        serve_read_index();
+        return true;
+    }
+
+    unsigned long long node::read_round()
+    {
+        return read_round_.load(std::memory_order_acquire);
+    }
+
+    void node::read_round_acked(int slot, unsigned long long round)
+    {
+        {
+            acl::lock_guard lg(read_locker_);
+            if (read_requests_.empty())
+                return;
+            read_quorum_.update(slot, round);
+        }
+        serve_read_index();
+    }
+
+    void node::serve_read_index()
+    {
+        std::vector<read_request> reads;
+        {
+            acl::lock_guard lg(read_locker_);
+            if (read_requests_.empty())
+                return;
+
+            unsigned long long confirmed = read_quorum_.quorum_index();
+            log_index_t committed = committed_index();
+            log_index_t applied = applied_index();
+
+            std::list<read_request>::iterator it = read_requests_.begin();
+            while (it != read_requests_.end())
+            {
+                if (!it->indexed_ && committed >= elected_index_)
+                {
+                    it->indexed_ = true;
+                    it->index_ = committed;
+                }
+                if (it->round_ > confirmed ||
+                    !it->indexed_ ||
+                    it->index_ > applied)
+                {
+                    ++it;
+                    continue;
+                }
+                reads.push_back(*it);
+                it = read_requests_.erase(it);
+            }
+        }
+        for (size_t i = 0; i < reads.size(); i++)
+        {
+            (*reads[i].callback_)(replicate_callback::E_OK,
+                                  reads[i].index_);
+        }
+    }
+
+    void node::notify_read_index_failed()
+    {
+        std::list<read_request> reads;
+        {
+            acl::lock_guard lg(read_locker_);
+            reads.swap(read_requests_);
+        }
+        for (std::list<read_request>::iterator it = reads.begin();
+             it != reads.end(); ++it)
+        {
+            (*it->callback_)(replicate_callback::E_NO_LEADER, it->index_);
+        }
+    }
+
+    void node::notify_replicate_failed()
+    {
+        logger_debug(ELECTION_SECTION, 2, "trace");
+
+        for (size_t i = 0; i < pending_callbacks_.size(); i++)
+        {
+            pending_callback &slot = pending_callbacks_[i];
+            replicate_callback *callback = slot.callback_.exchange(NULL);
+            if (!callback)
+                continue;
+
+            version ver(slot.index_, slot.term_);
+            (*callback)(replicate_callback::E_NO_LEADER, ver);
+        }
+        notify_pending_freed();
+    }
+
+    bool node::invoke_replicate_callback(log_index_t index,
+                                         term_t term,
+                                         replicate_callback::status_t status)
+    {
+        pending_callback &slot =
+            pending_callbacks_[index % pending_callbacks_.size()];
+
+        replicate_callback *callback =
+            slot.callback_.load(std::memory_order_acquire);
+        if (!callback || slot.index_ != index)
+            return false;
+
+        //notify_replicate_failed() maybe take it at the same time
+        if (!slot.callback_.compare_exchange_strong(callback, NULL))
+            return false;
+
+        //entry written by this node has been overwritten
+        if (slot.term_ != term)
+            status = replicate_callback::E_NO_LEADER;
+
+        (*callback)(status, version(index, term));
+        return true;
+    }
+
+    bool node::add_replicate_callbacks(
+        log_index_t index,
+        term_t term,
+        const std::vector<replicate_callback*> &callbacks)
+    {
+        size_t size = pending_callbacks_.size();
+        if (callbacks.size() > size)
+        {
+            logger_error("too many entries(%lu).max pending(%lu)",
+                         callbacks.size(),
+                         size);
+            return false;
+        }
+
+        for (size_t i = 0; i < callbacks.size(); i++)
+        {
+            pending_callback &slot = pending_callbacks_[(index + i) % size];
+
+            //entries not applied take all the slots
+            if (slot.callback_.load(std::memory_order_acquire))
+            {
+                acl_pthread_mutex_lock(&pending_mutex_);
+                while (slot.callback_.load() && is_leader())
+                    acl_pthread_cond_wait(&pending_cond_, &pending_mutex_);
+                acl_pthread_mutex_unlock(&pending_mutex_);
+            }
+            if (!is_leader())
+            {
+                remove_replicate_callbacks(index, i);
+                return false;
+            }
+            slot.index_ = index + i;
+            slot.term_ = term;
+            slot.callback_.store(callbacks[i], std::memory_order_release);
+        }
+        return true;
+    }
+
+    void node::remove_replicate_callbacks(log_index_t index, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            pending_callback &slot =
+                pending_callbacks_[(index + i) % pending_callbacks_.size()];
+            if (slot.index_ == index + i)
+                slot.callback_ = NULL;
+        }
+        notify_pending_freed();
+    }
+
+    void node::notify_pending_freed()
+    {
+        acl_pthread_mutex_lock(&pending_mutex_);
+        acl_pthread_cond_broadcast(&pending_cond_);
+        acl_pthread_mutex_unlock(&pending_mutex_);
+    }
+
+    /*
+     * leader skip all the entries of conflict term at once,
+     * instead of one entry each round trip
+     */
+    void node::set_conflict_term(const replicate_log_entries_request &req,
+                                 term_t term,
+                                 replicate_log_entries_response &resp)
+    {
+        log_index_t index = first_index_of_term(req.prev_log_index(), term);
+
+        resp.set_success(false);
+        resp.set_conflict_term(term);
+        resp.set_conflict_index(index);
+        //for leader not know conflict term
+        resp.set_last_log_index(index - 1);
+    }
+
+    bool node::handle_heartbeat_request(const heartbeat_request &req,
+                                        heartbeat_response &resp)
+    {
+        for (int i = 0; i < req.requests_size(); i++)
+        {
+            handle_replicate_log_request(req.requests(i),
+                                         *resp.add_responses());
+        }
+        return true;
+    }
+
+    bool node::handle_replicate_log_request(
+        const replicate_log_entries_request &req,
+        replicate_log_entries_response &resp)
+    {
+        logger_debug(NODE_SECTION, 10,
+                     "-----handle_replicate_log_request----\n"
+                     "req.term(%lu), "
+                     "req.prev_log_index(%lu),"
                      " req.prev_log_term(%lu)",
                      req.term(),
                      req.prev_log_index(),
@@ -1184,6 +1818,12 @@ namespace raft
 
 
 
+        /*
+         * leader may send requests in pipeline,
+         * handle them one by one.
+         */
+        acl::lock_guard replicate_lg(replicate_locker_);
+
         resp.set_req_id(req.req_id());
         /*currentTerm, for leader to update itself*/
         resp.set_term(current_term());
@@ -1222,7 +1862,7 @@ namespace raft
                    last_log_index());
 
             resp.set_success(false);
-
+            resp.set_conflict_index(last_log_index() + 1);
             return true;
         }
         else if (req.prev_log_index() == last_log_index())
@@ -1249,26 +1889,28 @@ namespace raft
                            req.prev_log_term(),
                            last_log_term());
 
-                    resp.set_last_log_index(req.prev_log_index() - 1);
+                    set_conflict_term(req, last_log_term(), resp);
+                    return true;
                 }
             }
         }
         else if (req.prev_log_index() >= start_log_index())
         {
-            log_entry entry;
+            //term only.no need to copy data of entry
+            log_entry_view entry;
 
             if (log_manager_->read(req.prev_log_index(), entry))
             {
                 /*
                 * check log_entry sync.
                 */
-                if (req.prev_log_term() != entry.term())
+                if (req.prev_log_term() != entry.term_)
                 {
                     logger("req.pre_log_term(%lu) != entry.term(%lu)",
                            req.prev_log_term(),
-                           entry.term());
+                           entry.term_);
 
-                    resp.set_last_log_index(req.prev_log_index() - 1);
+                    set_conflict_term(req, entry.term_, resp);
                     return true;
                 }
             }
@@ -1308,10 +1950,10 @@ namespace raft
             const log_entry &entry = req.entries(i);
             if (sync_log && entry.index() <= last_log_index())
             {
-                log_entry tmp;
+                log_entry_view tmp;
                 if (log_manager_->read(entry.index(), tmp))
                 {
-                    if (entry.term() == tmp.term())
+                    if (entry.term() == tmp.term_)
                         continue;
                     /*
                      *  If an existing entry conflicts with a new one
@@ -1355,6 +1997,16 @@ namespace raft
             set_committed_index(index);
             apply_log_.to_apply();
         }
+
+        /*
+         * entries must be flushed before reply to leader
+         */
+        if (!log_manager_->sync(last_log_index()))
+        {
+            logger_error("log_manager sync error");
+            resp.set_success(false);
+            return true;
+        }
         logger_debug(NODE_SECTION, 10, "replicate log ok");
         resp.set_last_log_index(last_log_index());
         return true;
@@ -1425,7 +2077,9 @@ namespace raft
     {
         logger_debug(ELECTION_SECTION, 10, "trace");
 
-        if (role() == E_LEADER)
+        bool leader = role() == E_LEADER;
+
+        if (leader)
         {
             notify_replicate_failed();
         }
@@ -1434,6 +2088,11 @@ namespace raft
             clear_vote_response();
         }
         set_role(E_FOLLOWER);
+
+        //read_index() after role changed return false
+        if (leader)
+            notify_read_index_failed();
+
         set_election_timer();
     }
 
@@ -1559,9 +2218,25 @@ namespace raft
             logger_warn("reload repeat");
             return true;
         }
-        log_manager_ = new mmap_log_manager(log_path_);
+        mmap_log_manager *_log_manager =
+            new mmap_log_manager(log_path_, log_format_);
+
+        _log_manager->set_verify(log_verify_, log_verify_sample_rate_);
+        log_manager_ = _log_manager;
         log_manager_->set_log_size(max_log_size_);
-        log_manager_->reload_logs();
+        log_manager_->set_sync_mode(sync_mode_,
+                                    sync_entries_,
+                                    sync_micros_);
+        log_manager_->set_cache_size(log_cache_size_);
+        if (!log_manager_->reload_logs())
+        {
+            logger_error("reload logs error.path(%s)", log_path_.c_str());
+            //no partial log.reload again from scratch
+            delete log_manager_;
+            log_manager_ = NULL;
+            return false;
+        }
+        log_manager_->set_preallocate(log_preallocate_, log_prefault_);
 
         acl_assert(!metadata_);
 
@@ -1575,6 +2250,19 @@ namespace raft
         if(peer_infos_.empty())
             peer_infos_ = metadata_->get_peer_info();
 
+        /**
+         * indexes of metadata maybe older than the ones before
+         * restart when they are checkpointed.entries applied are
+         * committed, and last snapshot has applied entries
+         * up to its index
+         */
+        log_index_t applied = std::max(metadata_->get_applied_index(),
+                                       last_snapshot_index());
+        log_index_t committed = std::max(metadata_->get_committed_index(),
+                                         applied);
+        applied_index_.store(applied, std::memory_order_release);
+        committed_index_.store(committed, std::memory_order_release);
+
         metadata_->print_status();
 
         return true;
@@ -1583,12 +2271,20 @@ namespace raft
     {
         init_peers();
 
-        apply_log_.start();
+        //entries committed before restart
+        apply_log_.to_apply();
 
-        log_compaction_worker_.start();
+        if (log_writer_.enabled())
+        {
+            log_flusher_.start();
+            log_writer_.start();
+        }
 
         set_election_timer();
 
+        if (checkpoint_interval_)
+            checkpoint_timer_.start();
+
         if(!peer_infos_.empty())
             metadata_->set_peer_infos(peer_infos_);
     }
@@ -1665,24 +2361,38 @@ namespace raft
         last_snapshot_term_ = term;
     }
 
-    void node::make_log_entry(const std::string &data, log_entry &entry)
+    bool node::write_entries(std::vector<log_entry> &entries,
+                             const std::vector<replicate_callback*> &callbacks,
+                             log_index_t &index)
     {
+        acl::lock_guard lg(write_locker_);
+
         term_t term = current_term();
+        log_index_t first = last_log_index() + 1;
 
-        entry.set_term(term);
-        entry.set_log_data(data);
-        entry.set_type(e_raft_log);
+        if (!add_replicate_callbacks(first, term, callbacks))
+            return false;
+
+        if (!write_logs(entries, index, term))
+        {
+            remove_replicate_callbacks(first, callbacks.size());
+            return false;
+        }
+        return true;
     }
 
-    bool node::write_log(const std::string &data,
-                         log_index_t &index, term_t &term)
+    bool node::write_logs(std::vector<log_entry> &entries,
+                          log_index_t &index, term_t &term)
     {
+        term_t current = current_term();
 
-        log_entry entry;
-
-        make_log_entry(data, entry);
-        index = log_manager_->write(entry);
-        term = entry.term();
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            entries[i].set_term(current);
+            entries[i].set_type(e_raft_log);
+        }
+        index = log_manager_->write(entries);
+        term = entries.back().term();
 
         if (!index)
         {
@@ -1700,6 +2410,11 @@ namespace raft
     {
         acl::lock_guard lg(peers_locker_);
 
+        quorum_.clear();
+        quorum_slot_ = quorum_.add_member();
+        read_quorum_.clear();
+        acl_assert(read_quorum_.add_member() == quorum_slot_);
+
         for (size_t i = 0; i < peer_infos_.size(); ++i)
         {
             if (peers_.find(peer_infos_[i].peer_id_) == peers_.end())
@@ -1717,144 +2432,388 @@ namespace raft
         {
             it->second->set_match_index(last_log_index());
             it->second->set_next_index(last_log_index());
+            it->second->set_max_inflight(max_inflight_);
+            int slot = quorum_.add_member();
+            acl_assert(read_quorum_.add_member() == slot);
+            it->second->set_quorum_slot(slot);
             it->second->start();
         }
     }
-    void node::add_replicate_callback(const version& version,
-                                      replicate_callback* callback)
+    node::apply_log::apply_log(node& _node)
+        :node_(_node),
+        retry_delay_(0)
     {
-        acl::lock_guard lg(replicate_callbacks_locker_);
-        replicate_callbacks_[version] = callback;
     }
 
-    node::apply_log::apply_log(node& _node)
+    node::apply_log::~apply_log()
+    {
+        stop();
+    }
+
+    void node::apply_log::stop()
+    {
+        //wait for the running one done
+        node_.get_background_scheduler().remove(this);
+    }
+
+    void node::apply_log::to_apply()
+    {
+        logger_debug(NODE_SECTION, 10,
+                     "committed_index(%llu)",
+                     node_.committed_index());
+
+        node_.get_background_scheduler().schedule(this);
+    }
+
+    void node::apply_log::run()
+    {
+        //read or apply callback failed.back off the retry
+        if (!node_.invoke_apply_callbacks())
+        {
+            retry_delay_ = retry_delay_ ? retry_delay_ * 2 : 1;
+            if (retry_delay_ > __APPLY_RETRY_MAX__)
+                retry_delay_ = __APPLY_RETRY_MAX__;
+            node_.get_background_scheduler().set_timer(this, retry_delay_);
+            return;
+        }
+        retry_delay_ = 0;
+
+        //leader's entries committed before flushed.try again later
+        if (node_.applied_index() < node_.committed_index())
+            node_.get_background_scheduler().set_timer(this, 1);
+    }
+
+    node::log_writer::log_writer(node &_node)
         :node_(_node),
-        to_stop_(false)
+        enabled_(false),
+        to_stop_(false),
+        max_count_(0),
+        max_bytes_(0),
+        linger_micros_(0),
+        head_(NULL),
+        waiting_(false)
     {
         acl_pthread_mutex_init(&mutex_, NULL);
         acl_pthread_cond_init(&cond_, NULL);
     }
 
-    node::apply_log::~apply_log()
+    node::log_writer::~log_writer()
     {
+        stop();
+        acl_pthread_mutex_destroy(&mutex_);
+        acl_pthread_cond_destroy(&cond_);
+    }
+
+    void node::log_writer::set_limits(size_t max_count,
+                                      size_t max_bytes,
+                                      unsigned int linger_micros)
+    {
+        max_count_ = max_count;
+        max_bytes_ = max_bytes;
+        linger_micros_ = linger_micros;
+        enabled_ = max_count_ > 0;
+    }
+
+    bool node::log_writer::enabled() const
+    {
+        return enabled_;
+    }
+
+    void node::log_writer::stop()
+    {
+        if (!enabled_)
+            return;
+
         acl_pthread_mutex_lock(&mutex_);
+        if (to_stop_)
+        {
+            acl_pthread_mutex_unlock(&mutex_);
+            return;
+        }
         to_stop_ = true;
         acl_pthread_cond_signal(&cond_);
         acl_pthread_mutex_unlock(&mutex_);
 
         //wait thread;
         wait();
-        acl_pthread_mutex_destroy(&mutex_);
-        acl_pthread_cond_destroy(&cond_);
     }
 
-    void node::apply_log::to_apply()
+    void node::log_writer::push(replicate_req *req)
     {
-        logger_debug(NODE_SECTION, 10,
-                     "committed_index(%llu)",
-                     node_.committed_index());
+        replicate_req *head = head_.load();
+        do
+        {
+            req->next_ = head;
+        } while (!head_.compare_exchange_weak(head, req));
+
+        //only wake up log writer when it is sleeping
+        if (waiting_.load())
+        {
+            acl_pthread_mutex_lock(&mutex_);
+            acl_pthread_cond_signal(&cond_);
+            acl_pthread_mutex_unlock(&mutex_);
+        }
+    }
 
+    bool node::log_writer::wait_for_reqs(const timespec *timeout)
+    {
         acl_pthread_mutex_lock(&mutex_);
-        acl_pthread_cond_signal(&cond_);
+
+        waiting_.store(true);
+        while (!head_.load() && !to_stop_)
+        {
+            if (!timeout)
+            {
+                acl_pthread_cond_wait(&cond_, &mutex_);
+                continue;
+            }
+            if (acl_pthread_cond_timedwait(&cond_, &mutex_, timeout)
+                == ACL_ETIMEDOUT)
+                break;
+        }
+        waiting_.store(false);
+
+        bool has_reqs = head_.load() != NULL;
         acl_pthread_mutex_unlock(&mutex_);
+        return has_reqs;
     }
 
-    bool node::apply_log::wait_to_apply()
+    size_t node::log_writer::take_reqs(std::vector<replicate_req*> &reqs)
     {
+        size_t bytes = 0;
+        size_t begin = reqs.size();
+        replicate_req *req = head_.exchange(NULL);
 
-        acl_pthread_mutex_lock(&mutex_);
+        //queue is lifo,reverse it to the order of push
+        for (; req; req = req->next_)
+        {
+            reqs.push_back(req);
+            bytes += req->data_.size();
+        }
+        std::reverse(reqs.begin() + begin, reqs.end());
+        return bytes;
+    }
 
-        while (node_.applied_index() ==
-               node_.committed_index() && !to_stop_)
+    void node::log_writer::write_reqs(std::vector<replicate_req*> &reqs)
+    {
+        std::vector<log_entry> entries;
+        std::vector<replicate_callback*> callbacks;
+
+        for (size_t i = 0; i < reqs.size();)
         {
-            acl_pthread_cond_wait(&cond_, &mutex_);
+            size_t bytes = 0;
+
+            entries.clear();
+            callbacks.clear();
+
+            for (; i < reqs.size() && entries.size() < max_count_ &&
+                   (bytes < max_bytes_ || entries.empty()); i++)
+            {
+                bytes += reqs[i]->data_.size();
+                entries.push_back(log_entry());
+                entries.back().mutable_log_data()->swap(reqs[i]->data_);
+                callbacks.push_back(reqs[i]->callback_);
+            }
+
+            bool kept = false;
+            log_index_t written = 0;
+
+            //flusher flushes it while the next batch writing
+            if (node_.replicate_entries(entries, callbacks, kept, &written))
+                node_.log_flusher_.flush(written - entries.size() + 1,
+                                         written);
+            else if (!kept)
+            {
+                replicate_callback::status_t status =
+                    node_.is_leader() ? replicate_callback::E_ERROR :
+                    replicate_callback::E_NO_LEADER;
+
+                for (size_t j = 0; j < callbacks.size(); j++)
+                {
+                    (*callbacks[j])(status, version());
+                }
+            }
         }
-        acl_pthread_mutex_unlock(&mutex_);
-        return !to_stop_;
+
+        for (size_t i = 0; i < reqs.size(); i++)
+        {
+            delete reqs[i];
+        }
+        reqs.clear();
     }
 
-    void* node::apply_log::run()
+    void *node::log_writer::run()
     {
-        while (wait_to_apply())
+        std::vector<replicate_req*> reqs;
+
+        while (wait_for_reqs(NULL))
         {
-            if (node_.is_leader())
-                node_.invoke_replicate_callback(
-                    replicate_callback::E_OK);
-            else
-                node_.invoke_apply_callbacks();
+            size_t bytes = take_reqs(reqs);
+
+            if (linger_micros_ && reqs.size() < max_count_ &&
+                bytes < max_bytes_)
+            {
+                timeval now;
+                timespec timeout;
+
+                gettimeofday(&now, NULL);
+                timeout.tv_sec = now.tv_sec + linger_micros_ / 1000000;
+                timeout.tv_nsec = (now.tv_usec +
+                                   linger_micros_ % 1000000) * 1000;
+                if (timeout.tv_nsec >= 1000000000)
+                {
+                    timeout.tv_sec += 1;
+                    timeout.tv_nsec -= 1000000000;
+                }
+
+                //linger for more requests to write in one batch
+                while (reqs.size() < max_count_ && bytes < max_bytes_ &&
+                       wait_for_reqs(&timeout))
+                {
+                    bytes += take_reqs(reqs);
+                }
+            }
+            write_reqs(reqs);
+        }
+
+        //stop.replicate requests remain in queue failed
+        take_reqs(reqs);
+        for (size_t i = 0; i < reqs.size(); i++)
+        {
+            (*reqs[i]->callback_)(replicate_callback::E_ERROR, version());
+            delete reqs[i];
         }
         return NULL;
     }
 
-    node::log_compaction::log_compaction(node &_node)
+    node::log_flusher::log_flusher(node &_node)
         :node_(_node),
-        do_compact_log_(false),
-        stop_(false)
+        to_stop_(false),
+        first_index_(0),
+        last_index_(0)
     {
         acl_pthread_mutex_init(&mutex_, NULL);
         acl_pthread_cond_init(&cond_, NULL);
     }
 
-    node::log_compaction::~log_compaction()
+    node::log_flusher::~log_flusher()
     {
+        stop();
+        acl_pthread_mutex_destroy(&mutex_);
+        acl_pthread_cond_destroy(&cond_);
+    }
+
+    void node::log_flusher::stop()
+    {
+        //started with log writer
+        if (!node_.log_writer_.enabled())
+            return;
+
         acl_pthread_mutex_lock(&mutex_);
-        stop_ = true;
-        acl_pthread_cond_wait(&cond_, &mutex_);
+        if (to_stop_)
+        {
+            acl_pthread_mutex_unlock(&mutex_);
+            return;
+        }
+        to_stop_ = true;
+        acl_pthread_cond_signal(&cond_);
         acl_pthread_mutex_unlock(&mutex_);
 
-        //wait compaction thread exist safely
-        wait(NULL);
+        //wait thread;
+        wait();
     }
 
-    void* node::log_compaction::run()
+    void node::log_flusher::flush(log_index_t first, log_index_t last)
     {
-        do
+        acl_pthread_mutex_lock(&mutex_);
+        //merge with the entries not flushed yet
+        if (!first_index_)
+            first_index_ = first;
+        last_index_ = last;
+        acl_pthread_cond_signal(&cond_);
+        acl_pthread_mutex_unlock(&mutex_);
+    }
+
+    void *node::log_flusher::run()
+    {
+        while (true)
         {
             acl_pthread_mutex_lock(&mutex_);
-
-            //wait for do compaction event
-            while (!stop_ && !node_.should_compact_log())
+            while (!first_index_ && !to_stop_)
                 acl_pthread_cond_wait(&cond_, &mutex_);
 
+            //flush the written ones before stop
+            if (!first_index_)
+            {
+                acl_pthread_mutex_unlock(&mutex_);
+                break;
+            }
+            log_index_t first = first_index_;
+            log_index_t index = last_index_;
+            first_index_ = 0;
             acl_pthread_mutex_unlock(&mutex_);
 
-            if (stop_)
-                break;
+            /**
+             * flush all entries written while the last flush
+             * running in one go.no group wait,log writer is the
+             * only writer and doesn't write more while waiting.
+             */
+            if (!node_.sync_log(index, false))
+                node_.sync_log_failed(first, index);
+        }
+        return NULL;
+    }
 
-            logger("++++++++[ start log compaction ]++++++");
-            node_.do_compaction_log();
-            logger("++++++++[ start log compaction end ]+++");
+    node::log_compaction::log_compaction(node &_node)
+        :node_(_node)
+    {
+    }
 
-        } while (!stop_);
+    node::log_compaction::~log_compaction()
+    {
+        stop();
+    }
 
-        return NULL;
+    void node::log_compaction::stop()
+    {
+        //wait for compaction running done
+        node_.get_background_scheduler().remove(this);
+    }
+
+    void node::log_compaction::run()
+    {
+        if (!node_.should_compact_log())
+            return;
+
+        logger("++++++++[ start log compaction ]++++++");
+        node_.do_compaction_log();
+        logger("++++++++[ start log compaction end ]+++");
     }
 
     void node::log_compaction::do_compact_log()
     {
-        acl_pthread_mutex_lock(&mutex_);
-        acl_pthread_cond_signal(&cond_);
-        acl_pthread_mutex_unlock(&mutex_);
+        node_.get_background_scheduler().schedule(this);
     }
 
     node::election_timer::election_timer(node &_node)
         :node_(_node),
-        stop_(false),
         cancel_(true),
         delay_(3600 * 1000)
     {
+        gettimeofday(&deadline_, NULL);
         acl_pthread_mutex_init(&mutex_, NULL);
-        acl_pthread_cond_init(&cond_, NULL);
-        start();
     }
 
     node::election_timer::~election_timer()
     {
-        stop_ = true;
-        cancel_timer();
-        wait();
+        stop();
         acl_pthread_mutex_destroy(&mutex_);
-        acl_pthread_cond_destroy(&cond_);
+    }
+
+    void node::election_timer::stop()
+    {
+        //wait for the running one done.never fire again
+        node_.get_scheduler().remove(this);
     }
 
     void node::election_timer::cancel_timer()
@@ -1862,8 +2821,7 @@ namespace raft
         logger("cancel timer ");
         acl_pthread_mutex_lock(&mutex_);
         cancel_ = true;
-        delay_ = 1000 * 60;
-        acl_pthread_cond_broadcast(&cond_);
+        node_.get_scheduler().cancel_timer(this);
         acl_pthread_mutex_unlock(&mutex_);
     }
 
@@ -1873,41 +2831,64 @@ namespace raft
         acl_pthread_mutex_lock(&mutex_);
         delay_ = delay;
         cancel_ = false;
-        acl_pthread_cond_broadcast(&cond_);
+        gettimeofday(&deadline_, NULL);
+        deadline_.tv_sec += delay / 1000;
+        deadline_.tv_usec += (delay % 1000) * 1000;
+        node_.get_scheduler().set_timer(this, delay);
         acl_pthread_mutex_unlock(&mutex_);
     }
 
-    void *node::election_timer::run()
+    void node::election_timer::run()
     {
-        logger("election timer to start run");
-
-        timespec timeout;
         timeval now;
+        gettimeofday(&now, NULL);
 
-        while (!stop_)
+        acl_assert(!acl_pthread_mutex_lock(&mutex_));
+        long long late =
+            (now.tv_sec - deadline_.tv_sec) * 1000000LL +
+            (now.tv_usec - deadline_.tv_usec);
+
+        if (cancel_ || late < 0)
         {
-            gettimeofday(&now, NULL);
-            timeout.tv_sec = now.tv_sec;
-            timeout.tv_nsec = now.tv_usec * 1000;
-            timeout.tv_sec += delay_ / 1000;
-            timeout.tv_nsec += (delay_ % 1000) * 1000 * 1000;
+            acl_assert(!acl_pthread_mutex_unlock(&mutex_));
+            return;
+        }
+        //fire again after delay_ if no one set timer
+        deadline_ = now;
+        deadline_.tv_sec += delay_ / 1000;
+        deadline_.tv_usec += (delay_ % 1000) * 1000;
+        node_.get_scheduler().set_timer(this, delay_);
+        acl_assert(!acl_pthread_mutex_unlock(&mutex_));
 
-            acl_assert(!acl_pthread_mutex_lock(&mutex_));
-            int status = acl_pthread_cond_timedwait(
-                    &cond_,
-                    &mutex_,
-                    &timeout);
+        node_.election_timer_callback();
+    }
 
-            if (cancel_ || status != ACL_ETIMEDOUT)
-            {
-                acl_assert(!acl_pthread_mutex_unlock(&mutex_));
-                continue;
-            }
-            acl_assert(!acl_pthread_mutex_unlock(&mutex_));
+    node::checkpoint_timer::checkpoint_timer(node &_node)
+        :node_(_node)
+    {
+    }
 
-            node_.election_timer_callback();
-        }
+    node::checkpoint_timer::~checkpoint_timer()
+    {
+        stop();
+    }
 
-        return NULL;
+    void node::checkpoint_timer::start()
+    {
+        node_.get_background_scheduler().set_timer(
+            this, node_.checkpoint_interval_);
+    }
+
+    void node::checkpoint_timer::stop()
+    {
+        node_.get_background_scheduler().remove(this);
+    }
+
+    void node::checkpoint_timer::run()
+    {
+        //msync metadata.keep disk io off the peer scheduler
+        node_.checkpoint_indexes();
+        node_.get_background_scheduler().set_timer(
+            this, node_.checkpoint_interval_);
     }
 }
@@ -2,15 +2,21 @@
 #define  __1MB__      (1024 * 1024)
 #define TO_REPLICATE  0x01
 #define TO_ELECTION   0x02
-#define TO_STOP       0x04
+#define HEARTBEAT_DONE 0x04
+#define REPLICATE_DONE 0x08
+#define VOTE_DONE      0x10
+#define SNAPSHOT_DONE  0x20
 
 #define SET_TO_REPLICATE(e)   (e |= TO_REPLICATE)
 #define SET_TO_ELECTION(e)    (e |= TO_ELECTION)
-#define SET_TO_STOP(e)        (e |= TO_STOP)
+#define SET_HEARTBEAT_DONE(e) (e |= HEARTBEAT_DONE)
 
 #define IS_TO_REPLICATE(e)    (e & TO_REPLICATE)
-#define IS_TO_STOP(e)         (e & TO_STOP)
 #define IS_TO_ELECTION(e)     (e & TO_ELECTION)
+#define IS_HEARTBEAT_DONE(e)  (e & HEARTBEAT_DONE)
+#define IS_REPLICATE_DONE(e)  (e & REPLICATE_DONE)
+#define IS_VOTE_DONE(e)       (e & VOTE_DONE)
+#define IS_SNAPSHOT_DONE(e)   (e & SNAPSHOT_DONE)
 
 #define PEER_SECTION 10
 
@@ -22,35 +28,36 @@ namespace raft
                const std::string &peer_id,
                const std::string &addr)
 		:node_(_node),
+         scheduler_(_node.get_scheduler()),
          peer_id_(peer_id),
          match_index_(0),
          next_index_(0),
          event_(0),
-         heart_inter_(3000),
-         rpc_client_(acl::http_rpc_client::get_instance()),
+         heart_inter_(_node.election_timeout()),
+         transport_(_node.get_transport()),
          rpc_fails_(0),
-         req_id_(1)
+         req_id_(1),
+         quorum_slot_(-1),
+         read_round_(0),
+         heartbeat_batcher_(_node.get_heartbeat_batcher()),
+         heartbeat_inflight_(false),
+         heartbeat_ok_(false),
+         heartbeat_index_(0),
+         heartbeat_read_round_(0),
+         max_inflight_(1),
+         stale_req_id_(0),
+         replicate_term_(0),
+         entry_size_(1),
+         vote_call_(*this),
+         vote_again_(false),
+         snapshot_call_(*this),
+         calls_(0)
 	{
-		//server_id/raft/interface
-		replicate_service_path_.format(
-			"/memkv%s/raft/replicate_log_req", peer_id_.c_str());
-
-
-		install_snapshot_service_path_.format(
-			"/memkv%s/raft/install_snapshot_req", peer_id_.c_str());
-
-
-        election_service_path_.format(
-                "/memkv%s/raft/vote_req", peer_id_.c_str());
-
-        //init rpc_client;
-        rpc_client_.add_service(addr.c_str(), install_snapshot_service_path_);
-        rpc_client_.add_service(addr.c_str(), replicate_service_path_);
-        rpc_client_.add_service(addr.c_str(), election_service_path_);
+        transport_.add_peer(peer_id_, addr);
 
 		//send heartbeat to sync log index first
 		acl_pthread_mutex_init(&mutex_, NULL);
-		acl_pthread_cond_init(&cond_, NULL);
+		acl_pthread_cond_init(&calls_cond_, NULL);
 
         //init last_replicate_time_
         gettimeofday(&last_heartbeat_time_, NULL);
@@ -60,35 +67,66 @@ namespace raft
     }
 	peer::~peer()
 	{
-		//notify thread to stop
-		notify_stop();
-		wait();
+		//wait for the running task done
+		scheduler_.remove(this);
+		if (heartbeat_batcher_)
+			heartbeat_batcher_->remove(this);
+
+		//callbacks of async calls touch peer
+		acl_pthread_mutex_lock(&mutex_);
+		while (calls_)
+			acl_pthread_cond_wait(&calls_cond_, &mutex_);
+		acl_pthread_mutex_unlock(&mutex_);
+
+		//calls in done_ are in inflight_ too
+		std::map<size_t, replicate_call*>::iterator it = inflight_.begin();
+		for (; it != inflight_.end(); ++it)
+			delete it->second;
+		for (size_t i = 0; i < free_calls_.size(); i++)
+			delete free_calls_[i];
+
+		acl_pthread_mutex_destroy(&mutex_);
+		acl_pthread_cond_destroy(&calls_cond_);
 	}
     void peer::start()
     {
-        acl::thread::start();
+        //requests are sent by async calls of transport.
+        //nothing to start
     }
-	void peer::notify_replicate()
+
+	void peer::set_max_inflight(size_t count)
 	{
-		acl_pthread_mutex_lock(&mutex_);
-		if (!IS_TO_REPLICATE(event_))
+		//requests wait for each other in transport.no overlap
+		if (count > 1 && !transport_.pipeline())
 		{
-			SET_TO_REPLICATE(event_);
-			acl_pthread_cond_signal(&cond_);
+			logger_warn("transport not pipeline.peer %s stop-and-wait",
+						peer_id_.c_str());
+			count = 1;
 		}
+		max_inflight_ = count ? count : 1;
+	}
+	void peer::set_quorum_slot(int slot)
+	{
+		quorum_slot_ = slot;
+	}
+
+	void peer::notify_replicate()
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		SET_TO_REPLICATE(event_);
 		acl_pthread_mutex_unlock(&mutex_);
 
+		scheduler_.schedule(this);
+
 	}
 
 	void peer::notify_election()
 	{
 		acl_pthread_mutex_lock(&mutex_);
-		if (!IS_TO_ELECTION(event_))
-		{
-			SET_TO_ELECTION(event_);
-			acl_pthread_cond_signal(&cond_);
-		}
+		SET_TO_ELECTION(event_);
 		acl_pthread_mutex_unlock(&mutex_);
+
+		scheduler_.schedule(this);
 	}
 	void peer::set_next_index(log_index_t index)
 	{
@@ -108,233 +146,490 @@ namespace raft
 		return match_index_;
 	}
 
-	void* peer::run()
+	void peer::run()
 	{
-		int event = 0;
-		while(wait_event(event))
+		int event = take_event();
+		//send one replicate request at least
+		bool heartbeat = false;
+
+		logger_debug(PEER_SECTION, 10, "event:%x", event);
+
+		//requests sent in the old term are stale
+		term_t term = node_.current_term();
+		if (term != replicate_term_)
 		{
-            logger_debug(PEER_SECTION, 10, "event:%x", event);
-			if (IS_TO_REPLICATE(event) && node_.is_leader())
-			{
-				do_replicate();
-			}
+			replicate_term_ = term;
+			stale_req_id_ = req_id_;
+			entry_size_ = 1;
+		}
 
-			if (IS_TO_ELECTION(event))
+		if (IS_HEARTBEAT_DONE(event))
+			do_heartbeat_done(event);
+
+		if (IS_REPLICATE_DONE(event))
+			do_replicate_done(event, heartbeat);
+
+		if (IS_SNAPSHOT_DONE(event))
+			do_snapshot_done(event);
+
+		if (IS_VOTE_DONE(event))
+			do_vote_done(event);
+
+		/*
+		 * check_heartbeat() for repeat during idle
+		 * periods to prevent election timeouts (5.2)
+		 */
+		//no heartbeat if replicate requests sent in heart_inter_
+		if (node_.is_leader() && heartbeat_delay() == 0)
+		{
+			logger_debug(PEER_SECTION, 10,
+						 "time to send heartbeat msg");
+
+			if (!heartbeat_batcher_ ||
+				IS_TO_REPLICATE(event) ||
+				!send_heartbeat())
 			{
-				do_election();
+				SET_TO_REPLICATE(event);
+				heartbeat = true;
 			}
 		}
-		return NULL;
+
+		if ((IS_TO_REPLICATE(event) || heartbeat) && node_.is_leader())
+		{
+			do_replicate(heartbeat);
+		}
+
+		if (IS_TO_ELECTION(event))
+		{
+			do_election();
+		}
+
+		//wake up for next heartbeat
+		if (node_.is_leader())
+		{
+			long long delay = heartbeat_delay();
+			scheduler_.set_timer(this, delay ? (unsigned int)delay : 1);
+		}
 	}
 
-	bool peer::do_install_snapshot()
+	void peer::begin_call()
 	{
-        logger_debug(PEER_SECTION,10,"trace");
+		acl_pthread_mutex_lock(&mutex_);
+		calls_++;
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	void peer::call_done(int event)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		event_ |= event;
+		calls_--;
+		//not run again if peer is destroying
+		scheduler_.schedule(this);
+		acl_pthread_cond_broadcast(&calls_cond_);
+		acl_pthread_mutex_unlock(&mutex_);
+	}
 
-		typedef acl::http_rpc_client::status_t status_t;
+	/*
+	 * open the last snapshot and send it chunk by chunk.
+	 * one chunk in flight,and the next one sent when the
+	 * response come back.replicate requests wait for it done.
+	 */
+	void peer::do_install_snapshot()
+	{
+        logger_debug(PEER_SECTION,10,"trace");
 
+		snapshot_call &call = snapshot_call_;
 		std::string file_path = node_.get_snapshot();
-		acl::ifstream file;
 		version ver;
 
 		if (file_path.empty())
 		{
 			logger_error("get snapshot failed");
-			return false;
+			return;
 		}
-		if (!file.open_read(file_path.c_str()))
+		if (!call.file_.open_read(file_path.c_str()))
 		{
 			logger_error("open file snapshot failed");
-			return false;
+			return;
 		}
 
-        long long int file_size =  file.fsize();
+        call.file_size_ = call.file_.fsize();
 
-        if (!read(file, ver))
+        if (!read(call.file_, ver))
 		{
 			logger_error("snapshot read version failed.");
-			return false;
+			call.file_.close();
+			return;
 		}
+		call.last_term_ = ver.term_;
+		call.last_index_ = ver.index_;
+
+        logger("snapshot file size(%lld)", call.file_size_);
 
-		long long int offset = 0;
+		call.active_ = true;
+		send_snapshot_chunk(0);
+	}
 
-        logger("snapshot file size(%lld)", file_size);
+	void peer::send_snapshot_chunk(long long offset)
+	{
+		snapshot_call &call = snapshot_call_;
 
-		while (node_.is_leader())
+		if (call.file_.fseek(offset, SEEK_SET) == -1)
 		{
-            if (file.fseek(offset, SEEK_SET) == -1)
-			{
-				logger_error("file fseek error.%s",
-                             acl::last_serror());
-				return false;
-			}
+			logger_error("file fseek error.%s",
+						 acl::last_serror());
+			stop_install_snapshot();
+			return;
+		}
+
+		install_snapshot_request &req = call.req_;
+		std::string *data = req.mutable_data();
+		data->resize(__1MB__);
 
-            char *buffer = new char [__1MB__];
+		int bytes = call.file_.read(&(*data)[0], __1MB__, false);
+		if (bytes == -1)
+		{
+			logger_fatal("file read error. %s",
+						 acl::last_serror());
+		}
+		data->resize((size_t)bytes);
+		bool done = call.file_size_ == (bytes + offset);
 
-			int bytes = file.read(buffer, __1MB__, false);
-            if(bytes == -1)
-            {
-                logger_fatal("file read error. %s",
-                             acl::last_serror());
-            }
-			bool done = file_size == (bytes + offset);
+		req.set_term(node_.current_term());
+		req.set_done(done);
+		req.set_offset((size_t)offset);
+		req.set_leader_id(node_.node_id());
+		req.set_group_id(node_.group_id());
 
-			install_snapshot_request req;
-			install_snapshot_response resp;
+		req.mutable_snapshot_info()->
+			set_last_included_term(call.last_term_);
 
-            req.set_term(node_.current_term());
-			req.set_data(buffer, (size_t)bytes);
-			req.set_done(done);
-			req.set_offset((size_t)offset);
-			req.set_leader_id(node_.node_id());
+		req.mutable_snapshot_info()->
+			set_last_snapshot_index(call.last_index_);
 
-			req.mutable_snapshot_info()->
-				set_last_included_term(ver.term_);
+		logger("data size(%d)", bytes);
 
-            req.mutable_snapshot_info()->
-				set_last_snapshot_index(ver.index_);
+		gettimeofday(&last_heartbeat_time_, NULL);
 
-            logger("data size(%d)", bytes);
+		call.resp_.Clear();
+		call.inflight_ = true;
+		begin_call();
+		transport_.async_install_snapshot(peer_id_,
+										  call.req_,
+										  call.resp_,
+										  &call);
+	}
 
-            delete []buffer;
+	void peer::do_snapshot_done(int &event)
+	{
+		snapshot_call &call = snapshot_call_;
+		call.inflight_ = false;
 
-            gettimeofday(&last_heartbeat_time_, NULL);
+		if (!call.active_)
+			return;
 
-			status_t status = rpc_client_.pb_call(
-				install_snapshot_service_path_,
-				req,
-				resp);
-			if (!status)
-			{
-				logger_error("proto_call error,%s",
-					status.error_str_.c_str());
-				return false;
-			}
-			if (node_.current_term() < resp.term())
-			{
-				logger("receive new term.%zd",resp.term());
-				node_.handle_new_term(resp.term());
-				return false;
-			}
-			offset = (long long int) resp.bytes_stored();
-			//done
-			if (offset == file_size)
-			{
-				//update next_index
-				next_index_ = ver.index_ + 1;
-				match_index_ = ver.index_;
-				logger("send snapshot done");
-				return true;
-			}
+		if (!node_.is_leader() ||
+			call.req_.term() != node_.current_term())
+		{
+			stop_install_snapshot();
+			return;
+		}
+		if (!call.ok_)
+		{
+			logger_error("send install_snapshot_request error");
+			rpc_fails_++;
+			stop_install_snapshot();
+			return;
+		}
+		if (node_.current_term() < call.resp_.term())
+		{
+			logger("receive new term.%zd", call.resp_.term());
+			node_.handle_new_term(call.resp_.term());
+			stop_install_snapshot();
+			return;
+		}
+		long long offset = (long long) call.resp_.bytes_stored();
+		//done
+		if (offset == call.file_size_)
+		{
+			//update next_index
+			next_index_ = call.last_index_ + 1;
+			match_index_ = call.last_index_;
+			logger("send snapshot done");
+			stop_install_snapshot();
+			SET_TO_REPLICATE(event);
+			return;
 		}
-		return false;
+		send_snapshot_chunk(offset);
+	}
+
+	void peer::stop_install_snapshot()
+	{
+		snapshot_call_.active_ = false;
+		snapshot_call_.file_.close();
+		//keep memory of data for next time
+		snapshot_call_.req_.Clear();
 	}
+
 	/*
 	 *If last log index  nextIndex for a follower: send
 	 *AppendEntries RPC with log entries starting at nextIndex
 	 *If successful: update nextIndex and matchIndex for follower (��5.3)
 	 *If AppendEntries fails because of log inconsistency:
 	 *decrement nextIndex and retry (��5.3)
+	 *
+	 * send up to max_inflight_ requests without waiting for
+	 * responses.next_index_ move forward when a request be sent,
+	 * and roll back when rejected.requests are posted in order
+	 * from this task only,so peer receive them in order and no
+	 * one rejected because the one before it not arrive yet.
 	 */
-
-    void peer::do_replicate()
+    void peer::do_replicate(bool heartbeat)
 	{
-		int entry_size = 1;
+		//snapshot first
+		if (snapshot_call_.active_)
+			return;
 
-		while (node_.is_leader())
+		while (node_.is_leader() &&
+			   inflight_.size() < max_inflight_ &&
+			   (heartbeat || next_index_ <= node_.last_log_index()))
 		{
-			replicate_log_entries_request req;
-			replicate_log_entries_response resp;
-			acl::http_rpc_client::status_t status;
+			//find the match index of peer first.one request
+			//in flight until it come back
+			if (entry_size_ == 1 &&
+				inflight_.upper_bound(stale_req_id_) != inflight_.end())
+			{
+				break;
+			}
+
+			replicate_call *call = new_replicate_call();
 
             logger_debug(PEER_SECTION, 10,
                          "next_index_(%llu)",
                          next_index_);
+
+			int count = 0;
 			if (!node_.build_replicate_log_request(
-				req,
+				call->req_,
+				call->body_,
 				next_index_,
-				entry_size))
+				entry_size_,
+				count))
 			{
+				free_replicate_call(call);
+				//wait for requests in flight first
+				if (!inflight_.empty())
+					break;
+
 				logger_debug(PEER_SECTION, 10,
-                             "build_replicate_log_request "
-                             "failed. next_index_:%llu",
-                             next_index_);
+							 "build_replicate_log_request "
+							 "failed. next_index_:%llu",
+							 next_index_);
 
-				if (!do_install_snapshot())
-				{
-					logger_error("do_install_snapshot error.");
-					break;
-				}
-				continue;
+				do_install_snapshot();
+				break;
 			}
-
-            gettimeofday(&last_heartbeat_time_, NULL);
+			heartbeat = false;
 
             logger_debug(PEER_SECTION, 10,
                          "term(%lu) "
                          "prev_log_term(%lu) "
                          "prev_log_index(%lu)",
-                         req.term(),
-                         req.prev_log_term(),
-                         req.prev_log_index());
+                         call->req_.term(),
+                         call->req_.prev_log_term(),
+                         call->req_.prev_log_index());
+
+			call->last_index_ = call->req_.prev_log_index() + count;
+
+			call->req_.set_req_id(++req_id_);
+			//fields after entries.parsed the same as in order
+			call->req_.AppendToString(&call->body_);
+			call->read_round_ = node_.read_round();
+			inflight_[req_id_] = call;
+
+			//move forward before response come back
+			next_index_ = call->last_index_ + 1;
+
+			gettimeofday(&last_heartbeat_time_, NULL);
+			begin_call();
+			transport_.async_replicate(peer_id_,
+									   call->body_,
+									   call->resp_,
+									   call);
+		}
 
-            req.set_req_id(++req_id_);
+		//requests in flight keep peer alive
+		if (heartbeat && !inflight_.empty())
+			gettimeofday(&last_heartbeat_time_, NULL);
+	}
+
+	void peer::do_replicate_done(int &event, bool &heartbeat)
+	{
+		std::list<replicate_call*> done;
+
+		acl_pthread_mutex_lock(&mutex_);
+		done.swap(done_);
+		acl_pthread_mutex_unlock(&mutex_);
 
-			//for next heartbeat time;
+		bool failed = false;
 
+		for (std::list<replicate_call*>::iterator it = done.begin();
+			 it != done.end(); ++it)
+		{
+			replicate_call *call = *it;
 
-			status = rpc_client_.pb_call(replicate_service_path_,
-                                         req,
-                                         resp);
+			//response matched to its request by req_id
+			inflight_.erase(call->req_.req_id());
 
-			if (!status)
+			//sent before roll back or in old term.ignore it
+			if (call->req_.req_id() <= stale_req_id_ ||
+				!node_.is_leader())
 			{
-				logger_error("proto_call error.%s",
-					status.error_str_.c_str());
+				free_replicate_call(call);
+				continue;
+			}
+
+			if (!call->ok_)
+			{
+				logger_error("send replicate_log_entries_request error");
 				rpc_fails_++;
-				break;
+				//send again from it.and drop requests in flight
+				next_index_ = call->req_.prev_log_index() + 1;
+				stale_req_id_ = req_id_;
+				entry_size_ = 1;
+				failed = true;
+				free_replicate_call(call);
+				continue;
 			}
+			ack_read_round(call->req_, call->resp_, call->read_round_);
 
             logger_debug(PEER_SECTION,10,"replicate done");
 
-			if (!resp.success())
+			if (!call->resp_.success())
 			{
 				term_t current_term = node_.current_term();
-				if (current_term < resp.term())
+				if (current_term < call->resp_.term())
 				{
-                    logger_debug(1, 2,"receive new handle");
-					node_.handle_new_term(resp.term());
-					break;
+					logger_debug(1, 2, "receive new handle");
+					node_.handle_new_term(call->resp_.term());
+					free_replicate_call(call);
+					continue;
 				}
-				//update next_index.
-				next_index_ = resp.last_log_index() + 1;
-				entry_size = 1;
-				match_index_ = 0;
+				//roll back next_index.and drop requests in flight
+				next_index_ = backtrack_next_index(call->resp_);
+				stale_req_id_ = req_id_;
+				entry_size_ = 1;
+				//probe peer even nothing to replicate
+				heartbeat = true;
+				free_replicate_call(call);
 				continue;
 			}
             logger_debug(PEER_SECTION,10,"replicate ok");
 
+			entry_size_ = 0;
 
-			//update peer metadata
-			entry_size = 0;
-			match_index_ = resp.last_log_index();
-			next_index_ = match_index_ + 1;
+			//peer maybe has more entries that not match leader
+			log_index_t match_index = call->resp_.last_log_index();
+			if (match_index > call->last_index_)
+				match_index = call->last_index_;
+			if (match_index > match_index_)
+				match_index_ = match_index;
 
-            //callback to node
-            node_.replicate_log_callback();
+			free_replicate_call(call);
 
-			//nothings to replicate
-			if(next_index_ > node_.last_log_index())
-            {
-                logger_debug(PEER_SECTION, 10,
-                             "next_index_(%llu) "
-                             "last_log_index(%llu).break",
-                             next_index_,
-                             node_.last_log_index());
-                break;
-            }
+			//callback to node
+			node_.replicate_log_callback(quorum_slot_, match_index_);
+		}
 
+		//retry failed one at next heartbeat
+		if (failed)
+		{
+			heartbeat = false;
+			return;
+		}
+		if (heartbeat || next_index_ <= node_.last_log_index())
+			SET_TO_REPLICATE(event);
+	}
+
+	peer::replicate_call *peer::new_replicate_call()
+	{
+		if (free_calls_.empty())
+			return new replicate_call(*this);
+
+		replicate_call *call = free_calls_.back();
+		free_calls_.pop_back();
+		return call;
+	}
+
+	void peer::free_replicate_call(replicate_call *call)
+	{
+		//one for each request in flight,and one building
+		if (free_calls_.size() > max_inflight_)
+		{
+			delete call;
+			return;
 		}
+		call->req_.Clear();
+		call->body_.clear();
+		call->resp_.Clear();
+		free_calls_.push_back(call);
+	}
+
+	peer::replicate_call::replicate_call(peer &_peer)
+		:peer_(_peer),
+		 ok_(false),
+		 last_index_(0),
+		 read_round_(0)
+	{
+
+	}
+
+	void peer::replicate_call::rpc_done(bool ok)
+	{
+		ok_ = ok;
+		peer_.push_replicate_done(this);
+	}
+
+	void peer::push_replicate_done(replicate_call *call)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		done_.push_back(call);
+		acl_pthread_mutex_unlock(&mutex_);
+
+		call_done(REPLICATE_DONE);
+	}
+
+	peer::vote_call::vote_call(peer &_peer)
+		:peer_(_peer),
+		 ok_(false),
+		 inflight_(false)
+	{
+
+	}
+
+	void peer::vote_call::rpc_done(bool ok)
+	{
+		ok_ = ok;
+		peer_.call_done(VOTE_DONE);
+	}
+
+	peer::snapshot_call::snapshot_call(peer &_peer)
+		:peer_(_peer),
+		 ok_(false),
+		 inflight_(false),
+		 active_(false),
+		 file_size_(0),
+		 last_term_(0),
+		 last_index_(0)
+	{
+
+	}
+
+	void peer::snapshot_call::rpc_done(bool ok)
+	{
+		ok_ = ok;
+		peer_.call_done(SNAPSHOT_DONE);
 	}
 
 	void peer::do_election()
@@ -346,16 +641,20 @@ namespace raft
 			return;
 		}
 
-		typedef acl::http_rpc_client::status_t status_t;
-		vote_request req;
-		vote_response resp;
+		//the last one not come back yet.send after it done
+		if (vote_call_.inflight_)
+		{
+			vote_again_ = true;
+			return;
+		}
+
+		vote_request &req = vote_call_.req_;
+		req.Clear();
+		vote_call_.resp_.Clear();
 		//async req need req_id_.keep it for the further
 		req.set_req_id(++req_id_);
 		node_.build_vote_request(req);
 
-        std::string data = req.SerializeAsString();
-        acl_assert(data.size());
-
         logger_debug(PEER_SECTION,10,
                      "req.last_log_index(%lu) "
                      "req.last_log_term(%lu) "
@@ -364,86 +663,168 @@ namespace raft
                      req.last_log_term(),
                      req.term());
 
-		status_t status = rpc_client_.pb_call(
-			election_service_path_,
-			req,
-			resp);
+		vote_call_.inflight_ = true;
+		begin_call();
+		transport_.async_vote(peer_id_, req, vote_call_.resp_, &vote_call_);
+	}
 
-		if (!status)
+	void peer::do_vote_done(int &event)
+	{
+		vote_call_.inflight_ = false;
+
+		if (!vote_call_.ok_)
+			logger_error("send vote_request error");
+		else
+			node_.vote_response_callback(peer_id_, vote_call_.resp_);
+
+		if (vote_again_)
 		{
-			logger_error("------proto_call error.%s--------",
-				status.error_str_.c_str());
-			return;
+			vote_again_ = false;
+			SET_TO_ELECTION(event);
 		}
+	}
 
-		node_.vote_response_callback(peer_id_, resp);
-	}
-
-	bool peer::wait_event(int &event)
-	{
-        event = 0;
-
-        timespec timeout;
-
-        timeout.tv_sec = last_heartbeat_time_.tv_sec;
-        timeout.tv_nsec = last_heartbeat_time_.tv_usec * 1000;
-
-        timeout.tv_sec += heart_inter_ / 1000;
-        timeout.tv_nsec += heart_inter_ % 1000 * 1000 * 1000;
-
-        acl_pthread_mutex_lock(&mutex_);
-        //has event. just do it .don't wait anymore
-        if (event_ != 0)
-        {
-			logger_debug(PEER_SECTION,10,"has event :%d", event);
-            event = event_;
-            event_ = 0;
-            acl_pthread_mutex_unlock(&mutex_);
-            return !IS_TO_STOP(event_);
-        }
-
-        if(node_.is_leader())
-        {
-            int status = acl_pthread_cond_timedwait(&cond_,
-                                                    &mutex_,
-                                                    &timeout);
-            if(status == -1)
-                logger_error("acl_pthread_cond_timedwait error");
-            /*
-            * check_heartbeat() for repeat during idle
-            * periods to prevent election timeouts (5.2)
-            * when cond timeout. it is time to send empty log
-            */
-            if (status == ACL_ETIMEDOUT)
-			{
-				logger_debug(PEER_SECTION, 10,
-                             "time to send heartbeat msg");
+	bool peer::send_heartbeat()
+	{
+		//the last one not come back yet
+		if (heartbeat_inflight_)
+		{
+			gettimeofday(&last_heartbeat_time_, NULL);
+			return true;
+		}
 
-				SET_TO_REPLICATE(event_);
-			}
-        } else
-        {
-            //node is not leader.wait without timeout
-            acl_pthread_cond_wait(&cond_,&mutex_);
-        }
-        logger_debug(PEER_SECTION, 15, "event_:%d", event_);
-        event = event_;
-        event_ = 0;
+		heartbeat_req_.Clear();
+		if (!node_.build_replicate_log_request(heartbeat_req_,
+											   next_index_,
+											   1))
+		{
+			return false;
+		}
+		int count = heartbeat_req_.entries_size();
+		heartbeat_index_ = count ?
+			heartbeat_req_.entries(count - 1).index() :
+			heartbeat_req_.prev_log_index();
+
+		heartbeat_req_.set_req_id(++req_id_);
+		heartbeat_read_round_ = node_.read_round();
+		heartbeat_inflight_ = true;
+		gettimeofday(&last_heartbeat_time_, NULL);
+
+		heartbeat_batcher_->push(this, peer_id_, heartbeat_req_);
+		return true;
+	}
+
+	void peer::heartbeat_done(bool ok,
+							  const replicate_log_entries_response &resp)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		heartbeat_ok_ = ok;
+		heartbeat_resp_.CopyFrom(resp);
+		SET_HEARTBEAT_DONE(event_);
 		acl_pthread_mutex_unlock(&mutex_);
 
-		return !IS_TO_STOP(event_);
+		scheduler_.schedule(this);
 	}
 
-	void peer::notify_stop()
+	void peer::do_heartbeat_done(int &event)
 	{
+		replicate_log_entries_response resp;
+
 		acl_pthread_mutex_lock(&mutex_);
-		if (!IS_TO_STOP(event_))
+		bool ok = heartbeat_ok_;
+		resp.CopyFrom(heartbeat_resp_);
+		acl_pthread_mutex_unlock(&mutex_);
+
+		bool success = resp.success();
+		term_t term = resp.term();
+		log_index_t last_log_index = resp.last_log_index();
+
+		heartbeat_inflight_ = false;
+
+		if (!ok)
+		{
+			rpc_fails_++;
+			return;
+		}
+		ack_read_round(heartbeat_req_, resp, heartbeat_read_round_);
+
+		if (!success)
 		{
-			SET_TO_STOP(event_);
-			acl_pthread_cond_signal(&cond_);
-			acl_pthread_mutex_unlock(&mutex_);
+			if (node_.current_term() < term)
+			{
+				logger_debug(1, 2, "receive new handle");
+				node_.handle_new_term(term);
+				return;
+			}
+			//log not match.replicate to find the match index
+			next_index_ = backtrack_next_index(resp);
+			SET_TO_REPLICATE(event);
+			return;
+		}
+
+		//peer maybe has more entries that not match leader
+		if (last_log_index > heartbeat_index_)
+			last_log_index = heartbeat_index_;
+		if (last_log_index > match_index_)
+			match_index_ = last_log_index;
+
+		node_.replicate_log_callback(quorum_slot_, match_index_);
+
+		if (next_index_ <= node_.last_log_index())
+			SET_TO_REPLICATE(event);
+	}
+
+	void peer::ack_read_round(const replicate_log_entries_request &req,
+							  const replicate_log_entries_response &resp,
+							  unsigned long long round)
+	{
+		//peer still in the term of request.no leader newer than us
+		if (round <= read_round_ || resp.term() != req.term())
 			return;
+
+		read_round_ = round;
+		node_.read_round_acked(quorum_slot_, round);
+	}
+
+	log_index_t peer::backtrack_next_index(
+		const replicate_log_entries_response &resp)
+	{
+		//peer not know conflict term
+		if (!resp.conflict_index())
+			return resp.last_log_index() + 1;
+
+		//leader has entries of conflict term.entries before the
+		//last one of them match the peer's
+		if (resp.conflict_term())
+		{
+			log_index_t index = node_.last_index_of_term(resp.conflict_term());
+			if (index)
+				return index + 1;
 		}
+		return resp.conflict_index();
+	}
+
+	int peer::take_event()
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		int event = event_;
+		event_ = 0;
 		acl_pthread_mutex_unlock(&mutex_);
+
+		return event;
+	}
+
+	long long peer::heartbeat_delay()
+	{
+		timeval now;
+		gettimeofday(&now, NULL);
+
+		long long elapsed =
+			(now.tv_sec - last_heartbeat_time_.tv_sec) * 1000 +
+			(now.tv_usec - last_heartbeat_time_.tv_usec) / 1000;
+
+		if (elapsed >= heart_inter_)
+			return 0;
+		return heart_inter_ - elapsed;
 	}
 }
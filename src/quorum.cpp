@@ -0,0 +1,119 @@
+#include "raft.hpp"
+
+namespace raft
+{
+	quorum::quorum()
+		:total_weight_(0),
+		 same_weight_(true)
+	{
+
+	}
+
+	int quorum::add_member(unsigned int weight)
+	{
+		acl::lock_guard lg(locker_);
+
+		int slot = static_cast<int>(indexes_.size());
+
+		indexes_.push_back(0);
+		weights_.push_back(weight);
+		ranks_.push_back(order_.size());
+		order_.push_back(slot);
+
+		total_weight_ += weight;
+		if (weight != weights_.front())
+			same_weight_ = false;
+
+		//keep order_ sorted
+		size_t pos = ranks_[slot];
+		while (pos > 0 && indexes_[order_[pos - 1]] < indexes_[slot])
+		{
+			swap(pos - 1, pos);
+			--pos;
+		}
+		return slot;
+	}
+
+	void quorum::clear()
+	{
+		acl::lock_guard lg(locker_);
+
+		indexes_.clear();
+		weights_.clear();
+		order_.clear();
+		ranks_.clear();
+		total_weight_ = 0;
+		same_weight_ = true;
+	}
+
+	void quorum::reset(log_index_t index)
+	{
+		acl::lock_guard lg(locker_);
+
+		//all equal.any order is sorted
+		for (size_t i = 0; i < indexes_.size(); i++)
+			indexes_[i] = index;
+	}
+
+	log_index_t quorum::update(int slot, log_index_t index)
+	{
+		acl::lock_guard lg(locker_);
+
+		acl_assert(slot >= 0 && slot < static_cast<int>(indexes_.size()));
+
+		indexes_[slot] = index;
+
+		//move forward or backward to keep order_ sorted.
+		//mostly it pass only a few members
+		size_t pos = ranks_[slot];
+		while (pos > 0 && indexes_[order_[pos - 1]] < index)
+		{
+			swap(pos - 1, pos);
+			--pos;
+		}
+		while (pos + 1 < order_.size() && indexes_[order_[pos + 1]] > index)
+		{
+			swap(pos, pos + 1);
+			++pos;
+		}
+		return get_quorum_index();
+	}
+
+	log_index_t quorum::quorum_index()
+	{
+		acl::lock_guard lg(locker_);
+		return get_quorum_index();
+	}
+
+	size_t quorum::size()
+	{
+		acl::lock_guard lg(locker_);
+		return indexes_.size();
+	}
+
+	void quorum::swap(size_t i, size_t j)
+	{
+		std::swap(order_[i], order_[j]);
+		ranks_[order_[i]] = i;
+		ranks_[order_[j]] = j;
+	}
+
+	log_index_t quorum::get_quorum_index()
+	{
+		if (order_.empty())
+			return 0;
+
+		//n / 2 + 1 members reach order_[n / 2]
+		if (same_weight_)
+			return indexes_[order_[order_.size() / 2]];
+
+		unsigned int weight = 0;
+		for (size_t i = 0; i < order_.size(); i++)
+		{
+			weight += weights_[order_[i]];
+			if (weight * 2 > total_weight_)
+				return indexes_[order_[i]];
+		}
+		return 0;
+	}
+}
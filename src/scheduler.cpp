@@ -0,0 +1,267 @@
+#include "raft.hpp"
+
+#define SCHEDULER_SECTION 13
+
+namespace raft
+{
+	enum
+	{
+		e_task_idle,
+		e_task_queued,
+		e_task_running,
+		//scheduled again when running
+		e_task_rerun,
+	};
+
+	static long long now_micros()
+	{
+		timeval now;
+		gettimeofday(&now, NULL);
+		return now.tv_sec * 1000000LL + now.tv_usec;
+	}
+
+	scheduler::task::task()
+		:state_(e_task_idle),
+		 removed_(false),
+		 has_timer_(false)
+	{
+
+	}
+
+	scheduler::task::~task()
+	{
+
+	}
+
+	scheduler::scheduler(size_t workers)
+		:stop_(false)
+	{
+		acl_pthread_mutex_init(&mutex_, NULL);
+		acl_pthread_cond_init(&task_cond_, NULL);
+		acl_pthread_cond_init(&timer_cond_, NULL);
+		acl_pthread_cond_init(&done_cond_, NULL);
+
+		if (!workers)
+			workers = 1;
+
+		for (size_t i = 0; i < workers; i++)
+		{
+			worker *_worker = new worker(*this);
+			_worker->start();
+			workers_.push_back(_worker);
+		}
+		timer_ = new timer(*this);
+		timer_->start();
+	}
+
+	scheduler::~scheduler()
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		stop_ = true;
+		acl_pthread_cond_broadcast(&task_cond_);
+		acl_pthread_cond_signal(&timer_cond_);
+		acl_pthread_mutex_unlock(&mutex_);
+
+		for (size_t i = 0; i < workers_.size(); i++)
+		{
+			workers_[i]->wait();
+			delete workers_[i];
+		}
+		timer_->wait();
+		delete timer_;
+
+		acl_pthread_mutex_destroy(&mutex_);
+		acl_pthread_cond_destroy(&task_cond_);
+		acl_pthread_cond_destroy(&timer_cond_);
+		acl_pthread_cond_destroy(&done_cond_);
+	}
+
+	scheduler &scheduler::get_instance()
+	{
+		//never delete.nodes may be destroyed after static objects
+		static scheduler *instance = new scheduler;
+		return *instance;
+	}
+
+	scheduler &scheduler::get_background_instance()
+	{
+		static scheduler *instance = new scheduler;
+		return *instance;
+	}
+
+	void scheduler::schedule(task *_task)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		push_task(_task);
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	void scheduler::set_timer(task *_task, unsigned int delay)
+	{
+		long long when = now_micros() + delay * 1000LL;
+
+		acl_pthread_mutex_lock(&mutex_);
+		if (_task->removed_)
+		{
+			acl_pthread_mutex_unlock(&mutex_);
+			return;
+		}
+		if (_task->has_timer_)
+			timers_.erase(_task->timer_);
+
+		_task->timer_ = timers_.insert(std::make_pair(when, _task));
+		_task->has_timer_ = true;
+
+		//the earliest one changed
+		if (_task->timer_ == timers_.begin())
+			acl_pthread_cond_signal(&timer_cond_);
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	void scheduler::cancel_timer(task *_task)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		if (_task->has_timer_)
+		{
+			timers_.erase(_task->timer_);
+			_task->has_timer_ = false;
+		}
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	void scheduler::remove(task *_task)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		_task->removed_ = true;
+
+		if (_task->has_timer_)
+		{
+			timers_.erase(_task->timer_);
+			_task->has_timer_ = false;
+		}
+		if (_task->state_ == e_task_queued)
+		{
+			tasks_.remove(_task);
+			_task->state_ = e_task_idle;
+		}
+		while (_task->state_ != e_task_idle)
+			acl_pthread_cond_wait(&done_cond_, &mutex_);
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	//must hold mutex_
+	void scheduler::push_task(task *_task)
+	{
+		if (_task->removed_)
+			return;
+
+		if (_task->state_ == e_task_idle)
+		{
+			_task->state_ = e_task_queued;
+			tasks_.push_back(_task);
+			acl_pthread_cond_signal(&task_cond_);
+		}
+		else if (_task->state_ == e_task_running)
+		{
+			_task->state_ = e_task_rerun;
+		}
+	}
+
+	scheduler::task *scheduler::pop_task()
+	{
+		task *_task = NULL;
+
+		acl_pthread_mutex_lock(&mutex_);
+		while (tasks_.empty() && !stop_)
+			acl_pthread_cond_wait(&task_cond_, &mutex_);
+
+		if (!stop_)
+		{
+			_task = tasks_.front();
+			tasks_.pop_front();
+			_task->state_ = e_task_running;
+		}
+		acl_pthread_mutex_unlock(&mutex_);
+		return _task;
+	}
+
+	void scheduler::task_done(task *_task)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		if (_task->state_ == e_task_rerun && !_task->removed_)
+		{
+			_task->state_ = e_task_queued;
+			tasks_.push_back(_task);
+			acl_pthread_cond_signal(&task_cond_);
+		}
+		else
+		{
+			_task->state_ = e_task_idle;
+			if (_task->removed_)
+				acl_pthread_cond_broadcast(&done_cond_);
+		}
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	void scheduler::run_timers()
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		while (!stop_)
+		{
+			long long now = now_micros();
+
+			while (timers_.size() && timers_.begin()->first <= now)
+			{
+				task *_task = timers_.begin()->second;
+				timers_.erase(timers_.begin());
+				_task->has_timer_ = false;
+				push_task(_task);
+			}
+
+			if (timers_.empty())
+			{
+				acl_pthread_cond_wait(&timer_cond_, &mutex_);
+				continue;
+			}
+
+			long long when = timers_.begin()->first;
+			timespec timeout;
+			timeout.tv_sec = when / 1000000;
+			timeout.tv_nsec = (when % 1000000) * 1000;
+
+			acl_pthread_cond_timedwait(&timer_cond_, &mutex_, &timeout);
+		}
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	scheduler::worker::worker(scheduler &_scheduler)
+		:scheduler_(_scheduler)
+	{
+
+	}
+
+	void *scheduler::worker::run()
+	{
+		task *_task = NULL;
+
+		while ((_task = scheduler_.pop_task()))
+		{
+			_task->run();
+			scheduler_.task_done(_task);
+		}
+		logger_debug(SCHEDULER_SECTION, 10, "worker stop");
+		return NULL;
+	}
+
+	scheduler::timer::timer(scheduler &_scheduler)
+		:scheduler_(_scheduler)
+	{
+
+	}
+
+	void *scheduler::timer::run()
+	{
+		scheduler_.run_timers();
+		return NULL;
+	}
+}
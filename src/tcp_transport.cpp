@@ -0,0 +1,1143 @@
+#include "raft.hpp"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+
+#define TCP_TRANSPORT_SECTION 15
+
+#define FRAME_HEADER_SIZE 16
+#define FRAME_MAX_SIZE    (256 * 1024 * 1024)
+
+//frame types.response type is request type | FRAME_RESPONSE
+#define FRAME_VOTE             1
+#define FRAME_REPLICATE        2
+#define FRAME_INSTALL_SNAPSHOT 3
+#define FRAME_HEARTBEAT        4
+#define FRAME_RESPONSE         0x100
+
+//milliseconds io thread wait for sockets before check timeout
+#define SWEEP_INTERVAL 100
+
+//milliseconds calls fail at once after connect failed.doubled
+//on each failure until RECONNECT_MAX
+#define RECONNECT_MIN  100
+#define RECONNECT_MAX  3000
+
+#define READ_SIZE      (64 * 1024)
+
+namespace raft
+{
+	static long long now_micros()
+	{
+		timeval now;
+		gettimeofday(&now, NULL);
+		return now.tv_sec * 1000000LL + now.tv_usec;
+	}
+
+	/**
+	 * wait for async call done.blocking calls on async ones
+	 */
+	class waiter : public transport::callback
+	{
+	public:
+		waiter()
+			:done_(false),
+			 ok_(false)
+		{
+			acl_pthread_mutex_init(&mutex_, NULL);
+			acl_pthread_cond_init(&cond_, NULL);
+		}
+
+		~waiter()
+		{
+			acl_pthread_mutex_destroy(&mutex_);
+			acl_pthread_cond_destroy(&cond_);
+		}
+
+		virtual void rpc_done(bool ok)
+		{
+			acl_pthread_mutex_lock(&mutex_);
+			ok_ = ok;
+			done_ = true;
+			acl_pthread_cond_signal(&cond_);
+			acl_pthread_mutex_unlock(&mutex_);
+		}
+
+		bool wait()
+		{
+			acl_pthread_mutex_lock(&mutex_);
+			while (!done_)
+				acl_pthread_cond_wait(&cond_, &mutex_);
+			acl_pthread_mutex_unlock(&mutex_);
+			return ok_;
+		}
+	private:
+		bool done_;
+		bool ok_;
+		acl_pthread_mutex_t mutex_;
+		acl_pthread_cond_t cond_;
+	};
+
+	static void put_uint32(unsigned char *buf, unsigned int value)
+	{
+		buf[0] = (unsigned char) (value >> 24);
+		buf[1] = (unsigned char) (value >> 16);
+		buf[2] = (unsigned char) (value >> 8);
+		buf[3] = (unsigned char) value;
+	}
+
+	static unsigned int get_uint32(const unsigned char *buf)
+	{
+		return ((unsigned int) buf[0] << 24) |
+			   ((unsigned int) buf[1] << 16) |
+			   ((unsigned int) buf[2] << 8) |
+			   (unsigned int) buf[3];
+	}
+
+	static bool parse_addr(const std::string &addr, sockaddr_in &sa)
+	{
+		std::string::size_type pos = addr.rfind(':');
+		if (pos == std::string::npos)
+		{
+			logger_error("addr error.%s", addr.c_str());
+			return false;
+		}
+		std::string ip = addr.substr(0, pos);
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sin_family = AF_INET;
+		sa.sin_port = htons((unsigned short) atoi(addr.c_str() + pos + 1));
+		if (inet_pton(AF_INET, ip.c_str(), &sa.sin_addr) != 1)
+		{
+			logger_error("addr error.%s", addr.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	static void put_header(unsigned char *header,
+						   unsigned int type,
+						   unsigned long long frame_id,
+						   size_t size)
+	{
+		//rvalue.not the one of common.hpp that move buffer
+		put_uint32(header + 0, (unsigned int) size);
+		put_uint32(header + 4, type);
+		put_uint32(header + 8, (unsigned int) (frame_id >> 32));
+		put_uint32(header + 12, (unsigned int) frame_id);
+	}
+
+	/**
+	 * write header and body with one syscall.not wait for
+	 * socket writable
+	 * @return return bytes written.-1 if socket error
+	 */
+	static ssize_t send_frame(int fd,
+							  const unsigned char *header,
+							  const std::string &body)
+	{
+		iovec iov[2];
+		iov[0].iov_base = const_cast<unsigned char *>(header);
+		iov[0].iov_len = FRAME_HEADER_SIZE;
+		iov[1].iov_base = const_cast<char *>(body.data());
+		iov[1].iov_len = body.size();
+
+		msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = body.empty() ? 1 : 2;
+
+		for (;;)
+		{
+			ssize_t bytes = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (bytes >= 0)
+				return bytes;
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			logger_error("sendmsg error.%s", acl::last_serror());
+			return -1;
+		}
+	}
+
+	/**
+	 * write header and body with one syscall
+	 */
+	static bool write_frame(int fd,
+							unsigned int type,
+							unsigned long long frame_id,
+							const std::string &body)
+	{
+		unsigned char header[FRAME_HEADER_SIZE];
+		put_header(header, type, frame_id, body.size());
+
+		iovec iov[2];
+		iov[0].iov_base = header;
+		iov[0].iov_len = FRAME_HEADER_SIZE;
+		iov[1].iov_base = const_cast<char *>(body.data());
+		iov[1].iov_len = body.size();
+
+		msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = body.empty() ? 1 : 2;
+
+		while (msg.msg_iovlen)
+		{
+			ssize_t bytes = sendmsg(fd, &msg, MSG_NOSIGNAL);
+			if (bytes < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				logger_error("sendmsg error.%s", acl::last_serror());
+				return false;
+			}
+			//skip bytes written
+			while (msg.msg_iovlen && bytes >= (ssize_t) msg.msg_iov->iov_len)
+			{
+				bytes -= msg.msg_iov->iov_len;
+				msg.msg_iov++;
+				msg.msg_iovlen--;
+			}
+			if (msg.msg_iovlen)
+			{
+				msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + bytes;
+				msg.msg_iov->iov_len -= bytes;
+			}
+		}
+		return true;
+	}
+
+	static bool read_full(int fd, char *buf, size_t len)
+	{
+		while (len)
+		{
+			ssize_t bytes = ::read(fd, buf, len);
+			if (bytes < 0 && errno == EINTR)
+				continue;
+			if (bytes <= 0)
+				return false;
+			buf += bytes;
+			len -= (size_t) bytes;
+		}
+		return true;
+	}
+
+	static bool read_frame(int fd,
+						   unsigned int &type,
+						   unsigned long long &frame_id,
+						   std::string &body)
+	{
+		unsigned char header[FRAME_HEADER_SIZE];
+		if (!read_full(fd, (char *) header, FRAME_HEADER_SIZE))
+			return false;
+
+		unsigned int len = get_uint32(header);
+		type = get_uint32(header + 4);
+		frame_id = ((unsigned long long) get_uint32(header + 8) << 32) |
+				   get_uint32(header + 12);
+		if (len > FRAME_MAX_SIZE)
+		{
+			logger_error("frame too large.%u", len);
+			return false;
+		}
+		body.resize(len);
+		return !len || read_full(fd, &body[0], len);
+	}
+
+	static void set_nonblock(int fd)
+	{
+		int flags = fcntl(fd, F_GETFL, 0);
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	}
+
+	static void set_nodelay(int fd)
+	{
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	}
+
+	tcp_transport::tcp_transport(unsigned int timeout)
+		:timeout_(timeout)
+	{
+
+	}
+
+	tcp_transport::~tcp_transport()
+	{
+		std::map<std::string, connection*>::iterator
+			it = connections_.begin();
+		for (; it != connections_.end(); ++it)
+			delete it->second;
+	}
+
+	void tcp_transport::add_peer(const std::string &peer_id,
+								 const std::string &addr)
+	{
+		acl::lock_guard lg(locker_);
+
+		if (connections_.find(peer_id) != connections_.end())
+			return;
+		//connect when the first request sent
+		connections_[peer_id] = new connection(addr, timeout_);
+	}
+
+	tcp_transport::connection *
+	tcp_transport::get_connection(const std::string &peer_id)
+	{
+		acl::lock_guard lg(locker_);
+
+		std::map<std::string, connection*>::iterator
+			it = connections_.find(peer_id);
+		if (it == connections_.end())
+		{
+			logger_error("peer not found.%s", peer_id.c_str());
+			return NULL;
+		}
+		return it->second;
+	}
+
+	bool tcp_transport::call(const std::string &peer_id,
+							 unsigned int type,
+							 const google::protobuf::Message &req,
+							 google::protobuf::Message &resp)
+	{
+		connection *conn = get_connection(peer_id);
+		return conn && conn->call(type, req, resp, timeout_);
+	}
+
+	void tcp_transport::async_call(const std::string &peer_id,
+								   unsigned int type,
+								   const google::protobuf::Message &req,
+								   google::protobuf::Message &resp,
+								   callback *_callback)
+	{
+		connection *conn = get_connection(peer_id);
+		if (!conn)
+		{
+			_callback->rpc_done(false);
+			return;
+		}
+		conn->async_call(type, req, resp, _callback, timeout_);
+	}
+
+	void tcp_transport::async_call(const std::string &peer_id,
+								   unsigned int type,
+								   const std::string &body,
+								   google::protobuf::Message &resp,
+								   callback *_callback)
+	{
+		connection *conn = get_connection(peer_id);
+		if (!conn)
+		{
+			_callback->rpc_done(false);
+			return;
+		}
+		conn->async_call(type, body, resp, _callback, timeout_);
+	}
+
+	bool tcp_transport::vote(const std::string &peer_id,
+							 const vote_request &req,
+							 vote_response &resp)
+	{
+		return call(peer_id, FRAME_VOTE, req, resp);
+	}
+
+	bool tcp_transport::replicate(const std::string &peer_id,
+								  const replicate_log_entries_request &req,
+								  replicate_log_entries_response &resp)
+	{
+		return call(peer_id, FRAME_REPLICATE, req, resp);
+	}
+
+	bool tcp_transport::install_snapshot(const std::string &peer_id,
+										 const install_snapshot_request &req,
+										 install_snapshot_response &resp)
+	{
+		return call(peer_id, FRAME_INSTALL_SNAPSHOT, req, resp);
+	}
+
+	bool tcp_transport::heartbeat(const std::string &peer_id,
+								  const heartbeat_request &req,
+								  heartbeat_response &resp)
+	{
+		return call(peer_id, FRAME_HEARTBEAT, req, resp);
+	}
+
+	void tcp_transport::async_vote(const std::string &peer_id,
+								   const vote_request &req,
+								   vote_response &resp,
+								   callback *_callback)
+	{
+		async_call(peer_id, FRAME_VOTE, req, resp, _callback);
+	}
+
+	void tcp_transport::async_replicate(
+		const std::string &peer_id,
+		const replicate_log_entries_request &req,
+		replicate_log_entries_response &resp,
+		callback *_callback)
+	{
+		async_call(peer_id, FRAME_REPLICATE, req, resp, _callback);
+	}
+
+	void tcp_transport::async_replicate(
+		const std::string &peer_id,
+		const std::string &req,
+		replicate_log_entries_response &resp,
+		callback *_callback)
+	{
+		async_call(peer_id, FRAME_REPLICATE, req, resp, _callback);
+	}
+
+	void tcp_transport::async_install_snapshot(
+		const std::string &peer_id,
+		const install_snapshot_request &req,
+		install_snapshot_response &resp,
+		callback *_callback)
+	{
+		async_call(peer_id, FRAME_INSTALL_SNAPSHOT, req, resp, _callback);
+	}
+
+	void tcp_transport::async_heartbeat(const std::string &peer_id,
+										const heartbeat_request &req,
+										heartbeat_response &resp,
+										callback *_callback)
+	{
+		async_call(peer_id, FRAME_HEARTBEAT, req, resp, _callback);
+	}
+
+	bool tcp_transport::pipeline()
+	{
+		return true;
+	}
+
+	tcp_transport::connection::connection(const std::string &addr,
+										  unsigned int timeout)
+		:addr_(addr),
+		 timeout_(timeout),
+		 fd_(-1),
+		 connecting_(false),
+		 connect_deadline_(0),
+		 retry_time_(0),
+		 backoff_(RECONNECT_MIN),
+		 out_pos_(0),
+		 frame_id_(0),
+		 stop_(false),
+		 io_thread_(NULL)
+	{
+		acl_pthread_mutex_init(&mutex_, NULL);
+
+		if (pipe(wakeup_fds_) < 0)
+			logger_fatal("pipe error.%s", acl::last_serror());
+		set_nonblock(wakeup_fds_[0]);
+		set_nonblock(wakeup_fds_[1]);
+	}
+
+	tcp_transport::connection::~connection()
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		stop_ = true;
+		acl_pthread_mutex_unlock(&mutex_);
+
+		if (io_thread_)
+		{
+			wakeup();
+			io_thread_->wait();
+			delete io_thread_;
+		}
+		//fail the calls left
+		broken();
+
+		close(wakeup_fds_[0]);
+		close(wakeup_fds_[1]);
+		acl_pthread_mutex_destroy(&mutex_);
+	}
+
+	bool tcp_transport::connection::open()
+	{
+		sockaddr_in sa;
+		if (!parse_addr(addr_, sa))
+			return false;
+
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+		{
+			logger_error("socket error.%s", acl::last_serror());
+			return false;
+		}
+		set_nonblock(fd);
+		set_nodelay(fd);
+
+		//done when fd writable
+		if (connect(fd, (const sockaddr *) &sa, sizeof(sa)) < 0 &&
+			errno != EINPROGRESS)
+		{
+			logger_error("connect %s error.%s",
+						 addr_.c_str(),
+						 acl::last_serror());
+			close(fd);
+			return false;
+		}
+		fd_ = fd;
+		connecting_ = true;
+		connect_deadline_ = now_micros() + timeout_ * 1000LL;
+		return true;
+	}
+
+	bool tcp_transport::connection::connected()
+	{
+		int error = 0;
+		socklen_t len = sizeof(error);
+
+		acl_pthread_mutex_lock(&mutex_);
+		if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+			error = errno;
+		if (error)
+		{
+			acl_pthread_mutex_unlock(&mutex_);
+			logger_error("connect %s error.%s",
+						 addr_.c_str(),
+						 strerror(error));
+			return false;
+		}
+		connecting_ = false;
+		backoff_ = RECONNECT_MIN;
+
+		//requests queued while connecting
+		bool rc = flush();
+		acl_pthread_mutex_unlock(&mutex_);
+		return rc;
+	}
+
+	bool tcp_transport::connection::flush()
+	{
+		while (out_pos_ < out_.size())
+		{
+			ssize_t bytes = send(fd_,
+								 out_.data() + out_pos_,
+								 out_.size() - out_pos_,
+								 MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (bytes < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				//socket buffer full.write again when writable
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+				logger_error("send error.%s", acl::last_serror());
+				return false;
+			}
+			out_pos_ += (size_t) bytes;
+		}
+
+		if (out_pos_ == out_.size())
+		{
+			//keep the memory
+			out_.clear();
+			out_pos_ = 0;
+		}
+		else if (out_pos_ > out_.size() / 2)
+		{
+			out_.erase(0, out_pos_);
+			out_pos_ = 0;
+		}
+		return true;
+	}
+
+	bool tcp_transport::connection::read_frames()
+	{
+		char buf[READ_SIZE];
+
+		for (;;)
+		{
+			ssize_t bytes = ::read(fd_, buf, sizeof(buf));
+			if (bytes < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+				logger_error("read error.%s", acl::last_serror());
+				return false;
+			}
+			if (bytes == 0)
+				return false;
+			in_.append(buf, (size_t) bytes);
+			if (bytes < (ssize_t) sizeof(buf))
+				break;
+		}
+
+		size_t pos = 0;
+		while (in_.size() - pos >= FRAME_HEADER_SIZE)
+		{
+			const unsigned char *header =
+				(const unsigned char *) in_.data() + pos;
+			unsigned int len = get_uint32(header);
+			unsigned int type = get_uint32(header + 4);
+			unsigned long long frame_id =
+				((unsigned long long) get_uint32(header + 8) << 32) |
+				get_uint32(header + 12);
+
+			if (len > FRAME_MAX_SIZE)
+			{
+				logger_error("frame too large.%u", len);
+				return false;
+			}
+			//wait for the rest of frame
+			if (in_.size() - pos - FRAME_HEADER_SIZE < len)
+				break;
+
+			done(frame_id,
+				 type,
+				 in_.data() + pos + FRAME_HEADER_SIZE,
+				 len);
+			pos += FRAME_HEADER_SIZE + len;
+		}
+		in_.erase(0, pos);
+		return true;
+	}
+
+	void tcp_transport::connection::broken()
+	{
+		std::map<unsigned long long, pending*> pendings;
+
+		acl_pthread_mutex_lock(&mutex_);
+		//connect failed.not try again for a while
+		if (connecting_ || fd_ < 0)
+		{
+			retry_time_ = now_micros() + backoff_ * 1000LL;
+			backoff_ = std::min(backoff_ * 2, (unsigned int) RECONNECT_MAX);
+		}
+		if (fd_ >= 0)
+		{
+			logger_debug(TCP_TRANSPORT_SECTION, 10,
+						 "connection to %s broken",
+						 addr_.c_str());
+			close(fd_);
+			fd_ = -1;
+		}
+		connecting_ = false;
+		out_.clear();
+		out_pos_ = 0;
+		pendings.swap(pendings_);
+		acl_pthread_mutex_unlock(&mutex_);
+
+		in_.clear();
+
+		//callbacks may make new calls.not hold mutex_
+		std::map<unsigned long long, pending*>::iterator
+			it = pendings.begin();
+		for (; it != pendings.end(); ++it)
+		{
+			it->second->callback_->rpc_done(false);
+			delete it->second;
+		}
+	}
+
+	void tcp_transport::connection::wakeup()
+	{
+		char c = 0;
+		//pipe full means io_thread wake up already
+		if (::write(wakeup_fds_[1], &c, 1) < 0 && errno != EAGAIN)
+			logger_error("write pipe error.%s", acl::last_serror());
+	}
+
+	bool tcp_transport::connection::run_once()
+	{
+		pollfd pfds[2];
+		nfds_t nfds = 1;
+		bool connecting = false;
+
+		pfds[0].fd = wakeup_fds_[0];
+		pfds[0].events = POLLIN;
+		pfds[0].revents = 0;
+
+		acl_pthread_mutex_lock(&mutex_);
+		if (stop_)
+		{
+			acl_pthread_mutex_unlock(&mutex_);
+			return false;
+		}
+		//connect for the calls queued
+		if (fd_ < 0 && pendings_.size() && !open())
+		{
+			acl_pthread_mutex_unlock(&mutex_);
+			broken();
+			return true;
+		}
+		if (fd_ >= 0)
+		{
+			pfds[1].fd = fd_;
+			pfds[1].events = POLLIN;
+			pfds[1].revents = 0;
+			if (connecting_ || out_pos_ < out_.size())
+				pfds[1].events |= POLLOUT;
+			nfds = 2;
+		}
+		connecting = connecting_;
+		acl_pthread_mutex_unlock(&mutex_);
+
+		int rc = poll(pfds, nfds, SWEEP_INTERVAL);
+		if (rc < 0 && errno != EINTR)
+		{
+			logger_error("poll error.%s", acl::last_serror());
+			return true;
+		}
+		if (rc > 0 && pfds[0].revents)
+		{
+			char buf[64];
+			while (::read(wakeup_fds_[0], buf, sizeof(buf)) > 0)
+				;
+		}
+		if (rc <= 0 || nfds == 1 || !pfds[1].revents)
+		{
+			if (connecting && now_micros() > connect_deadline_)
+			{
+				logger_error("connect %s timeout", addr_.c_str());
+				broken();
+			}
+			return true;
+		}
+
+		bool ok = true;
+		if (connecting)
+		{
+			ok = connected();
+		}
+		else
+		{
+			if (pfds[1].revents & (POLLIN | POLLERR | POLLHUP))
+				ok = read_frames();
+			if (ok && (pfds[1].revents & POLLOUT))
+			{
+				acl_pthread_mutex_lock(&mutex_);
+				ok = flush();
+				acl_pthread_mutex_unlock(&mutex_);
+			}
+		}
+		if (!ok)
+			broken();
+		return true;
+	}
+
+	void tcp_transport::connection::done(unsigned long long frame_id,
+										 unsigned int type,
+										 const char *body,
+										 size_t len)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+
+		std::map<unsigned long long, pending*>::iterator
+			it = pendings_.find(frame_id);
+		//caller timeout.drop it
+		if (it == pendings_.end())
+		{
+			acl_pthread_mutex_unlock(&mutex_);
+			return;
+		}
+		pending *_pending = it->second;
+		pendings_.erase(it);
+		acl_pthread_mutex_unlock(&mutex_);
+
+		bool ok = (type & FRAME_RESPONSE) &&
+			_pending->resp_->ParseFromArray(body, (int) len);
+		_pending->callback_->rpc_done(ok);
+		delete _pending;
+	}
+
+	void tcp_transport::connection::sweep()
+	{
+		std::vector<pending*> timeouts;
+		long long now = now_micros();
+
+		acl_pthread_mutex_lock(&mutex_);
+		std::map<unsigned long long, pending*>::iterator
+			it = pendings_.begin();
+		while (it != pendings_.end())
+		{
+			if (it->second->deadline_ > now)
+			{
+				++it;
+				continue;
+			}
+			timeouts.push_back(it->second);
+			pendings_.erase(it++);
+		}
+		acl_pthread_mutex_unlock(&mutex_);
+
+		for (size_t i = 0; i < timeouts.size(); i++)
+		{
+			logger_error("wait for response of %s timeout",
+						 addr_.c_str());
+			timeouts[i]->callback_->rpc_done(false);
+			delete timeouts[i];
+		}
+	}
+
+	bool tcp_transport::connection::call(unsigned int type,
+										 const google::protobuf::Message &req,
+										 google::protobuf::Message &resp,
+										 unsigned int timeout)
+	{
+		waiter _waiter;
+		async_call(type, req, resp, &_waiter, timeout);
+		return _waiter.wait();
+	}
+
+	void tcp_transport::connection::async_call(
+		unsigned int type,
+		const google::protobuf::Message &req,
+		google::protobuf::Message &resp,
+		callback *_callback,
+		unsigned int timeout)
+	{
+		std::string body;
+		if (!req.SerializeToString(&body))
+		{
+			logger_error("SerializeToString error");
+			_callback->rpc_done(false);
+			return;
+		}
+		async_call(type, body, resp, _callback, timeout);
+	}
+
+	void tcp_transport::connection::async_call(
+		unsigned int type,
+		const std::string &body,
+		google::protobuf::Message &resp,
+		callback *_callback,
+		unsigned int timeout)
+	{
+		long long now = now_micros();
+
+		acl_pthread_mutex_lock(&mutex_);
+		//peer down.not queue calls to fail later
+		if (stop_ || now < retry_time_)
+		{
+			acl_pthread_mutex_unlock(&mutex_);
+			logger_debug(TCP_TRANSPORT_SECTION, 10,
+						 "connection to %s backoff",
+						 addr_.c_str());
+			_callback->rpc_done(false);
+			return;
+		}
+
+		pending *_pending = new pending;
+		_pending->resp_ = &resp;
+		_pending->callback_ = _callback;
+		_pending->deadline_ = now + timeout * 1000LL;
+		unsigned long long frame_id = ++frame_id_;
+		pendings_[frame_id] = _pending;
+
+		unsigned char header[FRAME_HEADER_SIZE];
+		put_header(header, type, frame_id, body.size());
+
+		bool idle = out_pos_ == out_.size();
+		size_t written = 0;
+		//write it now if nothing queued.never block on socket
+		if (idle && fd_ >= 0 && !connecting_)
+		{
+			ssize_t bytes = send_frame(fd_, header, body);
+			//io_thread find it broken and fail the calls
+			if (bytes < 0)
+				shutdown(fd_, SHUT_RDWR);
+			else
+				written = (size_t) bytes;
+		}
+		if (written < FRAME_HEADER_SIZE)
+		{
+			out_.append((const char *) header + written,
+						FRAME_HEADER_SIZE - written);
+			out_.append(body);
+		}
+		else
+			out_.append(body, written - FRAME_HEADER_SIZE,
+						std::string::npos);
+
+		//wait for connect or socket writable
+		bool wake = (idle && out_pos_ < out_.size()) || fd_ < 0;
+		if (!io_thread_)
+		{
+			io_thread_ = new io_thread(*this);
+			io_thread_->start();
+		}
+		acl_pthread_mutex_unlock(&mutex_);
+
+		if (wake)
+			wakeup();
+	}
+
+	tcp_transport::io_thread::io_thread(connection &conn)
+		:conn_(conn)
+	{
+
+	}
+
+	void *tcp_transport::io_thread::run()
+	{
+		long long last_sweep = now_micros();
+
+		while (conn_.run_once())
+		{
+			long long now = now_micros();
+			if (now - last_sweep >= SWEEP_INTERVAL * 1000LL)
+			{
+				conn_.sweep();
+				last_sweep = now;
+			}
+		}
+		return NULL;
+	}
+
+	tcp_transport_server::tcp_transport_server()
+		:node_(NULL),
+		 host_(NULL),
+		 listen_fd_(-1),
+		 stop_(false),
+		 acceptor_(*this)
+	{
+
+	}
+
+	tcp_transport_server::~tcp_transport_server()
+	{
+		stop();
+	}
+
+	void tcp_transport_server::bind(node *_node)
+	{
+		node_ = _node;
+	}
+
+	void tcp_transport_server::bind(multi_raft *host)
+	{
+		host_ = host;
+	}
+
+	bool tcp_transport_server::open(const std::string &addr)
+	{
+		if (!node_ && !host_)
+		{
+			logger_error("bind node or multi_raft first");
+			return false;
+		}
+
+		sockaddr_in sa;
+		if (!parse_addr(addr, sa))
+			return false;
+
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+		{
+			logger_error("socket error.%s", acl::last_serror());
+			return false;
+		}
+		int on = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		if (::bind(fd, (sockaddr *) &sa, sizeof(sa)) < 0 ||
+			listen(fd, 128) < 0)
+		{
+			logger_error("listen %s error.%s",
+						 addr.c_str(),
+						 acl::last_serror());
+			close(fd);
+			return false;
+		}
+
+		socklen_t len = sizeof(sa);
+		getsockname(fd, (sockaddr *) &sa, &len);
+
+		char ip[INET_ADDRSTRLEN];
+		inet_ntop(AF_INET, &sa.sin_addr, ip, sizeof(ip));
+
+		acl::string buffer;
+		buffer.format("%s:%d", ip, ntohs(sa.sin_port));
+		addr_ = buffer.c_str();
+
+		listen_fd_ = fd;
+		acceptor_.start();
+		return true;
+	}
+
+	std::string tcp_transport_server::addr() const
+	{
+		return addr_;
+	}
+
+	void tcp_transport_server::stop()
+	{
+		if (listen_fd_ < 0)
+			return;
+
+		stop_ = true;
+		//wake up acceptor
+		shutdown(listen_fd_, SHUT_RDWR);
+		acceptor_.wait();
+		close(listen_fd_);
+		listen_fd_ = -1;
+
+		reap_sessions(true);
+	}
+
+	void tcp_transport_server::reap_sessions(bool all)
+	{
+		acl::lock_guard lg(sessions_locker_);
+
+		std::list<session*>::iterator it = sessions_.begin();
+		while (it != sessions_.end())
+		{
+			session *_session = *it;
+			if (all)
+				_session->shutdown();
+			else if (!_session->done())
+			{
+				++it;
+				continue;
+			}
+			_session->wait();
+			delete _session;
+			it = sessions_.erase(it);
+		}
+	}
+
+	tcp_transport_server::acceptor::acceptor(tcp_transport_server &server)
+		:server_(server)
+	{
+
+	}
+
+	void *tcp_transport_server::acceptor::run()
+	{
+		while (!server_.stop_)
+		{
+			int fd = accept(server_.listen_fd_, NULL, NULL);
+			if (fd < 0)
+			{
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				if (!server_.stop_)
+					logger_error("accept error.%s", acl::last_serror());
+				break;
+			}
+			set_nodelay(fd);
+
+			//sessions of closed connections
+			server_.reap_sessions(false);
+
+			session *_session = new session(server_, fd);
+			_session->start();
+
+			acl::lock_guard lg(server_.sessions_locker_);
+			server_.sessions_.push_back(_session);
+		}
+		return NULL;
+	}
+
+	tcp_transport_server::session::session(tcp_transport_server &server,
+										   int fd)
+		:server_(server),
+		 fd_(fd),
+		 done_(false)
+	{
+
+	}
+
+	tcp_transport_server::session::~session()
+	{
+		close(fd_);
+	}
+
+	void tcp_transport_server::session::shutdown()
+	{
+		::shutdown(fd_, SHUT_RDWR);
+	}
+
+	bool tcp_transport_server::session::done()
+	{
+		return done_;
+	}
+
+	void *tcp_transport_server::session::run()
+	{
+		unsigned int type;
+		unsigned long long frame_id;
+		std::string body;
+
+		while (read_frame(fd_, type, frame_id, body))
+		{
+			if (!handle(type, body))
+				break;
+			if (!write_frame(fd_, type | FRAME_RESPONSE, frame_id, buffer_))
+				break;
+		}
+		done_ = true;
+		return NULL;
+	}
+
+	bool tcp_transport_server::session::handle(unsigned int type,
+											   const std::string &body)
+	{
+		node *_node = server_.node_;
+		multi_raft *host = server_.host_;
+		bool ok = false;
+
+		buffer_.clear();
+
+		switch (type)
+		{
+		case FRAME_VOTE:
+			vote_resp_.Clear();
+			if (!vote_req_.ParseFromString(body))
+				break;
+			ok = host ? host->handle_vote_request(vote_req_, vote_resp_) :
+				_node->handle_vote_request(vote_req_, vote_resp_);
+			ok = ok && vote_resp_.SerializeToString(&buffer_);
+			break;
+		case FRAME_REPLICATE:
+			replicate_resp_.Clear();
+			if (!replicate_req_.ParseFromString(body))
+				break;
+			ok = host ?
+				host->handle_replicate_log_request(replicate_req_,
+												   replicate_resp_) :
+				_node->handle_replicate_log_request(replicate_req_,
+													replicate_resp_);
+			ok = ok && replicate_resp_.SerializeToString(&buffer_);
+			break;
+		case FRAME_INSTALL_SNAPSHOT:
+			install_snapshot_resp_.Clear();
+			if (!install_snapshot_req_.ParseFromString(body))
+				break;
+			ok = host ?
+				host->handle_install_snapshot_request(
+					install_snapshot_req_, install_snapshot_resp_) :
+				_node->handle_install_snapshot_request(
+					install_snapshot_req_, install_snapshot_resp_);
+			ok = ok && install_snapshot_resp_.SerializeToString(&buffer_);
+			break;
+		case FRAME_HEARTBEAT:
+			heartbeat_resp_.Clear();
+			if (!heartbeat_req_.ParseFromString(body))
+				break;
+			ok = host ?
+				host->handle_heartbeat_request(heartbeat_req_,
+											   heartbeat_resp_) :
+				_node->handle_heartbeat_request(heartbeat_req_,
+												heartbeat_resp_);
+			ok = ok && heartbeat_resp_.SerializeToString(&buffer_);
+			break;
+		default:
+			logger_error("unknown frame type.%u", type);
+			return false;
+		}
+		if (!ok)
+			logger_error("handle frame error.type:%u", type);
+		return ok;
+	}
+}
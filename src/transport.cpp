@@ -0,0 +1,346 @@
+#include "raft.hpp"
+
+namespace raft
+{
+	enum
+	{
+		e_rpc_vote,
+		e_rpc_replicate,
+		e_rpc_install_snapshot,
+		e_rpc_heartbeat,
+	};
+
+	transport::transport()
+	{
+
+	}
+
+	transport::~transport()
+	{
+		std::map<std::string, rpc_thread*>::iterator
+			it = rpc_threads_.begin();
+		for (; it != rpc_threads_.end(); ++it)
+		{
+			it->second->stop();
+			delete it->second;
+		}
+	}
+
+	void transport::async_vote(const std::string &peer_id,
+							   const vote_request &req,
+							   vote_response &resp,
+							   callback *_callback)
+	{
+		rpc _rpc = {e_rpc_vote, peer_id, &req, NULL, &resp, _callback};
+		async_call(_rpc);
+	}
+
+	void transport::async_replicate(const std::string &peer_id,
+									const replicate_log_entries_request &req,
+									replicate_log_entries_response &resp,
+									callback *_callback)
+	{
+		rpc _rpc = {e_rpc_replicate, peer_id, &req, NULL, &resp, _callback};
+		async_call(_rpc);
+	}
+
+	void transport::async_replicate(const std::string &peer_id,
+									const std::string &req,
+									replicate_log_entries_response &resp,
+									callback *_callback)
+	{
+		rpc _rpc = {e_rpc_replicate, peer_id, NULL, &req, &resp, _callback};
+		async_call(_rpc);
+	}
+
+	void transport::async_install_snapshot(
+		const std::string &peer_id,
+		const install_snapshot_request &req,
+		install_snapshot_response &resp,
+		callback *_callback)
+	{
+		rpc _rpc = {e_rpc_install_snapshot, peer_id,
+					&req, NULL, &resp, _callback};
+		async_call(_rpc);
+	}
+
+	void transport::async_heartbeat(const std::string &peer_id,
+									const heartbeat_request &req,
+									heartbeat_response &resp,
+									callback *_callback)
+	{
+		rpc _rpc = {e_rpc_heartbeat, peer_id, &req, NULL, &resp, _callback};
+		async_call(_rpc);
+	}
+
+	bool transport::replicate(const std::string &peer_id,
+							  const std::string &req,
+							  replicate_log_entries_response &resp)
+	{
+		replicate_log_entries_request _req;
+		if (!_req.ParseFromString(req))
+		{
+			logger_error("parse replicate_log_entries_request error");
+			return false;
+		}
+		return replicate(peer_id, _req, resp);
+	}
+
+	bool transport::pipeline()
+	{
+		return false;
+	}
+
+	void transport::async_call(const rpc &_rpc)
+	{
+		rpc_thread *thread = NULL;
+
+		rpc_threads_locker_.lock();
+		std::map<std::string, rpc_thread*>::iterator
+			it = rpc_threads_.find(_rpc.peer_id_);
+		if (it == rpc_threads_.end())
+		{
+			//started when the first request to peer sent
+			thread = new rpc_thread(*this);
+			thread->start();
+			rpc_threads_[_rpc.peer_id_] = thread;
+		}
+		else
+			thread = it->second;
+		rpc_threads_locker_.unlock();
+
+		thread->push(_rpc);
+	}
+
+	bool transport::invoke(const rpc &_rpc)
+	{
+		switch (_rpc.type_)
+		{
+		case e_rpc_vote:
+			return vote(_rpc.peer_id_,
+						*static_cast<const vote_request *>(_rpc.req_),
+						*static_cast<vote_response *>(_rpc.resp_));
+		case e_rpc_replicate:
+			if (_rpc.body_)
+			{
+				return replicate(
+					_rpc.peer_id_,
+					*_rpc.body_,
+					*static_cast<replicate_log_entries_response *>(_rpc.resp_));
+			}
+			return replicate(
+				_rpc.peer_id_,
+				*static_cast<const replicate_log_entries_request *>(_rpc.req_),
+				*static_cast<replicate_log_entries_response *>(_rpc.resp_));
+		case e_rpc_install_snapshot:
+			return install_snapshot(
+				_rpc.peer_id_,
+				*static_cast<const install_snapshot_request *>(_rpc.req_),
+				*static_cast<install_snapshot_response *>(_rpc.resp_));
+		case e_rpc_heartbeat:
+			return heartbeat(_rpc.peer_id_,
+							 *static_cast<const heartbeat_request *>(_rpc.req_),
+							 *static_cast<heartbeat_response *>(_rpc.resp_));
+		default:
+			logger_error("unknown rpc type.%d", _rpc.type_);
+			return false;
+		}
+	}
+
+	transport::rpc_thread::rpc_thread(transport &_transport)
+		:transport_(_transport),
+		 stop_(false)
+	{
+		acl_pthread_mutex_init(&mutex_, NULL);
+		acl_pthread_cond_init(&cond_, NULL);
+	}
+
+	transport::rpc_thread::~rpc_thread()
+	{
+		acl_pthread_mutex_destroy(&mutex_);
+		acl_pthread_cond_destroy(&cond_);
+	}
+
+	void transport::rpc_thread::push(const rpc &_rpc)
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		rpcs_.push_back(_rpc);
+		acl_pthread_cond_signal(&cond_);
+		acl_pthread_mutex_unlock(&mutex_);
+	}
+
+	void transport::rpc_thread::stop()
+	{
+		acl_pthread_mutex_lock(&mutex_);
+		stop_ = true;
+		acl_pthread_cond_signal(&cond_);
+		acl_pthread_mutex_unlock(&mutex_);
+
+		wait();
+	}
+
+	void *transport::rpc_thread::run()
+	{
+		for (;;)
+		{
+			acl_pthread_mutex_lock(&mutex_);
+			while (rpcs_.empty() && !stop_)
+				acl_pthread_cond_wait(&cond_, &mutex_);
+			if (rpcs_.empty())
+			{
+				acl_pthread_mutex_unlock(&mutex_);
+				break;
+			}
+			rpc _rpc = rpcs_.front();
+			rpcs_.pop_front();
+			acl_pthread_mutex_unlock(&mutex_);
+
+			_rpc.callback_->rpc_done(transport_.invoke(_rpc));
+		}
+		return NULL;
+	}
+
+	/**
+	 * request serialized already.pb_call take it as a message and
+	 * post the bytes as they are
+	 */
+	class serialized_request
+	{
+	public:
+		explicit serialized_request(const std::string &bytes)
+			:bytes_(bytes)
+		{
+
+		}
+
+		bool SerializeToString(std::string *output) const
+		{
+			output->assign(bytes_);
+			return true;
+		}
+
+		std::string SerializeAsString() const
+		{
+			return bytes_;
+		}
+
+		size_t ByteSizeLong() const
+		{
+			return bytes_.size();
+		}
+	private:
+		const std::string &bytes_;
+	};
+
+	http_rpc_transport::http_rpc_transport()
+		:rpc_client_(acl::http_rpc_client::get_instance())
+	{
+
+	}
+
+	http_rpc_transport &http_rpc_transport::get_instance()
+	{
+		static http_rpc_transport *instance = new http_rpc_transport;
+		return *instance;
+	}
+
+	void http_rpc_transport::add_peer(const std::string &peer_id,
+									  const std::string &addr)
+	{
+		acl::lock_guard lg(locker_);
+
+		if (paths_.find(peer_id) != paths_.end())
+			return;
+
+		//server_id/raft/interface
+		service_paths *paths = new service_paths;
+		paths->vote_.format("/memkv%s/raft/vote_req", peer_id.c_str());
+		paths->replicate_.format(
+			"/memkv%s/raft/replicate_log_req", peer_id.c_str());
+		paths->install_snapshot_.format(
+			"/memkv%s/raft/install_snapshot_req", peer_id.c_str());
+		paths->heartbeat_.format(
+			"/memkv%s/raft/heartbeat_req", peer_id.c_str());
+
+		rpc_client_.add_service(addr.c_str(), paths->vote_);
+		rpc_client_.add_service(addr.c_str(), paths->replicate_);
+		rpc_client_.add_service(addr.c_str(), paths->install_snapshot_);
+		rpc_client_.add_service(addr.c_str(), paths->heartbeat_);
+
+		paths_[peer_id] = paths;
+	}
+
+	const http_rpc_transport::service_paths *
+	http_rpc_transport::get_paths(const std::string &peer_id)
+	{
+		acl::lock_guard lg(locker_);
+
+		std::map<std::string, service_paths*>::iterator
+			it = paths_.find(peer_id);
+		if (it == paths_.end())
+		{
+			logger_error("peer not found.%s", peer_id.c_str());
+			return NULL;
+		}
+		return it->second;
+	}
+
+	template<class REQ, class RESP>
+	bool http_rpc_transport::call(const acl::string &path,
+								  const REQ &req,
+								  RESP &resp)
+	{
+		acl::http_rpc_client::status_t status =
+			rpc_client_.pb_call(path, req, resp);
+		if (!status)
+		{
+			logger_error("proto_call error.%s",
+						 status.error_str_.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	bool http_rpc_transport::vote(const std::string &peer_id,
+								  const vote_request &req,
+								  vote_response &resp)
+	{
+		const service_paths *paths = get_paths(peer_id);
+		return paths && call(paths->vote_, req, resp);
+	}
+
+	bool http_rpc_transport::replicate(
+		const std::string &peer_id,
+		const replicate_log_entries_request &req,
+		replicate_log_entries_response &resp)
+	{
+		const service_paths *paths = get_paths(peer_id);
+		return paths && call(paths->replicate_, req, resp);
+	}
+
+	bool http_rpc_transport::replicate(
+		const std::string &peer_id,
+		const std::string &req,
+		replicate_log_entries_response &resp)
+	{
+		const service_paths *paths = get_paths(peer_id);
+		return paths && call(paths->replicate_, serialized_request(req), resp);
+	}
+
+	bool http_rpc_transport::install_snapshot(
+		const std::string &peer_id,
+		const install_snapshot_request &req,
+		install_snapshot_response &resp)
+	{
+		const service_paths *paths = get_paths(peer_id);
+		return paths && call(paths->install_snapshot_, req, resp);
+	}
+
+	bool http_rpc_transport::heartbeat(const std::string &peer_id,
+									   const heartbeat_request &req,
+									   heartbeat_response &resp)
+	{
+		const service_paths *paths = get_paths(peer_id);
+		return paths && call(paths->heartbeat_, req, resp);
+	}
+}
@@ -0,0 +1,93 @@
+#include "raft.hpp"
+#include <iostream>
+
+
+using namespace raft;
+
+class conflict_term_test : public node
+{
+public:
+	conflict_term_test()
+	{
+		acl_make_dirs("conflict_term_test/log/", 0755);
+		acl_make_dirs("conflict_term_test/metadata/", 0755);
+		acl_make_dirs("conflict_term_test/snapshot/", 0755);
+
+		set_node_id("node1");
+		set_log_path("conflict_term_test/log/");
+		set_metadata_path("conflict_term_test/metadata/");
+		set_snapshot_path("conflict_term_test/snapshot/");
+	}
+
+	void do_test()
+	{
+		acl_assert(reload());
+
+		//entries [1,10] of term 1,[11,30] of term 2
+		acl_assert(append(1, 0, 0, 1, 10).success());
+		acl_assert(append(2, 10, 1, 11, 30).success());
+
+		acl_assert(last_index_of_term(1) == 10);
+		acl_assert(last_index_of_term(2) == 30);
+		acl_assert(last_index_of_term(3) == 0);
+		acl_assert(first_index_of_term(25, 2) == 11);
+		acl_assert(first_index_of_term(5, 1) == 1);
+
+		//leader of term 3 has [11,15] of term 3
+		replicate_log_entries_response resp = append(3, 15, 3, 0, 0);
+		acl_assert(!resp.success());
+		acl_assert(resp.conflict_term() == 2);
+		acl_assert(resp.conflict_index() == 11);
+		acl_assert(resp.last_log_index() == 10);
+
+		resp = append(3, 30, 3, 0, 0);
+		acl_assert(!resp.success());
+		acl_assert(resp.conflict_term() == 2);
+		acl_assert(resp.conflict_index() == 11);
+		acl_assert(last_log_index() == 30);
+
+		//log too short
+		resp = append(3, 40, 3, 0, 0);
+		acl_assert(!resp.success());
+		acl_assert(resp.conflict_term() == 0);
+		acl_assert(resp.conflict_index() == 31);
+
+		//match at the first index of conflict term - 1
+		resp = append(3, 10, 1, 0, 0);
+		acl_assert(resp.success());
+	}
+private:
+	replicate_log_entries_response append(term_t term,
+										  log_index_t prev_index,
+										  term_t prev_term,
+										  log_index_t begin,
+										  log_index_t end)
+	{
+		replicate_log_entries_request req;
+		replicate_log_entries_response resp;
+
+		req.set_term(term);
+		req.set_leader_id("node2");
+		req.set_prev_log_index(prev_index);
+		req.set_prev_log_term(prev_term);
+		for (log_index_t i = begin; begin && i <= end; i++)
+		{
+			log_entry *entry = req.add_entries();
+			entry->set_index(i);
+			entry->set_term(term);
+			entry->set_log_data("conflict term");
+		}
+		acl_assert(handle_replicate_log_request(req, resp));
+		return resp;
+	}
+};
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	conflict_term_test().do_test();
+
+	std::cout << "conflict_term test ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,53 @@
+#include <string>
+#include <iostream>
+
+#include "raft.hpp"
+
+using namespace raft;
+
+//known answer of crc32c
+void test_check_value()
+{
+	const char *data = "123456789";
+
+	acl_assert(crc32c(data, 9) == 0xE3069283);
+	acl_assert(crc32c_software(data, 9) == 0xE3069283);
+	acl_assert(crc32c("", 0) == 0);
+	acl_assert(crc32c_software("", 0) == 0);
+
+	//in pieces
+	acl_assert(crc32c(data + 4, 5, crc32c(data, 4)) == 0xE3069283);
+	acl_assert(crc32c_software(data + 4, 5,
+							   crc32c_software(data, 4)) == 0xE3069283);
+}
+
+//crc32c() and table lookup agree on all lengths and alignments
+void test_match()
+{
+	std::string buffer(4096 + 16, '\0');
+	for (size_t i = 0; i < buffer.size(); i++)
+		buffer[i] = static_cast<char>(i * 7 + 3);
+
+	for (size_t offset = 0; offset < 8; offset++)
+	{
+		for (size_t len = 0; len < 100; len++)
+		{
+			acl_assert(crc32c(buffer.data() + offset, len) ==
+					   crc32c_software(buffer.data() + offset, len));
+		}
+		acl_assert(crc32c(buffer.data() + offset, 4096) ==
+				   crc32c_software(buffer.data() + offset, 4096));
+	}
+}
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	std::cout << "crc32c hardware:" << crc32c_hardware() << std::endl;
+
+	test_check_value();
+	test_match();
+
+	return 0;
+}
@@ -0,0 +1,175 @@
+#include "raft.hpp"
+#include <iostream>
+
+#include "../test_helper.h"
+
+
+using namespace raft;
+
+#define GROUPS 8
+#define HOSTS  3
+
+//count heartbeats sent and groups in them
+struct counting_transport : loopback_transport
+{
+	counting_transport()
+		:heartbeats_(0),
+		 max_batch_(0)
+	{
+
+	}
+	virtual bool heartbeat(const std::string &peer_id,
+						   const heartbeat_request &req,
+						   heartbeat_response &resp)
+	{
+		heartbeats_++;
+		int size = req.requests_size();
+		while (size > max_batch_)
+			max_batch_ = size;
+
+		bool rc = loopback_transport::heartbeat(peer_id, req, resp);
+		if (rc)
+			acl_assert(resp.responses_size() == size);
+		return rc;
+	}
+	std::atomic<int> heartbeats_;
+	std::atomic<int> max_batch_;
+};
+
+static std::string host_id(int i)
+{
+	char id[32];
+	sprintf(id, "host%d", i);
+	return id;
+}
+
+static std::string group_id(int i)
+{
+	char id[32];
+	sprintf(id, "group%d", i);
+	return id;
+}
+
+//only host0 campaign,so it leads all the groups and
+//heartbeats of them go to the same hosts
+static multi_raft *create_host(int i, counting_transport &transport)
+{
+	std::string path = "heartbeat_batch_test/" + host_id(i) + "/";
+	multi_raft *host = new multi_raft(host_id(i),
+									  path,
+									  scheduler::get_instance(),
+									  transport);
+	//wait for heartbeats of all the groups
+	host->set_heartbeat_window(100);
+
+	std::vector<peer_info> peers;
+	for (int j = 0; j < HOSTS; j++)
+	{
+		if (j == i)
+			continue;
+		peer_info info;
+		info.peer_id_ = host_id(j);
+		info.addr_ = "loopback";
+		peers.push_back(info);
+	}
+
+	for (int j = 0; j < GROUPS; j++)
+	{
+		node *_node = host->create_group(group_id(j), peers);
+		acl_assert(_node);
+		_node->set_election_timeout(i == 0 ? 200 : 60000);
+		acl_assert(host->add_group(group_id(j)));
+		_node->start();
+	}
+	transport.bind(host_id(i), host);
+	return host;
+}
+
+static void wait_leaders(multi_raft *host)
+{
+	for (int i = 0; i < GROUPS; i++)
+	{
+		node *_node = host->get_group(group_id(i));
+		for (int j = 0; j < 100 && !_node->is_leader(); j++)
+			acl_doze(100);
+		acl_assert(_node->is_leader());
+	}
+}
+
+static void replicate(multi_raft *host, int count)
+{
+	counter_replicate_callback replicated;
+
+	for (int i = 0; i < GROUPS; i++)
+	{
+		node *_node = host->get_group(group_id(i));
+		for (int j = 0; j < count; j++)
+			acl_assert(_node->replicate("hello raft", &replicated));
+	}
+	for (int i = 0; i < 100 && replicated.ok_ < GROUPS * count; i++)
+		acl_doze(100);
+	acl_assert(replicated.ok_ == GROUPS * count);
+}
+
+//committed index of groups in host catch up with leader
+static void wait_catch_up(multi_raft *leader, multi_raft *host)
+{
+	for (int i = 0; i < GROUPS; i++)
+	{
+		node *_leader = leader->get_group(group_id(i));
+		node *_node = host->get_group(group_id(i));
+
+		for (int j = 0; j < 100 &&
+			 _node->committed_index() < _leader->committed_index(); j++)
+			acl_doze(100);
+		acl_assert(_node->committed_index() == _leader->committed_index());
+	}
+}
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	counting_transport transport;
+	std::vector<multi_raft*> hosts;
+
+	for (int i = 0; i < HOSTS; i++)
+		hosts.push_back(create_host(i, transport));
+
+	wait_leaders(hosts[0]);
+	replicate(hosts[0], 10);
+
+	//idle groups keep leader by heartbeats only
+	int heartbeats = transport.heartbeats_;
+	acl_doze(1000);
+	acl_assert(transport.heartbeats_ > heartbeats);
+	//heartbeats of groups sent together
+	acl_assert(transport.max_batch_ > 1);
+	for (int i = 0; i < GROUPS; i++)
+		acl_assert(hosts[0]->get_group(group_id(i))->is_leader());
+
+	//host2 miss entries
+	transport.set_connected(host_id(2), false);
+	replicate(hosts[0], 10);
+
+	//restart host0.new leaders don't know what host2 has
+	transport.unbind(host_id(0));
+	delete hosts[0];
+	hosts[0] = create_host(0, transport);
+	wait_leaders(hosts[0]);
+
+	//heartbeats to host2 fail.and rejected when it come back,
+	//leader backtrack and replicate entries it miss
+	acl_doze(500);
+	transport.set_connected(host_id(2), true);
+	wait_catch_up(hosts[0], hosts[2]);
+	wait_catch_up(hosts[0], hosts[1]);
+
+	for (int i = 0; i < HOSTS; i++)
+		transport.unbind(host_id(i));
+	for (int i = 0; i < HOSTS; i++)
+		delete hosts[i];
+
+	std::cout << "heartbeat batch test ok" << std::endl;
+	return 0;
+}
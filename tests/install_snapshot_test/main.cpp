@@ -0,0 +1,160 @@
+#include "raft.hpp"
+#include <iostream>
+
+#include "../test_helper.h"
+
+
+using namespace raft;
+
+#define NODES   3
+#define ENTRIES 2000
+
+//remember version of the last entry applied
+struct version_apply_callback : apply_callback
+{
+	virtual bool operator()(const std::string &, const version &ver)
+	{
+		acl::lock_guard lg(locker_);
+		ver_ = ver;
+		return true;
+	}
+	version ver_;
+	acl::locker locker_;
+};
+
+//snapshot of 3 chunks.version and padding
+struct padding_snapshot_callback : make_snapshot_callback
+{
+	explicit padding_snapshot_callback(version_apply_callback &applied)
+		:applied_(applied)
+	{
+
+	}
+	virtual bool operator()(const std::string &path, std::string &filepath)
+	{
+		version ver;
+		applied_.locker_.lock();
+		ver = applied_.ver_;
+		applied_.locker_.unlock();
+
+		char name[64];
+		sprintf(name, "%llu.temp_snapshot", (unsigned long long) ver.index_);
+		filepath = path + name;
+
+		acl::ofstream file;
+		if (!file.open_trunc(filepath.c_str()))
+			return false;
+		std::string padding(2 * 1024 * 1024 + 100, 'x');
+		return write(file, ver) && write(file, padding);
+	}
+	version_apply_callback &applied_;
+};
+
+struct counter_load_snapshot_callback : load_snapshot_callback
+{
+	counter_load_snapshot_callback()
+		:loads_(0)
+	{
+
+	}
+	virtual bool operator()(const std::string &)
+	{
+		loads_++;
+		return true;
+	}
+	std::atomic<int> loads_;
+};
+
+static bool has_snapshot(const std::string &path)
+{
+	return !list_dir(path, ".snapshot").empty();
+}
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	loopback_transport transport;
+	std::vector<node*> nodes;
+	std::vector<version_apply_callback*> applies;
+	std::vector<padding_snapshot_callback*> makes;
+	std::vector<counter_load_snapshot_callback*> loads;
+	std::vector<std::string> addrs(NODES, "loopback");
+
+	for (int i = 0; i < NODES; i++)
+	{
+		version_apply_callback *apply = new version_apply_callback;
+		padding_snapshot_callback *make = new padding_snapshot_callback(*apply);
+		counter_load_snapshot_callback *load =
+			new counter_load_snapshot_callback;
+
+		node *_node = new node;
+		init_node(*_node, "install_snapshot_test/", i, addrs);
+		_node->set_transport(transport);
+		_node->set_apply_callback(apply);
+		_node->set_make_snapshot_callback(make);
+		_node->set_load_snapshot_callback(load);
+		_node->set_election_timeout(200);
+		//compact log soon
+		_node->set_max_log_size(64 * 1024);
+		_node->set_max_log_count(4);
+		acl_assert(_node->reload());
+
+		transport.bind(_node->node_id(), _node);
+		nodes.push_back(_node);
+		applies.push_back(apply);
+		makes.push_back(make);
+		loads.push_back(load);
+	}
+	for (int i = 0; i < NODES; i++)
+		nodes[i]->start();
+
+	node *leader = wait_leader(nodes);
+	acl_assert(leader);
+	std::cout << "leader: " << leader->node_id() << std::endl;
+
+	//a follower miss entries compacted by leader
+	int lagger = 0;
+	while (nodes[lagger] == leader)
+		lagger++;
+	transport.set_connected(nodes[lagger]->node_id(), false);
+
+	std::string data(1000, 'a');
+	counter_replicate_callback replicated;
+	for (int i = 0; i < ENTRIES; i++)
+		acl_assert(leader->replicate(data, &replicated));
+	for (int i = 0; i < 100 && replicated.ok_ < ENTRIES; i++)
+		acl_doze(100);
+	acl_assert(replicated.ok_ == ENTRIES);
+
+	std::string snapshot_path = std::string("install_snapshot_test/") +
+		leader->node_id() + "/snapshot/";
+	for (int i = 0; i < 100 && !has_snapshot(snapshot_path); i++)
+		acl_doze(100);
+	acl_assert(has_snapshot(snapshot_path));
+
+	//leader send snapshot in chunks,then the entries after it
+	transport.set_connected(nodes[lagger]->node_id(), true);
+	for (int i = 0; i < 100 && !loads[lagger]->loads_; i++)
+		acl_doze(100);
+	acl_assert(loads[lagger]->loads_ > 0);
+
+	leader = wait_leader(nodes);
+	acl_assert(leader);
+	for (int i = 0; i < 100 &&
+		 nodes[lagger]->committed_index() < leader->committed_index(); i++)
+		acl_doze(100);
+	acl_assert(nodes[lagger]->committed_index() >= leader->committed_index());
+
+	for (int i = 0; i < NODES; i++)
+	{
+		transport.unbind(nodes[i]->node_id());
+		delete nodes[i];
+		delete applies[i];
+		delete makes[i];
+		delete loads[i];
+	}
+
+	std::cout << "install snapshot test ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,157 @@
+#include "raft.hpp"
+#include <iostream>
+
+#include "../test_helper.h"
+
+
+using namespace raft;
+
+struct counter_apply_callback : apply_callback
+{
+	counter_apply_callback()
+		:count_(0),
+		 batches_(0)
+	{
+
+	}
+	virtual bool operator()(const std::string &, const version &)
+	{
+		count_++;
+		return true;
+	}
+	virtual size_t apply_batch(const log_entry_view *views, size_t count)
+	{
+		//a run of entries
+		for (size_t i = 1; i < count; i++)
+			acl_assert(views[i].index_ == views[i - 1].index_ + 1);
+
+		batches_++;
+		return apply_callback::apply_batch(views, count);
+	}
+	std::atomic<int> count_;
+	std::atomic<int> batches_;
+};
+
+struct counter_read_index_callback : read_index_callback
+{
+	counter_read_index_callback()
+		:ok_(0),
+		 index_(0)
+	{
+
+	}
+	virtual void operator()(replicate_callback::status_t status,
+							log_index_t index)
+	{
+		if (status != replicate_callback::E_OK)
+			return;
+		index_ = index;
+		ok_++;
+	}
+	std::atomic<int> ok_;
+	std::atomic<log_index_t> index_;
+};
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	const int count = 3;
+	const int entries = 100;
+
+	loopback_transport transport;
+	std::vector<node*> nodes;
+	std::vector<counter_apply_callback*> callbacks;
+	std::vector<std::string> addrs(count, "loopback");
+
+	//3 nodes cluster in this process
+	for (int i = 0; i < count; i++)
+	{
+		node *_node = new node;
+		counter_apply_callback *callback = new counter_apply_callback;
+
+		init_node(*_node, "loopback_test/", i, addrs);
+		_node->set_apply_callback(callback);
+		_node->set_transport(transport);
+		_node->set_election_timeout(200);
+		//replicate(...) wait for free slots
+		_node->set_max_pending_replicates(16);
+		//indexes written to metadata in background
+		_node->set_index_checkpoint(100);
+		acl_assert(_node->reload());
+
+		transport.bind(_node->node_id(), _node);
+		nodes.push_back(_node);
+		callbacks.push_back(callback);
+	}
+	for (int i = 0; i < count; i++)
+		nodes[i]->start();
+
+	node *leader = wait_leader(nodes);
+	acl_assert(leader);
+	std::cout << "leader: " << leader->node_id() << std::endl;
+
+	//read before any entry written in leader's term
+	counter_read_index_callback idle_read;
+	acl_assert(leader->read_index(&idle_read));
+	for (int i = 0; i < 100 && idle_read.ok_ < 1; i++)
+		acl_doze(100);
+	acl_assert(idle_read.ok_ == 1);
+
+	counter_replicate_callback replicated;
+	for (int i = 0; i < entries; i++)
+		acl_assert(leader->replicate("hello raft", &replicated));
+
+	for (int i = 0; i < 100 && replicated.ok_ < entries; i++)
+		acl_doze(100);
+	acl_assert(replicated.ok_ == entries);
+
+	//leader and followers apply all the entries
+	for (int i = 0; i < count; i++)
+	{
+		for (int j = 0; j < 100 && callbacks[i]->count_ < entries; j++)
+			acl_doze(100);
+		acl_assert(callbacks[i]->count_ >= entries);
+		acl_assert(callbacks[i]->batches_ <= callbacks[i]->count_);
+	}
+
+	//reads at the same time share rounds.no log written
+	log_index_t committed = leader->committed_index();
+	counter_read_index_callback reads;
+	for (int i = 0; i < 10; i++)
+		acl_assert(leader->read_index(&reads));
+	for (int i = 0; i < 100 && reads.ok_ < 10; i++)
+		acl_doze(100);
+	acl_assert(reads.ok_ == 10);
+	acl_assert(reads.index_ >= committed);
+	acl_assert(leader->committed_index() == committed);
+	acl_assert(leader->applied_index() >= reads.index_);
+
+	//followers not serve read_index
+	for (int i = 0; i < count; i++)
+	{
+		if (nodes[i] != leader)
+			acl_assert(!nodes[i]->read_index(&reads));
+	}
+
+	std::vector<log_index_t> applied;
+	for (int i = 0; i < count; i++)
+	{
+		applied.push_back(nodes[i]->applied_index());
+		transport.unbind(nodes[i]->node_id());
+		delete nodes[i];
+		delete callbacks[i];
+	}
+
+	//indexes checkpointed when node destroyed
+	for (int i = 0; i < count; i++)
+	{
+		node _node;
+		init_node_paths(_node, "loopback_test/", i);
+		acl_assert(_node.reload());
+		acl_assert(_node.applied_index() >= applied[i]);
+		acl_assert(_node.committed_index() >= applied[i]);
+	}
+	std::cout << "loopback test ok" << std::endl;
+	return 0;
+}
@@ -1,19 +1,18 @@
 #include "raft.hpp"
 using namespace raft;
 
-#define METADATA_TEST_COUNT 100000
+#define METADATA_TEST_COUNT 1000
+#define METADATA_TEST_DIR "metadata_test_dir/"
 
-raft::metadata metadata_(64*1024);
-
-void do_write_test(size_t count)
+void do_write_test(metadata &metadata_, size_t count)
 {
     logger("begin write");
 	for (size_t i = 0; i < count; i++)
 	{
-		metadata_.set_applied_index(i);
-		metadata_.set_committed_index(i);
-		metadata_.set_current_term(i);
-		metadata_.set_vote_for("hello", i);
+		acl_assert(metadata_.set_applied_index(i));
+		acl_assert(metadata_.set_committed_index(i));
+		acl_assert(metadata_.set_current_term(i));
+		acl_assert(metadata_.set_vote_for("hello", i));
 	}
 	acl_assert(metadata_.get_applied_index() == count-1);
 	acl_assert(metadata_.get_committed_index() == count - 1);
@@ -22,7 +21,7 @@ void do_write_test(size_t count)
 	acl_assert(vote_for.first == count - 1);
 	acl_assert(vote_for.second == "hello");
 }
-void do_read_test(size_t value)
+void do_read_test(metadata &metadata_, size_t value)
 {
     logger("do read");
 	acl_assert(metadata_.get_applied_index() == value);
@@ -32,19 +31,171 @@ void do_read_test(size_t value)
 	acl_assert(vote_for.first == value);
 	acl_assert(vote_for.second == "hello");
 }
+
+//break the slot with the bigger seq
+void do_break_newest_slot()
+{
+	const char *file_path = METADATA_TEST_DIR "metadata.slot";
+	long long size = acl_file_size(file_path);
+	acl_assert(size > 0);
+
+	std::string buffer((size_t) size, '\0');
+	FILE *file = fopen(file_path, "r+b");
+	acl_assert(file);
+	acl_assert(fread(&buffer[0], 1, buffer.size(), file) == buffer.size());
+
+	unsigned char *data = (unsigned char *)&buffer[0];
+	unsigned char *slot0 = data + sizeof(int) * 3;
+	unsigned char *slot1 = data + size / 2 + sizeof(int) * 3;
+	unsigned long long seq0 = get_uint64(slot0);
+	unsigned long long seq1 = get_uint64(slot1);
+
+	//flip a byte of current_term
+	long offset = seq0 > seq1 ? 0 : (long) size / 2;
+	offset += sizeof(int) * 3 + 8;
+	data[offset] ^= 0xff;
+
+	acl_assert(fseek(file, offset, SEEK_SET) == 0);
+	acl_assert(fwrite(data + offset, 1, 1, file) == 1);
+	fclose(file);
+}
+
+#define JOURNAL_TEST_DIR "metadata_journal_test_dir/"
+
+//record of old journal with crc32c
+void put_record(unsigned char *&buffer, unsigned char type,
+				const std::string &value)
+{
+	std::string data(1, (char) type);
+	data += value;
+
+	put_uint32(buffer, 192837465);
+	put_uint32(buffer, (unsigned int) data.size());
+	put_uint32(buffer, crc32c(data.data(), data.size()));
+	memcpy(buffer, data.data(), data.size());
+	buffer += data.size();
+	put_uint32(buffer, 987654321);
+}
+
+std::string uint64_value(unsigned long long value)
+{
+	unsigned char buf[8];
+	unsigned char *buffer = buf;
+	put_uint64(buffer, value);
+	return std::string((char *) buf, sizeof(buf));
+}
+
+void write_journal(const char *file_path, term_t term)
+{
+	unsigned char buf[4096];
+	unsigned char *buffer = buf;
+	memset(buf, 0, sizeof(buf));
+
+	//record without crc32c
+	put_uint32(buffer, 123456789);
+	put_uint8(buffer, 4);
+	put_uint64(buffer, term);
+	put_uint32(buffer, 987654321);
+
+	put_record(buffer, 2, uint64_value(7));
+	put_record(buffer, 1, uint64_value(6));
+
+	unsigned char vote[64];
+	unsigned char *vote_buffer = vote;
+	put_uint64(vote_buffer, term);
+	put_string(vote_buffer, "node1");
+	put_record(buffer, 3, std::string((char *) vote, vote_buffer - vote));
+
+	unsigned char peers[64];
+	unsigned char *peers_buffer = peers;
+	put_uint32(peers_buffer, 1);
+	put_string(peers_buffer, "node2");
+	put_string(peers_buffer, "127.0.0.1:10002");
+	put_record(buffer, 5,
+			   std::string((char *) peers, peers_buffer - peers));
+
+	//broken record is dropped
+	unsigned char *broken = buffer;
+	put_record(buffer, 4, uint64_value(term + 100));
+	broken[sizeof(int) * 3 + 1] ^= 0xff;
+
+	FILE *file = fopen(file_path, "wb");
+	acl_assert(file);
+	acl_assert(fwrite(buf, 1, sizeof(buf), file) == sizeof(buf));
+	fclose(file);
+}
+
+void check_migrated(metadata &metadata_)
+{
+	acl_assert(metadata_.get_current_term() == 5);
+	acl_assert(metadata_.get_committed_index() == 7);
+	acl_assert(metadata_.get_applied_index() == 6);
+
+	std::pair<term_t, std::string> vote_for = metadata_.get_vote_for();
+	acl_assert(vote_for.first == 5);
+	acl_assert(vote_for.second == "node1");
+
+	std::vector<peer_info> infos = metadata_.get_peer_info();
+	acl_assert(infos.size() == 1);
+	acl_assert(infos[0].peer_id_ == "node2");
+	acl_assert(infos[0].addr_ == "127.0.0.1:10002");
+}
+
+//old journal files migrate to slot file
+void do_migrate_test()
+{
+	acl_assert(acl_make_dirs(JOURNAL_TEST_DIR, 0755) == 0);
+	remove(JOURNAL_TEST_DIR "metadata.slot");
+
+	//the newest one is replayed
+	write_journal(JOURNAL_TEST_DIR "1.meta", 3);
+	write_journal(JOURNAL_TEST_DIR "2.meta", 5);
+	{
+		metadata metadata_;
+		acl_assert(metadata_.reload(JOURNAL_TEST_DIR));
+		check_migrated(metadata_);
+	}
+	acl_assert(list_dir(JOURNAL_TEST_DIR, ".meta").empty());
+
+	metadata metadata_;
+	acl_assert(metadata_.reload(JOURNAL_TEST_DIR));
+	check_migrated(metadata_);
+}
+
 int main()
 {
     acl::log::stdout_open(true);
 
-	acl_assert(metadata_.reload("metadata_test_dir/"));
-	if (metadata_.get_applied_index() == 0)
+	acl_assert(acl_make_dirs(METADATA_TEST_DIR, 0755) == 0);
+	remove(METADATA_TEST_DIR "metadata.slot");
+
 	{
-		do_write_test(METADATA_TEST_COUNT);
+		metadata metadata_;
+		acl_assert(metadata_.reload(METADATA_TEST_DIR));
+		acl_assert(metadata_.get_applied_index() == 0);
+		do_write_test(metadata_, METADATA_TEST_COUNT);
 	}
-	else
 	{
-		do_read_test(METADATA_TEST_COUNT - 1);
+		//reload from the newest slot
+		metadata metadata_;
+		acl_assert(metadata_.reload(METADATA_TEST_DIR));
+		do_read_test(metadata_, METADATA_TEST_COUNT - 1);
+
+		//term flushed to one slot.indexes in the other
+		acl_assert(metadata_.set_current_term(METADATA_TEST_COUNT));
+		acl_assert(metadata_.set_committed_index(METADATA_TEST_COUNT));
+		acl_assert(metadata_.set_applied_index(METADATA_TEST_COUNT));
+	}
+	do_break_newest_slot();
+	{
+		//torn newest slot.fall back to the older one
+		metadata metadata_;
+		acl_assert(metadata_.reload(METADATA_TEST_DIR));
+		acl_assert(metadata_.get_current_term() == METADATA_TEST_COUNT);
+		acl_assert(metadata_.get_committed_index() ==
+				   METADATA_TEST_COUNT - 1);
 	}
 
+	do_migrate_test();
 	return 0;
-}
\ No newline at end of file
+}
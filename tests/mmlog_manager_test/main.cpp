@@ -12,6 +12,9 @@ void create_log_manger()
 //    mkdir("mmap_log_manger_test",S_IRWXU|S_IRGRP|S_IXGRP|S_IROTH);
 	log_manager_ = 
 		new mmap_log_manager("mmap_log_manger_test/");
+	log_manager_->set_sync_mode(log_manager::e_sync_group, 1000, 1000);
+	log_manager_->set_cache_size(4 * 1024 * 1024);
+	log_manager_->set_preallocate(2, true);
 }
 void close_log_manager()
 {
@@ -42,6 +45,29 @@ void write(log_index_t begin,log_index_t  end)
 		log_manager_->write(entry);
 	}
 }
+void write_batch(log_index_t begin, log_index_t end, size_t batch)
+{
+	std::vector<log_entry> entries;
+
+	for (log_index_t i = begin; i < end; i++)
+	{
+		log_entry entry;
+		entry.set_term(1);
+		entry.set_type(e_raft_log);
+
+		std::string buffer(1000, 'a');
+		buffer += to_string(i);
+
+		entry.mutable_log_data()->append(buffer);
+		entries.push_back(entry);
+
+		if (entries.size() == batch || i + 1 == end)
+		{
+			acl_assert(log_manager_->write(entries) == i);
+			entries.clear();
+		}
+	}
+}
 void read(int start, int end)
 {
 	for (int i = start; i < end ; i++)
@@ -52,6 +78,72 @@ void read(int start, int end)
 	}
 }
 
+//the latest entries are read from cache
+void read_cache()
+{
+	log_index_t last = log_manager_->last_index();
+	std::vector<log_entry*> entries;
+
+	acl_assert(log_manager_->read(last - 9, 1024 * 1024, 10, entries));
+	acl_assert(entries.size() == 10);
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		acl_assert(entries[i]->index() == last - 9 + i);
+		acl_assert(entries[i]->log_data().substr(1000) ==
+				   to_string(entries[i]->index()));
+		delete entries[i];
+	}
+}
+
+//log_entry objects cleared are reused
+void read_reuse()
+{
+	log_entries_t entries;
+	log_index_t start = log_manager_->start_index();
+
+	acl_assert(log_manager_->read(start, 1024 * 1024, 10, entries));
+	acl_assert(entries.size() == 10);
+	const log_entry *first = &entries.Get(0);
+
+	entries.Clear();
+	acl_assert(log_manager_->read(start + 1, 1024 * 1024, 10, entries));
+	acl_assert(entries.size() == 10);
+	acl_assert(&entries.Get(0) == first);
+
+	for (int i = 0; i < entries.size(); i++)
+	{
+		acl_assert(entries.Get(i).index() == start + 1 + i);
+		acl_assert(entries.Get(i).log_data().substr(1000) ==
+				   to_string(entries.Get(i).index()));
+	}
+}
+
+//entries encoded are the same as the ones in request
+void read_encoded(log_index_t index)
+{
+	log_entries_t entries;
+	std::string encoded;
+	int count = 0;
+
+	acl_assert(log_manager_->read(index, 1024 * 1024, 10, entries));
+	acl_assert(log_manager_->read(index, 1024 * 1024, 10, encoded, count));
+	acl_assert(count == entries.size());
+
+	replicate_log_entries_request req;
+	req.set_term(1);
+	acl_assert(req.AppendToString(&encoded));
+	acl_assert(req.ParseFromString(encoded));
+	acl_assert(req.term() == 1);
+	acl_assert(req.entries_size() == count);
+
+	for (int i = 0; i < count; i++)
+	{
+		acl_assert(req.entries(i).SerializeAsString() ==
+				   entries.Get(i).SerializeAsString());
+	}
+}
+
 void read_all()
 {
 	std::vector<log_entry*> entries;
@@ -89,10 +181,24 @@ void discard()
 	std::map<log_index_t, log_index_t> log_infos = 
 		log_manager_->logs_info();
 
+	int count = 0;
+
+	//segments up to the last index of the second one in one go
+	if (log_infos.size() > 3)
+	{
+		std::map<log_index_t, log_index_t>::iterator second =
+			++log_infos.begin();
+
+		count = log_manager_->discard_log(second->second);
+		acl_assert(count == 2);
+		acl_assert(log_manager_->logs_info().size() ==
+				   log_infos.size() - 2);
+		log_infos = log_manager_->logs_info();
+	}
+
 	std::map<log_index_t, log_index_t>::iterator it = 
 		log_infos.begin();
 
-	int count = 0;
 	for (; it != log_infos.end(); ++it)
 	{
 		if (count < log_infos.size() / 2)
@@ -102,9 +208,104 @@ void discard()
 	}
 	std::cout << "discard log count:" << count << std::endl;
 }
+//logs after a missing one are not reloaded
+void reload_hole()
+{
+	const char *path = "mmap_log_manger_hole_test/";
+	acl_assert(acl_make_dirs(path, 0755) == 0);
+	std::set<std::string> files = list_dir(path, "");
+	for (std::set<std::string>::iterator it = files.begin();
+		 it != files.end(); ++it)
+		remove(it->c_str());
+
+	log_manager *manager = new mmap_log_manager(path);
+	manager->set_log_size(64 * 1024);
+	acl_assert(manager->reload_logs());
+
+	for (int i = 0; i < 500; i++)
+	{
+		log_entry entry;
+		entry.set_term(1);
+		entry.set_type(e_raft_log);
+		entry.set_log_data(std::string(1000, 'a'));
+		acl_assert(manager->write(entry));
+	}
+	acl_assert(manager->sync(manager->last_index()));
+
+	std::map<log_index_t, log_index_t> log_infos = manager->logs_info();
+	acl_assert(log_infos.size() > 3);
+	delete manager;
+
+	//remove the second log
+	std::map<log_index_t, log_index_t>::iterator second =
+		++log_infos.begin();
+	std::string file_path(path);
+	file_path += to_string(second->first);
+	file_path += ".log";
+	acl_assert(remove(file_path.c_str()) == 0);
+	acl_assert(remove((file_path + ".index").c_str()) == 0);
+
+	manager = new mmap_log_manager(path);
+	manager->set_log_size(64 * 1024);
+	acl_assert(manager->reload_logs());
+	acl_assert(manager->logs_info().size() == 1);
+	acl_assert(manager->last_index() == log_infos.begin()->second);
+	acl_assert(list_dir(path, ".broken").size() ==
+			   (log_infos.size() - 2) * 2);
+	delete manager;
+}
+
+//reload fails on a log file can't open
+void reload_error()
+{
+	const char *path = "mmap_log_manger_error_test/";
+	acl_assert(acl_make_dirs(path, 0755) == 0);
+	std::set<std::string> files = list_dir(path, "");
+	for (std::set<std::string>::iterator it = files.begin();
+		 it != files.end(); ++it)
+		remove(it->c_str());
+
+	log_manager *manager = new mmap_log_manager(path);
+	manager->set_log_size(64 * 1024);
+	acl_assert(manager->reload_logs());
+	for (int i = 0; i < 200; i++)
+	{
+		log_entry entry;
+		entry.set_term(1);
+		entry.set_type(e_raft_log);
+		entry.set_log_data(std::string(1000, 'a'));
+		acl_assert(manager->write(entry));
+	}
+	acl_assert(manager->sync(manager->last_index()));
+	acl_assert(manager->logs_info().size() > 1);
+	delete manager;
+
+	//not a log file.sorted after the others
+	std::string file_path(path);
+	file_path += "999999999.log";
+	FILE *file = fopen(file_path.c_str(), "w");
+	acl_assert(file && fputs("broken", file) >= 0);
+	fclose(file);
+	file = fopen((file_path + ".index").c_str(), "w");
+	acl_assert(file && fputs("broken", file) >= 0);
+	fclose(file);
+
+	manager = new mmap_log_manager(path);
+	manager->set_log_size(64 * 1024);
+	acl_assert(!manager->reload_logs());
+	acl_assert(manager->logs_info().empty());
+	delete manager;
+
+	acl_assert(remove(file_path.c_str()) == 0);
+	acl_assert(remove((file_path + ".index").c_str()) == 0);
+}
+
 int main()
 {
 	acl::log::stdout_open(true);
+
+	reload_hole();
+	reload_error();
 	//create
 	create_log_manger();
 
@@ -120,6 +321,24 @@ int main()
 	log_index_t end   = start + 1000000;
 	write(start, end);
 
+	//write batch
+	write_batch(end, end + 100000, 100);
+
+	//flush
+	acl_assert(log_manager_->sync(log_manager_->last_index()));
+	acl_assert(log_manager_->sync_index() == log_manager_->last_index());
+
+	//the only flusher doesn't wait for a group
+	log_manager_->set_sync_mode(log_manager::e_sync_group, 1000, 1000000);
+	write(log_manager_->last_index() + 1, log_manager_->last_index() + 2);
+	timeval begin, now;
+	gettimeofday(&begin, NULL);
+	acl_assert(log_manager_->sync(log_manager_->last_index(), false));
+	gettimeofday(&now, NULL);
+	acl_assert((now.tv_sec - begin.tv_sec) * 1000000 +
+			   (now.tv_usec - begin.tv_usec) < 500000);
+	log_manager_->set_sync_mode(log_manager::e_sync_group, 1000, 1000);
+
 
 	//log count
 	std::cout << log_manager_->log_count() << std::endl;;
@@ -144,6 +363,14 @@ int main()
 	//read
 	/*read(log_manager_->start_index(), log_manager_->last_index() + 1)*/;
 
+	read_cache();
+
+	read_reuse();
+
+	//from cache and from log files
+	read_encoded(log_manager_->last_index() - 9);
+	read_encoded(log_manager_->start_index());
+
 	read_all();
 
 	//discard log
@@ -34,6 +34,22 @@ void test_read(raft::mmap_log &log)
 
 	acl_assert(entries.size() == 999);
 
+	{
+		std::vector<log_entry_view> views;
+		bytes = 0;
+		acl_assert(log.read(1, 1000000, 100000, views, bytes));
+		acl_assert(views.size() == 999);
+		acl_assert(log.ref() == 1000);
+
+		for (size_t j = 0; j < views.size(); ++j)
+		{
+			acl_assert(views[j].index_ == j + 1);
+			acl_assert(views[j].term_ == j + 1);
+			acl_assert(views[j].data() == "hello");
+		}
+	}
+	//views release refs of log
+	acl_assert(log.ref() == 1);
 }
 void test_write(mmap_log &log)
 {
@@ -47,13 +63,12 @@ void test_write(mmap_log &log)
 
 		acl_assert(log.write(entry));
 	}
+	acl_assert(log.sync());
 }
-int main()
+void test_log(const char *filepath, mmap_log::format_t format)
 {
-	acl::log::stdout_open(true);
-	mmap_log log(0,1000);
-	const char *filepath = "mmap.log";
-	
+	mmap_log log(0, 1000, format);
+
 	bool exist = acl_file_size(filepath) != -1;
 	acl_assert(log.open(filepath));
 
@@ -67,6 +82,224 @@ int main()
 		test_read(log);
 	}
 	log.auto_delete(true);
+}
+
+//log file write by e_format_protobuf can be read and
+//append with e_format_binary
+void test_upgrade(const char *filepath)
+{
+	{
+		mmap_log log(0, 1000, mmap_log::e_format_protobuf);
+		acl_assert(log.open(filepath));
+		count = 500;
+		test_write(log);
+	}
+
+	mmap_log log(0, 1000, mmap_log::e_format_binary);
+	acl_assert(log.open(filepath));
+	acl_assert(log.last_index() == 499);
+	acl_assert(log.last_term() == 499);
+
+	for (int i = 500; i < 1000; i++)
+	{
+		log_entry entry;
+		entry.set_term(i);
+		entry.set_type(e_raft_log);
+		entry.set_log_data(std::string("hello"));
+
+		acl_assert(log.write(entry) == i);
+	}
+	count = 1000;
+	test_read(log);
+	log.auto_delete(true);
+}
+
+//broken entry is dropped when reload
+void test_broken(const char *filepath)
+{
+	{
+		mmap_log log(0, 1000, mmap_log::e_format_binary);
+		acl_assert(log.open(filepath));
+		count = 1000;
+		test_write(log);
+	}
+	{
+		//flip one byte of log data of entry 500
+		std::vector<log_entry_view> views;
+		int bytes = 0;
+		mmap_log log(0, 1000, mmap_log::e_format_binary);
+		acl_assert(log.open(filepath));
+		acl_assert(log.read(500, 1, 1, views, bytes));
+		const_cast<char*>(views[0].data_)[0] ^= 0xff;
+	}
+
+	mmap_log log(0, 1000, mmap_log::e_format_binary);
+	log.set_verify(mmap_log::e_verify_always);
+	acl_assert(log.open(filepath));
+	acl_assert(log.last_index() == 499);
+	acl_assert(log.last_term() == 499);
+
+	log_entry entry;
+	entry.set_term(500);
+	entry.set_log_data(std::string("hello"));
+	acl_assert(log.write(entry) == 500);
+	acl_assert(log.read(500, entry));
+	acl_assert(entry.log_data() == "hello");
+	log.auto_delete(true);
+}
+
+//broken length of binary entry never read past the mapping
+void test_broken_len(const char *filepath)
+{
+	mmap_log log(0, 64 * 1024, mmap_log::e_format_binary);
+	acl_assert(log.open(filepath));
+
+	log_entry entry;
+	entry.set_term(1);
+	entry.set_log_data(std::string(100, 'a'));
+	for (int i = 0; i < 10; i++)
+		acl_assert(log.write(entry));
+
+	std::vector<log_entry_view> views;
+	int bytes = 0;
+	acl_assert(log.read(5, 1, 1, views, bytes));
+
+	//length is the field before checksum
+	unsigned char *len = (unsigned char*)views[0].data_ - sizeof(int) * 2;
+	put_le_uint32(len, 0xffffffff);
+
+	acl_assert(!log.read(5, entry));
+	views.clear();
+	acl_assert(!log.read(5, 1, 1, views, bytes));
+	log.set_verify(mmap_log::e_verify_always);
+	acl_assert(!log.read(5, entry));
+	log.auto_delete(true);
+}
+
+//sealed log reopen with footer
+void test_seal(const char *filepath, mmap_log::format_t format)
+{
+	log_index_t last_index = 0;
+	{
+		mmap_log log(0, 64 * 1024, format);
+		acl_assert(log.open(filepath));
+
+		log_entry entry;
+		entry.set_log_data(std::string(100, 'a'));
+		for (term_t term = 1; ; term++)
+		{
+			entry.set_term(term);
+			log_index_t index = log.write(entry);
+			if (!index)
+				break;
+			last_index = index;
+		}
+		acl_assert(log.eof());
+		acl_assert(log.sync());
+	}
+
+	mmap_log log(0, 64 * 1024, format);
+	acl_assert(log.open(filepath));
+	//open from footer
+	acl_assert(log.eof());
+	acl_assert(log.start_index() == 1);
+	acl_assert(log.last_index() == last_index);
+	acl_assert(log.last_term() == last_index);
+
+	log_entry entry;
+	acl_assert(log.read(last_index, entry));
+	acl_assert(entry.term() == last_index);
+	log.auto_delete(true);
+}
+
+//broken entry of sealed log verified in reload
+void test_broken_seal(const char *filepath)
+{
+	{
+		mmap_log log(0, 64 * 1024, mmap_log::e_format_binary);
+		acl_assert(log.open(filepath));
+
+		log_entry entry;
+		entry.set_log_data(std::string(100, 'a'));
+		for (term_t term = 1; ; term++)
+		{
+			entry.set_term(term);
+			if (!log.write(entry))
+				break;
+		}
+		acl_assert(log.eof());
+		acl_assert(log.sync());
+	}
+	{
+		//flip one byte of log data of entry 10
+		std::vector<log_entry_view> views;
+		int bytes = 0;
+		mmap_log log(0, 64 * 1024, mmap_log::e_format_binary);
+		acl_assert(log.open(filepath));
+		acl_assert(log.eof());
+		acl_assert(log.read(10, 1, 1, views, bytes));
+		const_cast<char*>(views[0].data_)[0] ^= 0xff;
+	}
+
+	//default e_verify_reload
+	mmap_log log(0, 64 * 1024, mmap_log::e_format_binary);
+	acl_assert(log.open(filepath));
+	acl_assert(!log.eof());
+	acl_assert(log.last_index() == 9);
+	acl_assert(log.last_term() == 9);
+	log.auto_delete(true);
+}
+
+//empty binary entries fill the index before the data
+void test_small_entries(const char *filepath)
+{
+	log_index_t last_index = 0;
+	{
+		mmap_log log(0, 64 * 1024, mmap_log::e_format_binary);
+		acl_assert(log.open(filepath));
+
+		std::vector<log_entry> entries(10);
+		for (size_t i = 0; i < entries.size(); i++)
+			entries[i].set_term(1);
+
+		for (;;)
+		{
+			size_t count = log.write_batch(entries, 0);
+			if (!count)
+				break;
+			last_index += count;
+		}
+		acl_assert(log.eof());
+		acl_assert(log.last_index() == last_index);
+		acl_assert(log.sync());
+	}
+
+	mmap_log log(0, 64 * 1024, mmap_log::e_format_binary);
+	acl_assert(log.open(filepath));
+	//footer not overwritten by index entries
+	acl_assert(log.eof());
+	acl_assert(log.start_index() == 1);
+	acl_assert(log.last_index() == last_index);
+
+	log_entry entry;
+	acl_assert(log.read(last_index, entry));
+	acl_assert(entry.index() == last_index);
+	log.auto_delete(true);
+}
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	test_log("mmap.log", mmap_log::e_format_protobuf);
+	test_log("mmap_binary.log", mmap_log::e_format_binary);
+	test_upgrade("mmap_upgrade.log");
+	test_broken("mmap_broken.log");
+	test_broken_len("mmap_broken_len.log");
+	test_seal("mmap_seal.log", mmap_log::e_format_protobuf);
+	test_seal("mmap_seal_binary.log", mmap_log::e_format_binary);
+	test_broken_seal("mmap_broken_seal.log");
+	test_small_entries("mmap_small.log");
 
 	return 0;
 }
@@ -0,0 +1,76 @@
+#include "raft.hpp"
+#include <iostream>
+
+
+using namespace raft;
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	multi_raft host("host1", "multi_raft_test/");
+	std::vector<peer_info> peers;
+
+	for (int i = 0; i < 100; i++)
+	{
+		char id[32];
+		sprintf(id, "group%d", i);
+
+		node *_node = host.create_group(id, peers);
+		acl_assert(_node);
+		acl_assert(_node->group_id() == id);
+		acl_assert(host.add_group(id));
+	}
+	acl_assert(host.groups().size() == 100);
+	acl_assert(!host.create_group("group1", peers));
+	acl_assert(!host.add_group("group1"));
+
+	//routed by group_id
+	vote_request req;
+	vote_response resp;
+
+	req.set_group_id("group7");
+	req.set_candidate("host2");
+	req.set_term(100);
+	acl_assert(host.handle_vote_request(req, resp));
+	acl_assert(resp.term() == 100);
+
+	//unknown group
+	resp.Clear();
+	req.set_group_id("group100");
+	acl_assert(host.handle_vote_request(req, resp));
+	acl_assert(!resp.vote_granted());
+
+	//not added yet.metadata not loaded
+	acl_assert(host.create_group("group100", peers));
+	resp.Clear();
+	acl_assert(host.handle_vote_request(req, resp));
+	acl_assert(!resp.vote_granted());
+	acl_assert(resp.term() == 0);
+	acl_assert(host.remove_group("group100"));
+
+	//heartbeats of groups in one request
+	heartbeat_request hb_req;
+	heartbeat_response hb_resp;
+	replicate_log_entries_request *hb = hb_req.add_requests();
+
+	hb->set_group_id("group8");
+	hb->set_leader_id("host2");
+	hb->set_term(100);
+	hb->set_req_id(1);
+	hb = hb_req.add_requests();
+	hb->set_group_id("group100");
+	hb->set_req_id(2);
+	acl_assert(host.handle_heartbeat_request(hb_req, hb_resp));
+	acl_assert(hb_resp.responses_size() == 2);
+	acl_assert(hb_resp.responses(0).term() == 100);
+	acl_assert(hb_resp.responses(0).req_id() == 1);
+	acl_assert(!hb_resp.responses(1).success());
+
+	acl_assert(host.remove_group("group7"));
+	acl_assert(!host.get_group("group7"));
+	acl_assert(host.groups().size() == 99);
+
+	std::cout << "multi_raft test ok" << std::endl;
+	return 0;
+}
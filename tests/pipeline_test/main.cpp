@@ -0,0 +1,128 @@
+#include "raft.hpp"
+#include <iostream>
+
+#include "../test_helper.h"
+
+
+using namespace raft;
+
+#define NODES   3
+#define ENTRIES 2000
+
+//count replicate requests rejected by peers
+struct counting_transport : tcp_transport
+{
+	struct counted_call : callback
+	{
+		counted_call(counting_transport &transport,
+					 replicate_log_entries_response &resp,
+					 callback *_callback)
+			:transport_(transport),
+			 resp_(resp),
+			 callback_(_callback)
+		{
+
+		}
+		virtual void rpc_done(bool ok)
+		{
+			if (ok && !resp_.success())
+				transport_.rejects_++;
+			callback_->rpc_done(ok);
+			delete this;
+		}
+		counting_transport &transport_;
+		replicate_log_entries_response &resp_;
+		callback *callback_;
+	};
+
+	counting_transport()
+		:rejects_(0)
+	{
+
+	}
+	//peers send serialized requests
+	virtual void async_replicate(const std::string &peer_id,
+								 const std::string &req,
+								 replicate_log_entries_response &resp,
+								 callback *_callback)
+	{
+		tcp_transport::async_replicate(peer_id,
+									   req,
+									   resp,
+									   new counted_call(*this,
+														resp,
+														_callback));
+	}
+	std::atomic<int> rejects_;
+};
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	counting_transport transport;
+	std::vector<node*> nodes;
+	std::vector<tcp_transport_server*> servers;
+	std::vector<std::string> addrs;
+
+	//listen first to know the addresses of peers
+	for (int i = 0; i < NODES; i++)
+	{
+		node *_node = new node;
+		tcp_transport_server *server = new tcp_transport_server;
+		server->bind(_node);
+		acl_assert(server->open("127.0.0.1:0"));
+		nodes.push_back(_node);
+		servers.push_back(server);
+		addrs.push_back(server->addr());
+	}
+
+	for (int i = 0; i < NODES; i++)
+	{
+		node *_node = nodes[i];
+		init_node(*_node, "pipeline_test/", i, addrs);
+		_node->set_transport(transport);
+		_node->set_election_timeout(200);
+		_node->set_replicate_pipeline(8);
+		acl_assert(_node->reload());
+	}
+	for (int i = 0; i < NODES; i++)
+		nodes[i]->start();
+
+	node *leader = wait_leader(nodes);
+	acl_assert(leader);
+	std::cout << "leader: " << leader->node_id() << std::endl;
+
+	counter_replicate_callback replicated;
+	for (int i = 0; i < ENTRIES; i++)
+		acl_assert(leader->replicate("hello raft", &replicated));
+
+	for (int i = 0; i < 100 && replicated.ok_ < ENTRIES; i++)
+		acl_doze(100);
+	acl_assert(replicated.ok_ == ENTRIES);
+
+	for (int i = 0; i < NODES; i++)
+	{
+		for (int j = 0; j < 100 &&
+			 nodes[i]->committed_index() < leader->committed_index(); j++)
+			acl_doze(100);
+		acl_assert(nodes[i]->committed_index() ==
+				   leader->committed_index());
+	}
+
+	//requests in flight arrive in order.only the probes of
+	//the new leader may be rejected
+	std::cout << "rejects: " << transport.rejects_ << std::endl;
+	acl_assert(transport.rejects_ <= (NODES - 1) * 2);
+
+	for (int i = 0; i < NODES; i++)
+		servers[i]->stop();
+	for (int i = 0; i < NODES; i++)
+	{
+		delete nodes[i];
+		delete servers[i];
+	}
+
+	std::cout << "pipeline test ok" << std::endl;
+	return 0;
+}
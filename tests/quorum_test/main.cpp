@@ -0,0 +1,78 @@
+#include "raft.hpp"
+#include <iostream>
+#include <algorithm>
+
+
+using namespace raft;
+
+void test_majority()
+{
+	quorum q;
+	int a = q.add_member();
+	int b = q.add_member();
+	int c = q.add_member();
+
+	acl_assert(q.quorum_index() == 0);
+	acl_assert(q.update(a, 10) == 0);
+	acl_assert(q.update(b, 5) == 5);
+	acl_assert(q.update(c, 7) == 7);
+	acl_assert(q.update(b, 20) == 10);
+	//move backward
+	acl_assert(q.update(a, 1) == 7);
+
+	//4 members need 3 of them
+	int d = q.add_member();
+	acl_assert(q.quorum_index() == 1);
+	acl_assert(q.update(d, 8) == 7);
+
+	q.reset(0);
+	acl_assert(q.quorum_index() == 0);
+	std::cout << "test_majority ok" << std::endl;
+}
+
+void test_weight()
+{
+	quorum q;
+	int a = q.add_member(3);
+	int b = q.add_member(1);
+	int c = q.add_member(1);
+
+	//a has more than half of weight
+	acl_assert(q.update(a, 10) == 10);
+	acl_assert(q.update(b, 20) == 10);
+	acl_assert(q.update(c, 30) == 10);
+	acl_assert(q.update(a, 25) == 25);
+	std::cout << "test_weight ok" << std::endl;
+}
+
+void test_random()
+{
+	quorum q;
+	std::vector<log_index_t> indexes(7, 0);
+
+	for (size_t i = 0; i < indexes.size(); i++)
+		q.add_member();
+
+	for (int i = 0; i < 100000; i++)
+	{
+		int slot = rand() % static_cast<int>(indexes.size());
+		indexes[slot] = rand() % 1000;
+
+		std::vector<log_index_t> sorted(indexes);
+		std::sort(sorted.begin(), sorted.end());
+
+		acl_assert(q.update(slot, indexes[slot]) ==
+				   sorted[(sorted.size() - 1) / 2]);
+	}
+	std::cout << "test_random ok" << std::endl;
+}
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	test_majority();
+	test_weight();
+	test_random();
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include "raft.hpp"
+#include <iostream>
+
+#include "../test_helper.h"
+
+
+using namespace raft;
+
+#define NODES 3
+
+//blocking calls only,like http_rpc_transport.calls to the slow
+//peer take long
+struct slow_transport : loopback_transport
+{
+	slow_transport()
+		:slow_(false)
+	{
+
+	}
+	void delay(const std::string &peer_id)
+	{
+		if (slow_ && peer_id == slow_peer_)
+			acl_doze(2000);
+	}
+	virtual bool vote(const std::string &peer_id,
+					  const vote_request &req,
+					  vote_response &resp)
+	{
+		delay(peer_id);
+		return loopback_transport::vote(peer_id, req, resp);
+	}
+	virtual bool replicate(const std::string &peer_id,
+						   const replicate_log_entries_request &req,
+						   replicate_log_entries_response &resp)
+	{
+		delay(peer_id);
+		return loopback_transport::replicate(peer_id, req, resp);
+	}
+	//default async calls of transport
+	virtual void async_vote(const std::string &peer_id,
+							const vote_request &req,
+							vote_response &resp,
+							callback *_callback)
+	{
+		transport::async_vote(peer_id, req, resp, _callback);
+	}
+	virtual void async_replicate(const std::string &peer_id,
+								 const replicate_log_entries_request &req,
+								 replicate_log_entries_response &resp,
+								 callback *_callback)
+	{
+		transport::async_replicate(peer_id, req, resp, _callback);
+	}
+	virtual void async_replicate(const std::string &peer_id,
+								 const std::string &req,
+								 replicate_log_entries_response &resp,
+								 callback *_callback)
+	{
+		transport::async_replicate(peer_id, req, resp, _callback);
+	}
+	std::atomic<bool> slow_;
+	std::string slow_peer_;
+};
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	//one worker for all the peers and timers
+	scheduler _scheduler(1);
+	slow_transport transport;
+	std::vector<node*> nodes;
+	std::vector<std::string> addrs(NODES, "loopback");
+
+	for (int i = 0; i < NODES; i++)
+	{
+		node *_node = new node;
+		init_node(*_node, "slow_peer_test/", i, addrs);
+		_node->set_transport(transport);
+		_node->set_scheduler(_scheduler);
+		//only node0 campaign
+		_node->set_election_timeout(i == 0 ? 300 : 60000);
+		acl_assert(_node->reload());
+
+		transport.bind(_node->node_id(), _node);
+		nodes.push_back(_node);
+	}
+	for (int i = 0; i < NODES; i++)
+		nodes[i]->start();
+
+	node *leader = wait_leader(nodes);
+	acl_assert(leader);
+	std::cout << "leader: " << leader->node_id() << std::endl;
+
+	//calls to a follower take longer than election timeout
+	int slow = 0;
+	while (nodes[slow] == leader)
+		slow++;
+	transport.slow_peer_ = nodes[slow]->node_id();
+	transport.slow_ = true;
+
+	//the other follower commit entries,and keep leader by
+	//heartbeats.workers not wait for the slow one
+	counter_replicate_callback replicated;
+	for (int round = 0; round < 10; round++)
+	{
+		acl_assert(leader->replicate("hello raft", &replicated));
+		for (int i = 0; i < 10 && replicated.ok_ <= round; i++)
+			acl_doze(100);
+		acl_assert(replicated.ok_ == round + 1);
+		acl_assert(leader->is_leader());
+	}
+
+	transport.slow_ = false;
+	for (int i = 0; i < NODES; i++)
+	{
+		transport.unbind(nodes[i]->node_id());
+		delete nodes[i];
+	}
+
+	std::cout << "slow peer test ok" << std::endl;
+	return 0;
+}
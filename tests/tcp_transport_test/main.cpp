@@ -0,0 +1,202 @@
+#include "raft.hpp"
+#include <iostream>
+
+
+using namespace raft;
+
+class vote_thread : public acl::thread
+{
+public:
+	vote_thread(tcp_transport &transport, int calls)
+		:transport_(transport),
+		 calls_(calls),
+		 ok_(0)
+	{
+
+	}
+	int ok()
+	{
+		return ok_;
+	}
+private:
+	virtual void *run()
+	{
+		for (int i = 0; i < calls_; i++)
+		{
+			vote_request req;
+			vote_response resp;
+
+			req.set_group_id("group1");
+			req.set_candidate("host2");
+			req.set_term(200);
+			req.set_req_id(i);
+			if (transport_.vote("host1", req, resp) &&
+				resp.req_id() == (size_t) i)
+				ok_++;
+		}
+		return NULL;
+	}
+	tcp_transport &transport_;
+	int calls_;
+	int ok_;
+};
+
+//async vote.count responses match the request
+struct vote_call : transport::callback
+{
+	vote_call(std::atomic<int> &ok, std::atomic<int> &done)
+		:ok_(ok),
+		 done_(done)
+	{
+
+	}
+	virtual void rpc_done(bool ok)
+	{
+		if (ok && resp_.req_id() == req_.req_id())
+			ok_++;
+		done_++;
+	}
+	vote_request req_;
+	vote_response resp_;
+	std::atomic<int> &ok_;
+	std::atomic<int> &done_;
+};
+
+static void async_votes(tcp_transport &transport,
+						const std::string &peer_id,
+						int calls,
+						int expect_ok)
+{
+	std::atomic<int> ok(0);
+	std::atomic<int> done(0);
+	std::vector<vote_call*> votes;
+
+	//all the requests written before responses come back
+	for (int i = 0; i < calls; i++)
+	{
+		vote_call *call = new vote_call(ok, done);
+		call->req_.set_group_id("group1");
+		call->req_.set_candidate("host2");
+		call->req_.set_term(300);
+		call->req_.set_req_id(i);
+		votes.push_back(call);
+		transport.async_vote(peer_id, call->req_, call->resp_, call);
+	}
+	for (int i = 0; i < 100 && done < calls; i++)
+		acl_doze(100);
+	acl_assert(done == calls);
+	acl_assert(ok == expect_ok);
+
+	for (size_t i = 0; i < votes.size(); i++)
+		delete votes[i];
+}
+
+int main()
+{
+	acl::log::stdout_open(true);
+
+	multi_raft host("host1", "tcp_transport_test/");
+	std::vector<peer_info> peers;
+
+	acl_assert(host.create_group("group0", peers));
+	acl_assert(host.add_group("group0"));
+	acl_assert(host.create_group("group1", peers));
+	acl_assert(host.add_group("group1"));
+
+	tcp_transport_server server;
+	server.bind(&host);
+	acl_assert(server.open("127.0.0.1:0"));
+	std::cout << "listen on " << server.addr() << std::endl;
+
+	tcp_transport transport(1000);
+	transport.add_peer("host1", server.addr());
+	acl_assert(transport.pipeline());
+	acl_assert(!http_rpc_transport::get_instance().pipeline());
+
+	//request and response
+	vote_request req;
+	vote_response resp;
+	req.set_group_id("group0");
+	req.set_candidate("host2");
+	req.set_term(100);
+	acl_assert(transport.vote("host1", req, resp));
+	acl_assert(resp.term() == 100);
+
+	heartbeat_request hb_req;
+	heartbeat_response hb_resp;
+	replicate_log_entries_request *hb = hb_req.add_requests();
+	hb->set_group_id("group0");
+	hb->set_leader_id("host2");
+	hb->set_term(100);
+	hb = hb_req.add_requests();
+	hb->set_group_id("group2");
+	acl_assert(transport.heartbeat("host1", hb_req, hb_resp));
+	acl_assert(hb_resp.responses_size() == 2);
+	acl_assert(hb_resp.responses(0).term() == 100);
+	acl_assert(!hb_resp.responses(1).success());
+
+	//calls of threads share one connection
+	std::vector<vote_thread*> threads;
+	for (int i = 0; i < 8; i++)
+	{
+		threads.push_back(new vote_thread(transport, 1000));
+		threads.back()->start();
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i]->wait();
+		acl_assert(threads[i]->ok() == 1000);
+		delete threads[i];
+	}
+
+	//async calls on the connection
+	async_votes(transport, "host1", 1000, 1000);
+
+	//async calls fail
+	async_votes(transport, "host4", 10, 0);
+
+	//peer not reachable
+	acl_assert(!transport.vote("host3", req, resp));
+	transport.add_peer("host3", "127.0.0.1:1");
+	acl_assert(!transport.vote("host3", req, resp));
+
+	//async calls return at once even if connect hang.
+	//and fail at once while reconnect backoff
+	transport.add_peer("host5", "10.255.255.1:1");
+	std::atomic<int> ok(0);
+	std::atomic<int> done(0);
+	for (int i = 0; i < 2; i++)
+	{
+		timeval begin, end;
+		vote_call call(ok, done);
+		gettimeofday(&begin, NULL);
+		transport.async_vote("host5", call.req_, call.resp_, &call);
+		gettimeofday(&end, NULL);
+		acl_assert((end.tv_sec - begin.tv_sec) * 1000000LL +
+				   end.tv_usec - begin.tv_usec < 100 * 1000);
+		for (int j = 0; j < 30 && done == i; j++)
+			acl_doze(100);
+		acl_assert(done == i + 1);
+	}
+	acl_assert(ok == 0);
+
+	//reconnect after server restart
+	server.stop();
+	acl_assert(!transport.vote("host1", req, resp));
+	async_votes(transport, "host1", 10, 0);
+
+	tcp_transport_server server2;
+	server2.bind(&host);
+	acl_assert(server2.open(server.addr()));
+	//calls fail until reconnect backoff end
+	bool reconnected = false;
+	for (int i = 0; i < 50 && !reconnected; i++)
+	{
+		if (!(reconnected = transport.vote("host1", req, resp)))
+			acl_doze(100);
+	}
+	acl_assert(reconnected);
+
+	std::cout << "tcp_transport test ok" << std::endl;
+	return 0;
+}
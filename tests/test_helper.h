@@ -0,0 +1,94 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "raft.hpp"
+
+//fixtures of the tests run a cluster in one process
+
+struct counter_replicate_callback : raft::replicate_callback
+{
+	counter_replicate_callback()
+		:ok_(0)
+	{
+
+	}
+	virtual bool operator()(status_t status, raft::version)
+	{
+		if (status == E_OK)
+			ok_++;
+		return true;
+	}
+	std::atomic<int> ok_;
+};
+
+static inline raft::node *find_leader(std::vector<raft::node*> &nodes)
+{
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i]->is_leader())
+			return nodes[i];
+	}
+	return NULL;
+}
+
+//wait 10 seconds at most
+static inline raft::node *wait_leader(std::vector<raft::node*> &nodes)
+{
+	raft::node *leader = NULL;
+	for (int i = 0; i < 100 && !(leader = find_leader(nodes)); i++)
+		acl_doze(100);
+	return leader;
+}
+
+static inline std::string test_node_id(int i)
+{
+	char id[32];
+	sprintf(id, "node%d", i);
+	return id;
+}
+
+/**
+ * set id and paths of node<i>.make the dirs of log,metadata
+ * and snapshot in dir/node<i>/
+ */
+static inline void init_node_paths(raft::node &_node,
+								   const std::string &dir,
+								   int i)
+{
+	std::string id = test_node_id(i);
+	std::string path = dir + id + "/";
+
+	acl_make_dirs((path + "log/").c_str(), 0755);
+	acl_make_dirs((path + "metadata/").c_str(), 0755);
+	acl_make_dirs((path + "snapshot/").c_str(), 0755);
+
+	_node.set_node_id(id);
+	_node.set_log_path(path + "log/");
+	_node.set_metadata_path(path + "metadata/");
+	_node.set_snapshot_path(path + "snapshot/");
+}
+
+/**
+ * init node<i> of the cluster.node<j> listen on addrs[j].
+ * caller sets transport and options,then reload it
+ */
+static inline void init_node(raft::node &_node,
+							 const std::string &dir,
+							 int i,
+							 const std::vector<std::string> &addrs)
+{
+	std::vector<raft::peer_info> peers;
+	for (int j = 0; j < static_cast<int>(addrs.size()); j++)
+	{
+		if (j == i)
+			continue;
+		raft::peer_info info;
+		info.peer_id_ = test_node_id(j);
+		info.addr_ = addrs[j];
+		peers.push_back(info);
+	}
+
+	init_node_paths(_node, dir, i);
+	_node.set_peers(peers);
+}